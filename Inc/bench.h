@@ -0,0 +1,6 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+void bench_run(void);
+
+#endif
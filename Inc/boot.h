@@ -0,0 +1,34 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+/*
+ * Set to 1 to defer the startup menu to the print task, so the scheduler (and the control loop
+ * after a warm restart) starts without waiting for the menu to be sent. On a cold start the loop
+ * still waits for the user to enter mod mode. It can also be given on the compiler command line
+ * (-DBOOT_FAST_START=1).
+ */
+#ifndef BOOT_FAST_START
+#define BOOT_FAST_START 0
+#endif
+
+// Boot milestones, in the order they are reached.
+typedef enum
+{
+        BOOT_STAGE_START,      // Cycle counter started, right after the FPU is enabled
+        BOOT_STAGE_CLOCK,      // Reset cause read, PLL running
+        BOOT_STAGE_TIMERS,     // Time base, SysTick and TIM2 (loop and PWM)
+        BOOT_STAGE_IO,         // GPIO, button polling and UART
+        BOOT_STAGE_PLANT,      // Converter model and controllers
+        BOOT_STAGE_CLI,        // Startup menu sent, deferred or state resumed
+        BOOT_STAGE_WATCHDOG,   // IWDG and task supervision running, scheduler starts
+        BOOT_STAGE_FIRST_STEP, // First control step started (a start-up time on warm starts only)
+        BOOT_STAGE_MENU,       // Deferred startup menu sent (fast start only)
+        BOOT_STAGES_NUM
+} boot_stage_t;
+
+void boot_mark(boot_stage_t stage);
+void boot_defer_menu(void);
+void boot_run_deferred(void);
+void boot_print(void);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef C2D_H
+#define C2D_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool c2d_zoh(uint8_t n, const float *Ac, const float *Bc, float h, float *Ad, float *Bd);
+
+#endif
@@ -4,11 +4,12 @@
 #include <stdbool.h>
 
 #include "converter.h"
+#include "scheduler.h"
 
 extern volatile bool cli_stream_is_on;
 
 void cli_init(void);
-void cli_process_rx_byte(void);
+void cli_process_rx_byte(const struct event *event);
 void cli_button_handler(void);
 void cli_configure_mode_LEDs(converter_mode_t mode);
 void cli_configure_text_color(converter_mode_t mode);
@@ -1,17 +1,48 @@
 #ifndef CLOCK_H
 #define CLOCK_H
 
-// Clock values used for this project.
-#define LSI_CLK      32000UL
-#define HSI_CLK      16000000UL
-#define HSE_CLK      8000000UL
-#define SYSCLK       100000000UL
-#define HCLK         100000000UL
-#define PCLK1        (HCLK / 2)
-#define PCLK2        (HCLK / 1)
-#define APB1_TIM_CLK (PCLK1 * 2)
-#define APB2_TIM_CLK (PCLK2)
+#include <stdbool.h>
+#include <stdint.h>
+
+// Oscillator frequencies of the board.
+#define LSI_CLK 32000UL
+#define HSI_CLK 16000000UL
+#define HSE_CLK 8000000UL
+
+// Source the system clock was started from.
+typedef enum
+{
+        CLOCK_SOURCE_HSE_PLL, // PLL from HSE (ST-LINK MCO), the normal case
+        CLOCK_SOURCE_HSI_PLL, // PLL from HSI, HSE did not start
+        CLOCK_SOURCE_HSI,     // HSI directly, the PLL did not lock
+        CLOCK_SOURCES_NUM
+} clock_source_t;
+
+// Run-time clock profiles, named by their SYSCLK.
+typedef enum
+{
+        CLOCK_PROFILE_100MHZ,
+        CLOCK_PROFILE_84MHZ,
+        CLOCK_PROFILE_48MHZ,
+        CLOCK_PROFILE_16MHZ,
+        CLOCK_PROFILES_NUM
+} clock_profile_t;
+
+extern const char *const clock_profile_names[];
 
 void clock_init(void);
+bool clock_set_profile(clock_profile_t profile);
+clock_profile_t clock_get_profile(void);
+void clock_set_auto_scaling(bool on);
+void clock_apply_auto_scaling(bool running);
+void clock_print(void);
+clock_source_t clock_get_source(void);
+const char *clock_get_source_name(void);
+uint32_t clock_get_sysclk(void);
+uint32_t clock_get_hclk(void);
+uint32_t clock_get_pclk1(void);
+uint32_t clock_get_pclk2(void);
+uint32_t clock_get_apb1_timer_clock(void);
+uint32_t clock_get_apb2_timer_clock(void);
 
 #endif
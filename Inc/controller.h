@@ -1,9 +1,33 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
+#include <stdbool.h>
+
+#include "converter.h"
+
 // Maximum reference value is the same as DC link voltage
 #define REF_MAX 50.0f
 
+#define CONTROLLER_TYPES_NUM 4
+
+/*
+ * Set to 1 to run the PID controller in Q31 fixed point (pid_q31.c) instead of single-precision
+ * float. It can also be given on the compiler command line (-DPID_FIXED_POINT=1).
+ */
+#ifndef PID_FIXED_POINT
+#define PID_FIXED_POINT 0
+#endif
+
+typedef enum
+{
+        CONTROLLER_PID,
+        CONTROLLER_LQR,
+        CONTROLLER_PR,
+        CONTROLLER_MPC
+} controller_type_t;
+
+extern const char *const controller_types[];
+
 void pid_init(float kp,
               float ki,
               float kd,
@@ -13,15 +37,25 @@ void pid_init(float kp,
               float controller_out_min,
               float controller_out_max);
 float pid_update(float reference, float measurement);
-void pid_set_kp(float kp);
+float pid_float_update(float reference, float measurement);
+bool pid_set_kp(float kp);
 float pid_get_kp(void);
-void pid_set_ki(float ki);
+bool pid_set_ki(float ki);
 float pid_get_ki(void);
-void pid_set_kd(float kd);
+bool pid_set_kd(float kd);
 float pid_get_kd(void);
 void pid_set_ref(float new_ref);
 float pid_get_ref(void);
 void pid_clear_integrator(void);
 void pid_clear_prev_error(void);
 
-#endif
\ No newline at end of file
+float controller_update(float reference, float measurement);
+void controller_apply_input(float input);
+bool controller_uses_observer(controller_type_t type);
+void controller_reset(void);
+controller_type_t controller_get_type(converter_type_t converter_type);
+void controller_set_type(converter_type_t converter_type, controller_type_t controller_type);
+float controller_get_out_min(void);
+float controller_get_out_max(void);
+
+#endif
@@ -1,12 +1,22 @@
 #ifndef CONVERTER_H
 #define CONVERTER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "model.h"
+
 #define STATES_NUM  6
 #define INPUTS_NUM  1
 #define OUTPUTS_NUM 1
 #define MODES_NUM   3
 #define TYPES_NUM   2
 
+// Model sampling frequency (the continuous model is discretized with h = 1/50e3 = 20 us).
+#define SAMPLING_FREQUENCY 50000.0f
+// Frequency of the sinusoidal reference in inverter type.
+#define SINE_FREQUENCY     50.0f
+
 typedef enum
 {
         IDLE,
@@ -27,10 +37,21 @@ extern const char *const types[];
 extern const char *const types_id[];
 extern float u[][1];
 extern float y[][1];
+extern const float converter_Ac[STATES_NUM][STATES_NUM];
+extern const float converter_Bc[STATES_NUM][INPUTS_NUM];
+extern float converter_Ad[STATES_NUM][STATES_NUM];
+extern float converter_Bd[STATES_NUM][INPUTS_NUM];
+extern const float converter_Cd[OUTPUTS_NUM][STATES_NUM];
+extern const float converter_Dd[OUTPUTS_NUM][INPUTS_NUM];
 
-void converter_init(void);
+model_status_t converter_init(void);
 void converter_reset_state(void);
+void converter_get_state(float x[]);
+void converter_set_state(const float x[]);
+void converter_clamp_state(float limit);
+bool converter_state_in_range(float limit);
 void converter_update(const float u[INPUTS_NUM][1], float y[OUTPUTS_NUM][1]);
+void converter_fast_forward(uint32_t steps, float input);
 converter_type_t converter_get_type(void);
 void converter_set_type(converter_type_t type);
 converter_mode_t converter_get_mode(void);
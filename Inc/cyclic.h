@@ -0,0 +1,11 @@
+#ifndef CYCLIC_H
+#define CYCLIC_H
+
+#define CYCLIC_MINOR_FRAME_MS 5U  // Minor frame (base tick) length, one control loop period
+#define CYCLIC_MINOR_FRAMES   40U // Minor frames per major frame (200 ms)
+
+void cyclic_release_frame(void);
+void cyclic_run(void);
+void cyclic_print(void);
+
+#endif
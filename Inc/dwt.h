@@ -0,0 +1,9 @@
+#ifndef DWT_H
+#define DWT_H
+
+#include <stdint.h>
+
+void dwt_init(void);
+uint32_t dwt_get_cycles(void);
+
+#endif
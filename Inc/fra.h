@@ -0,0 +1,21 @@
+#ifndef FRA_H
+#define FRA_H
+
+#include <stdbool.h>
+
+typedef enum
+{
+        FRA_INJECT_OUTPUT,   // Perturb the controller output, measure the open-loop response
+        FRA_INJECT_REFERENCE // Perturb the reference, measure the closed-loop response
+} fra_injection_t;
+
+void fra_start(fra_injection_t injection, float amplitude);
+void fra_stop(void);
+bool fra_is_running(void);
+fra_injection_t fra_get_injection(void);
+float fra_get_perturbation(void);
+void fra_update(float controller_output, float plant_input, float measurement);
+void fra_print_records(void);
+void fra_print_status(void);
+
+#endif
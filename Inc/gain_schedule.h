@@ -0,0 +1,33 @@
+#ifndef GAIN_SCHEDULE_H
+#define GAIN_SCHEDULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define GS_POINTS_MAX 8
+
+typedef enum
+{
+        GS_SOURCE_REFERENCE,
+        GS_SOURCE_MEASUREMENT
+} gs_source_t;
+
+struct gs_point
+{
+        float x; // Operating point (reference or measured output voltage)
+        float kp;
+        float ki;
+        float kd;
+};
+
+bool gs_is_enabled(void);
+bool gs_enable(bool enable);
+gs_source_t gs_get_source(void);
+void gs_set_source(gs_source_t source);
+void gs_lookup(float x, float *kp, float *ki, float *kd);
+bool gs_stage_point(uint8_t index, struct gs_point point);
+void gs_stage_clear(void);
+int gs_apply(void);
+void gs_dump(void);
+
+#endif
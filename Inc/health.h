@@ -0,0 +1,25 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdint.h>
+
+#define HEALTH_ACTIONS_NUM 3
+
+typedef enum
+{
+        HEALTH_ACTION_CLAMP,  // Saturate the plant state and signals, clear the controllers
+        HEALTH_ACTION_RESET,  // Zero the plant state, signals and controllers
+        HEALTH_ACTION_CONFIG  // Stop the loop by going to config mode
+} health_action_t;
+
+extern const char *const health_actions[];
+
+void health_clear_flags(void);
+void health_check(void);
+health_action_t health_get_action(void);
+void health_set_action(health_action_t action);
+void health_clear_log(void);
+void health_print(void);
+void health_print_events(void);
+
+#endif
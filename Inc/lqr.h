@@ -0,0 +1,7 @@
+#ifndef LQR_H
+#define LQR_H
+
+void lqr_reset(void);
+float lqr_update(float reference, float measurement);
+
+#endif
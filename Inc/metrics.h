@@ -0,0 +1,27 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct metrics
+{
+        uint32_t steps;          // Steps since the last reference change
+        float iae;               // Integral of absolute error
+        float ise;               // Integral of squared error
+        float itae;              // Integral of time-weighted absolute error
+        float overshoot;         // Peak overshoot in percent of the step size
+        bool risen;              // The output has passed 90 % of the step
+        uint32_t rise_steps;     // 10 % to 90 % rise time (valid once risen, may be 0)
+        uint32_t settling_steps; // Steps until the output stays within the band
+        uint32_t saturated_steps;
+};
+
+void metrics_reset(void);
+void metrics_update(float setpoint, float reference, float measurement, float input);
+struct metrics metrics_get(void);
+float metrics_get_band(void);
+void metrics_set_band(float band_percent);
+void metrics_print(void);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef MODAL_H
+#define MODAL_H
+
+#include <stdbool.h>
+
+bool modal_discretize(float h, float *values);
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MODEL_STATES_MAX   8           // Largest plant order accepted by the model store
+#define MODEL_FF_STEPS_MAX (1UL << 24U) // Longest fast-forward, in model steps (335 s)
+
+typedef enum
+{
+        MODEL_DENSE, // Built-in model as Ad, Bd, Cd, Dd
+        MODEL_MODAL  // Built-in model in real block-diagonal form (modal.c)
+} model_realization_t;
+
+typedef enum
+{
+        MODEL_OK,
+        MODEL_ERR_LENGTH,
+        MODEL_ERR_HEADER,
+        MODEL_ERR_ORDER,
+        MODEL_ERR_CRC,
+        MODEL_ERR_VALUE,
+        MODEL_ERR_UNSTABLE,
+        MODEL_ERR_BUSY
+} model_status_t;
+
+struct model;
+
+typedef void (*model_kernel_t)(const struct model *model, float *x, float input);
+
+struct model
+{
+        uint8_t states;
+        float A[MODEL_STATES_MAX][MODEL_STATES_MAX];
+        float B[MODEL_STATES_MAX];
+        float C[MODEL_STATES_MAX];
+        float D;
+        float radius; // Spectral radius estimate of A
+
+        // Kernels chosen when the model is built
+        model_kernel_t state_kernel;
+        bool output_is_selector; // C has a single 1 at output_index
+        uint8_t output_index;
+        bool has_feedthrough;    // D != 0
+
+        // A in compressed sparse row form (used by the sparse kernel only)
+        uint8_t nonzeros;
+        uint8_t row_start[MODEL_STATES_MAX + 1];
+        uint8_t columns[MODEL_STATES_MAX * MODEL_STATES_MAX];
+        float values[MODEL_STATES_MAX * MODEL_STATES_MAX];
+
+        // Diagonal blocks of A (used by the block kernels only)
+        uint8_t blocks;
+        uint8_t block_start[MODEL_STATES_MAX + 1];
+};
+
+extern const char *const model_realizations[];
+extern const char *const model_status_messages[];
+
+model_status_t model_init(void);
+size_t model_blob_length(uint8_t states);
+model_status_t model_load_blob(const uint8_t *blob, size_t length);
+model_status_t model_load_builtin(model_realization_t realization);
+model_status_t model_build_builtin(struct model *model, model_realization_t realization);
+bool model_swap_if_pending(void);
+float model_step(float x[MODEL_STATES_MAX], float input);
+float model_run(const struct model *model, float x[MODEL_STATES_MAX], float input);
+float model_fast_forward(float x[MODEL_STATES_MAX], float input, uint32_t steps);
+uint8_t model_get_states(void);
+bool model_is_available(void);
+void model_print_builtin_errors(void);
+bool model_receive_start(uint8_t states);
+void model_receive_poll(void);
+void model_print(void);
+
+#endif
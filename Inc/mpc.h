@@ -0,0 +1,11 @@
+#ifndef MPC_H
+#define MPC_H
+
+#include <stdint.h>
+
+void mpc_reset(void);
+float mpc_update(float reference, float measurement);
+uint32_t mpc_get_regions_num(void);
+uint32_t mpc_measure_worst_case(void);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef OBSERVER_H
+#define OBSERVER_H
+
+#include "converter.h"
+
+void observer_reset(void);
+const float *observer_correct(float measurement);
+void observer_predict(float input);
+
+#endif
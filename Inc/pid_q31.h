@@ -0,0 +1,21 @@
+#ifndef PID_Q31_H
+#define PID_Q31_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef int32_t q31_t;
+
+void pid_q31_init(float Ts,
+                  float int_out_min,
+                  float int_out_max,
+                  float controller_out_min,
+                  float controller_out_max);
+void pid_q31_set_gains(float kp, float ki, float kd);
+bool pid_q31_gains_fit(float kp, float ki, float kd);
+void pid_q31_get_gain_limits(float *kp_max, float *ki_max, float *kd_max);
+void pid_q31_reset(void);
+float pid_q31_update(float reference, float measurement);
+float pid_q31_step(float kp, float ki, float kd, float reference, float measurement);
+
+#endif
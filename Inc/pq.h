@@ -0,0 +1,24 @@
+#ifndef PQ_H
+#define PQ_H
+
+#include <stdint.h>
+
+#define PQ_ODD_HARMONICS 6 // Odd harmonics tracked above the fundamental (3rd to 13th)
+
+struct pq_result
+{
+        uint32_t periods;                  // Complete periods analyzed since the last reset
+        float rms;                         // RMS of the output voltage over the last period
+        float fundamental;                 // Fundamental amplitude
+        float amplitude_error;             // Fundamental amplitude - reference amplitude
+        float phase_error;                 // Fundamental phase - reference phase in degrees
+        float harmonics[PQ_ODD_HARMONICS]; // Amplitudes of the 3rd, 5th, ... harmonics
+        float thd;                         // Total harmonic distortion in percent
+};
+
+void pq_reset(void);
+void pq_update(float phase, float measurement);
+struct pq_result pq_get(void);
+void pq_print(void);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef PR_H
+#define PR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void pr_init(void);
+void pr_reset(void);
+float pr_update(float reference, float measurement);
+void pr_set_kr(float kr);
+float pr_get_kr(void);
+bool pr_set_harmonic(uint8_t harmonic, bool enable);
+bool pr_harmonic_is_enabled(uint8_t harmonic);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef RESTART_H
+#define RESTART_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void restart_init(void);
+bool restart_is_warm(void);
+uint32_t restart_get_reset_flags(void);
+void restart_resume(void);
+void restart_save(void);
+
+#endif
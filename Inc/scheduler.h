@@ -1,20 +1,64 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 
-#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 
-enum
+#define SCHEDULER_QUEUE_CAPACITY 32U // Events per priority level (a power of two)
+
+/*
+ * Set to 1 to run the time-triggered cyclic executive (cyclic.c) instead of the event-driven
+ * scheduler. It can also be given on the compiler command line (-DSCHEDULER_CYCLIC=1).
+ */
+#ifndef SCHEDULER_CYCLIC
+#define SCHEDULER_CYCLIC 0
+#endif
+
+// One event queue per task, indexed by priority (0 is the highest).
+typedef enum
+{
+        QUEUE_LOOP,   // control loop update task (TIM2)
+        QUEUE_UART,   // UART command task (UART2)
+        QUEUE_BUTTON, // button command task (push button, polled by a software timer)
+        QUEUE_PRINT,  // output print task (SysTick)
+        QUEUES_NUM
+} scheduler_queue_t;
+
+typedef enum
+{
+        EVENT_TICK,   // TIM2 update, data.tick is the number of the release
+        EVENT_BYTE,   // Received UART byte, data.byte
+        EVENT_BUTTON, // Debounced button edge, data.pressed is the new state
+        EVENT_PRINT   // 200 ms print period
+} event_type_t;
+
+struct event
+{
+        event_type_t type;
+        uint64_t time_us; // Time base (time_now_us) when the event was posted
+        union
+        {
+                uint32_t tick;
+                uint8_t byte;
+                bool pressed;
+        } data;
+};
+
+struct scheduler_queue_stats
 {
-        TASK0 = (1UL << 0U), // control loop update task (TIM2)
-        TASK1 = (1UL << 1U), // UART command task (UART2)
-        TASK2 = (1UL << 2U), // button command task (push button, TIM3)
-        TASK3 = (1UL << 3U)  // output print task (SysTick)
+        uint32_t posted;    // Events accepted since start-up
+        uint32_t dropped;   // Events lost because the queue was full
+        uint32_t max_depth;      // Most events waiting at once
+        uint32_t max_latency_us; // Longest time from posting an event to running its task
 };
 
-extern _Atomic uint32_t ready_flag_word;
+extern const char *const scheduler_queue_names[];
 
 void scheduler_init(void);
 void scheduler_run(void);
+bool scheduler_post(scheduler_queue_t queue, const struct event *event);
+bool scheduler_dispatch(scheduler_queue_t queue);
+void scheduler_flush(scheduler_queue_t queue);
+struct scheduler_queue_stats scheduler_get_queue_stats(scheduler_queue_t queue);
 
-#endif
\ No newline at end of file
+#endif
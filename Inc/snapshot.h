@@ -0,0 +1,24 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "model.h"
+
+// Signals of one control step, all from the same step.
+struct loop_snapshot
+{
+        uint32_t tick;             // Control steps published since start-up
+        uint64_t time_us;          // Time base (time_now_us) at the end of the step
+        float setpoint;            // Reference set by the user
+        float ref;                 // Instantaneous reference (sinusoidal in inverter type)
+        float phase;               // Reference phase in inverter type
+        float u;                   // Plant input
+        float y;                   // Plant output
+        float x[MODEL_STATES_MAX]; // Plant state
+};
+
+void snapshot_publish(const struct loop_snapshot *sample);
+struct loop_snapshot snapshot_read(void);
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include <stdint.h>
+
+// Tasks that must keep checking in for the watchdogs to be petted.
+typedef enum
+{
+        SUPERVISOR_LOOP,       // Control loop task (expected in mod mode only)
+        SUPERVISOR_BUTTON,     // Button polling (software timer or cyclic slot)
+        SUPERVISOR_PRINT,      // Output print task
+        SUPERVISOR_BACKGROUND, // Scheduler background loop (CLI)
+        SUPERVISOR_TASKS_NUM
+} supervisor_task_t;
+
+void supervisor_init(void);
+void supervisor_check_in(supervisor_task_t task);
+void supervisor_print(void);
+
+#endif
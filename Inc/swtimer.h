@@ -0,0 +1,32 @@
+#ifndef SWTIMER_H
+#define SWTIMER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Callback of an expired timer. It runs in the SysTick interrupt, so it must be short.
+typedef void (*swtimer_callback_t)(void);
+
+/*
+ * A software timer. The caller owns the storage (usually a static variable) and must not touch
+ * the fields; a zero-initialized timer is stopped.
+ */
+struct swtimer
+{
+        struct swtimer *next;        // Next timer in the same wheel slot
+        struct swtimer **pprev;      // Link pointing to this timer, NULL when it is stopped
+        uint64_t expiry_ms;          // Wheel time when the timer fires
+        uint32_t period_ms;          // Reload period, 0 for a one-shot timer
+        swtimer_callback_t callback; // Called when the timer fires (may be NULL)
+};
+
+void swtimer_tick(void);
+uint64_t swtimer_now_ms(void);
+void swtimer_start(struct swtimer *timer,
+                   swtimer_callback_t callback,
+                   uint32_t delay_ms,
+                   uint32_t period_ms);
+void swtimer_cancel(struct swtimer *timer);
+bool swtimer_is_active(const struct swtimer *timer);
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef SYSID_H
+#define SYSID_H
+
+#include <stdint.h>
+
+#define SYSID_NA     6 // Order of the output polynomial A(q)
+#define SYSID_NB     6 // Number of input coefficients of B(q)
+#define SYSID_PARAMS (SYSID_NA + SYSID_NB)
+
+struct sysid_estimate
+{
+        uint32_t samples;  // Samples since the last reset
+        float a[SYSID_NA]; // A(q) = 1 + a1*q^-1 + ... + a_na*q^-na
+        float b[SYSID_NB]; // B(q) = b1*q^-1 + ... + b_nb*q^-nb
+        float fit;         // 100 * (1 - RMS of prediction error / RMS of output variation)
+        float dc_gain;     // B(1) / A(1)
+        float trace;       // Trace of the covariance matrix
+};
+
+void sysid_reset(void);
+void sysid_update(float input, float output);
+struct sysid_estimate sysid_get(void);
+float sysid_get_lambda(void);
+void sysid_set_lambda(float lambda);
+void sysid_print(void);
+
+#endif
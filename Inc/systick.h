@@ -3,10 +3,14 @@
 
 #include <stdint.h>
 
+#include "scheduler.h"
+
 extern uint16_t systick_print_counter;
 
 void systick_init(void);
+void systick_rescale(uint32_t lost_us);
+void systick_release_print(void);
 uint32_t systick_get_ticks(void);
-void systick_print_output(void);
+void systick_print_output(const struct event *event);
 
 #endif
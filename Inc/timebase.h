@@ -0,0 +1,12 @@
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdint.h>
+
+#define TIMEBASE_FREQUENCY 1000000UL // TIM5 counter frequency (1 us resolution)
+
+void timebase_init(void);
+void timebase_rescale(uint32_t lost_us);
+uint64_t time_now_us(void);
+
+#endif
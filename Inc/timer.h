@@ -3,21 +3,61 @@
 
 #include <stdint.h>
 
+#include "scheduler.h"
+
 /*
  * TIM2 frequency determines the rate of the update of the control loop and converter state
  * vector. It is also the frequency of PWM signal driving the green LED, because it uses
  * channel 1 of TIM2. TIM2 update event frequency is loop update frequency meaning each second model
  * goes TIM2_FREQUENCY steps ahead where each step is h = 1/Fs = 1/50e3 = 2e-5 in real time.
  *
- * TIM3 frequency determines the time for debounce of the push-button. Here the frequency is
- * chosen to be 50 Hz so that a valid press button signal should last for at least 20 ms.
+ * The button polling period determines the time for debounce of the push-button. It is chosen to
+ * be 20 ms so that a valid press button signal should last for at least 20 ms. The button is
+ * polled by a software timer (swtimer.c).
  */
-#define TIM2_FREQUENCY 200UL
-#define TIM3_FREQUENCY 50UL
+#define TIM2_FREQUENCY        200UL
+#define BUTTON_POLL_PERIOD_MS 20UL
+
+#define TIM2_CATCHUP_POLICIES_NUM 3
+
+/*
+ * What the control task does with TIM2 releases that it missed (it was still pending when TIM2
+ * fired again):
+ * - skip: drop them, so simulated time falls behind the tick count.
+ * - step: run the full loop once for each of them, up to a limit per task run.
+ * - ff:   advance the plant over them with the last input held (zero-order hold), then run the
+ *         loop once.
+ */
+typedef enum
+{
+        TIM2_CATCHUP_SKIP,
+        TIM2_CATCHUP_STEP,
+        TIM2_CATCHUP_FAST_FORWARD
+} tim2_catchup_t;
+
+struct tim2_catchup_stats
+{
+        uint32_t releases;  // TIM2 update events since the counters were cleared
+        uint32_t dropped;   // Releases that were never stepped
+        uint32_t stepped;   // Missed releases caught up with full loop steps
+        uint32_t forwarded; // Missed releases caught up with plant fast-forward
+        uint32_t max_late;  // Largest number of releases missed at once
+};
+
+extern const char *const tim2_catchup_policies[];
 
-void tim3_init(uint32_t timer_freq);
 void tim2_init(uint32_t timer_freq);
-void tim2_update_loop(void);
-void tim3_read_button(void);
+void tim2_rescale(uint32_t lost_us);
+void tim2_release(void);
+void tim2_update_loop(const struct event *event);
+void tim2_clear_releases(void);
+tim2_catchup_t tim2_get_catchup(void);
+uint32_t tim2_get_catchup_limit(void);
+void tim2_set_catchup(tim2_catchup_t policy, uint32_t limit);
+struct tim2_catchup_stats tim2_get_catchup_stats(void);
+void tim2_clear_catchup_stats(void);
+void timer_button_init(void);
+void timer_sample_button(void);
+void timer_read_button(const struct event *event);
 
 #endif
\ No newline at end of file
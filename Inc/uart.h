@@ -3,9 +3,12 @@
 
 #include <stdint.h>
 
-extern volatile uint8_t uart_read_char;
-
 void uart2_init(void);
-void uart2_write_char_blocking(char ch);
+void uart2_write_char(char ch);
+void uart2_wait_tx_done(void);
+void uart2_rescale(void);
+void uart2_raw_receive_start(uint8_t *buffer, uint16_t length);
+void uart2_raw_receive_stop(void);
+uint16_t uart2_raw_receive_count(void);
 
 #endif
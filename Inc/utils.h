@@ -1,6 +1,9 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define PI                 3.141592f
 
 #define CLAMP(x, min, max) (((x) < (min)) ? (min) : (((x) > (max)) ? (max) : (x)))
@@ -9,5 +12,6 @@
 
 float str_to_float(const char *str);
 void str_to_lower(char *str);
+uint32_t crc32(const uint8_t *data, size_t length);
 
 #endif
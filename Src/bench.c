@@ -0,0 +1,342 @@
+/*
+ * bench.c
+ *
+ * Description:
+ *     On-target benchmark of the available controller types.
+ *
+ *     Each controller is run in closed loop with the converter model for a reference step from
+ *     0 V to the current reference, starting from a zero state. For each controller this module
+ *     reports:
+ *     - Settling time to a band around the reference (in model steps and model time)
+ *     - Peak overshoot
+ *     - Average and worst-case core cycles per controller step (measured with DWT CYCCNT)
+ *
+ *     It also reports the cycles of an MPC region search that scans every region, which bounds
+ *     the explicit MPC step, against the cycle budget of one model step at the 50 kHz model rate.
+ *
+ *     The float and Q31 fixed-point PID controllers are then run side by side on the same closed
+ *     loop (the float one drives the plant, the fixed-point one sees the same reference and
+ *     measurement), and the cycles per step of each and their largest output difference are
+ *     reported.
+ *
+ *     Finally the dense and modal realizations of the built-in plant model are driven open loop
+ *     with the same square-wave input, and the largest output difference and the cycles per plant
+ *     step of each are reported.
+ *
+ *     Last, the average and worst-case cycles of one read of each time source (the microsecond
+ *     time base, the SysTick tick and the software timer clock) are reported.
+ *
+ * Notes:
+ *     - The benchmark uses the real plant and controller instances, so it is only allowed in
+ *       config mode where the control loop is stopped. All states are cleared when it returns.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "bench.h"
+
+#include "controller.h"
+#include "converter.h"
+#include "dwt.h"
+#include "clock.h"
+#include "lqr.h"
+#include "model.h"
+#include "mpc.h"
+#include "observer.h"
+#include "pid_q31.h"
+#include "pr.h"
+#include "swtimer.h"
+#include "systick.h"
+#include "terminal.h"
+#include "timebase.h"
+#include "utils.h"
+
+#define BENCH_STEPS        3000U
+#define BENCH_BAND         0.02f // Settling band relative to the step size
+#define BENCH_DEFAULT_STEP 40.0f // Step size used when the reference is 0
+#define BENCH_INPUT_PERIOD 500U  // Half period of the square-wave plant input in model steps
+
+typedef float (*bench_update_fn)(float reference, float measurement);
+
+struct bench_result
+{
+        uint32_t settling_steps;
+        float overshoot;
+        uint32_t avg_cycles;
+        uint32_t max_cycles;
+};
+
+// Controllers under test, indexed by controller_type_t.
+static const bench_update_fn bench_controllers[CONTROLLER_TYPES_NUM] = {pid_update,
+                                                                        lqr_update,
+                                                                        pr_update,
+                                                                        mpc_update};
+
+// Dense and modal realizations of the plant, indexed by model_realization_t.
+static struct model bench_models[2];
+
+static uint32_t bench_cycles_overhead(void);
+static struct bench_result bench_step_response(controller_type_t type, float step);
+static void bench_pid_paths(float step);
+static void bench_realizations(float step);
+static void bench_time_reads(void);
+
+void bench_run(void)
+{
+        float step = pid_get_ref();
+        if (step == 0.0f)
+        {
+                step = BENCH_DEFAULT_STEP;
+        }
+
+        printf("  Controller benchmark (%u steps, step to %.2f V, %.0f%% band)",
+               BENCH_STEPS,
+               step,
+               100.0f * BENCH_BAND);
+        terminal_insert_new_line();
+        printf("  ctrl   settling [steps]   settling [ms]   overshoot [%%]   cycles avg/max");
+        terminal_insert_new_line();
+
+        for (size_t i = 0; i < CONTROLLER_TYPES_NUM; i++)
+        {
+                struct bench_result result = bench_step_response((controller_type_t)i, step);
+
+                printf("  %-5s  ", controller_types[i]);
+                if (result.settling_steps < BENCH_STEPS)
+                {
+                        printf("%15lu   %13.3f",
+                               (unsigned long)result.settling_steps,
+                               1000.0f * result.settling_steps / SAMPLING_FREQUENCY);
+                }
+                else
+                {
+                        printf("%15s   %13s", "not settled", "-");
+                }
+                printf("   %13.2f   %6lu/%-6lu",
+                       result.overshoot,
+                       (unsigned long)result.avg_cycles,
+                       (unsigned long)result.max_cycles);
+                terminal_insert_new_line();
+        }
+
+        printf("  MPC search over all %lu regions: %lu cycles (budget per model step: %lu cycles)",
+               (unsigned long)mpc_get_regions_num(),
+               (unsigned long)mpc_measure_worst_case(),
+               (unsigned long)(clock_get_hclk() / (uint32_t)SAMPLING_FREQUENCY));
+        terminal_insert_new_line();
+
+        bench_pid_paths(step);
+        bench_realizations(step);
+        bench_time_reads();
+
+        // Leave the plant and the controllers as they were found in config mode.
+        converter_reset_state();
+        controller_reset();
+        u[0][0] = 0.0f;
+        y[0][0] = 0.0f;
+}
+
+// Cycles spent by two back-to-back reads of the cycle counter, subtracted from every measurement.
+static uint32_t bench_cycles_overhead(void)
+{
+        uint32_t start = dwt_get_cycles();
+        uint32_t end   = dwt_get_cycles();
+
+        return end - start;
+}
+
+static struct bench_result bench_step_response(controller_type_t type, float step)
+{
+        bench_update_fn update     = bench_controllers[type];
+        bool observer              = controller_uses_observer(type);
+        struct bench_result result = {0};
+        float bu[INPUTS_NUM][1]    = {{0.0f}};
+        float by[OUTPUTS_NUM][1]   = {{0.0f}};
+        float band                 = BENCH_BAND * ABS_FLOAT(step);
+        float peak                 = 0.0f;
+        uint32_t overhead          = bench_cycles_overhead();
+        uint64_t total_cycles      = 0U;
+
+        converter_reset_state();
+        controller_reset();
+
+        // settling_steps ends up one past the last step outside the band.
+        for (uint32_t k = 0U; k < BENCH_STEPS; k++)
+        {
+                uint32_t start  = dwt_get_cycles();
+                bu[0][0]        = update(step, by[0][0]);
+                if (observer)
+                {
+                        observer_predict(bu[0][0]);
+                }
+                uint32_t cycles = dwt_get_cycles() - start - overhead;
+
+                converter_update(bu, by);
+
+                total_cycles += cycles;
+                if (cycles > result.max_cycles)
+                {
+                        result.max_cycles = cycles;
+                }
+
+                float deviation = by[0][0] - step;
+                if (ABS_FLOAT(deviation) > band)
+                {
+                        result.settling_steps = k + 1U;
+                }
+
+                // Overshoot is the largest excursion past the reference in the step direction.
+                float excursion = (step > 0.0f) ? deviation : -deviation;
+                if (excursion > peak)
+                {
+                        peak = excursion;
+                }
+        }
+
+        result.overshoot  = 100.0f * peak / ABS_FLOAT(step);
+        result.avg_cycles = (uint32_t)(total_cycles / BENCH_STEPS);
+
+        return result;
+}
+
+static void bench_pid_paths(float step)
+{
+        float bu[INPUTS_NUM][1]  = {{0.0f}};
+        float by[OUTPUTS_NUM][1] = {{0.0f}};
+        uint64_t float_cycles    = 0U;
+        uint64_t fixed_cycles    = 0U;
+        float max_difference     = 0.0f;
+        uint32_t overhead        = bench_cycles_overhead();
+
+        converter_reset_state();
+        controller_reset();
+
+        for (uint32_t k = 0U; k < BENCH_STEPS; k++)
+        {
+                uint32_t start = dwt_get_cycles();
+                bu[0][0]       = pid_float_update(step, by[0][0]);
+                float_cycles += dwt_get_cycles() - start - overhead;
+
+                start             = dwt_get_cycles();
+                float fixed_input = pid_q31_update(step, by[0][0]);
+                fixed_cycles += dwt_get_cycles() - start - overhead;
+
+                float difference = ABS_FLOAT(fixed_input - bu[0][0]);
+                if (difference > max_difference)
+                {
+                        max_difference = difference;
+                }
+
+                converter_update(bu, by);
+        }
+
+        printf("  PID arithmetic (%s in the loop): float %lu, Q31 %lu cycles per step, "
+               "max |u_q31 - u_float| = %.3g V",
+               PID_FIXED_POINT ? "Q31" : "float",
+               (unsigned long)(float_cycles / BENCH_STEPS),
+               (unsigned long)(fixed_cycles / BENCH_STEPS),
+               max_difference);
+        terminal_insert_new_line();
+}
+
+static void bench_realizations(float step)
+{
+        float x[2][MODEL_STATES_MAX] = {{0.0f}};
+        uint64_t total_cycles[2]     = {0U};
+        float max_error              = 0.0f;
+        float max_output             = 0.0f;
+        uint32_t overhead            = bench_cycles_overhead();
+
+        for (size_t r = 0; r < 2U; r++)
+        {
+                if (model_build_builtin(&bench_models[r], (model_realization_t)r) != MODEL_OK)
+                {
+                        printf("  The %s realization could not be built.", model_realizations[r]);
+                        terminal_insert_new_line();
+                        return;
+                }
+        }
+
+        for (uint32_t k = 0U; k < BENCH_STEPS; k++)
+        {
+                float input = ((k / BENCH_INPUT_PERIOD) % 2U == 0U) ? step : -step;
+                float output[2];
+
+                for (size_t r = 0; r < 2U; r++)
+                {
+                        uint32_t start = dwt_get_cycles();
+                        output[r]      = model_run(&bench_models[r], x[r], input);
+                        total_cycles[r] += dwt_get_cycles() - start - overhead;
+                }
+
+                float error = ABS_FLOAT(output[MODEL_MODAL] - output[MODEL_DENSE]);
+                if (error > max_error)
+                {
+                        max_error = error;
+                }
+                if (ABS_FLOAT(output[MODEL_DENSE]) > max_output)
+                {
+                        max_output = ABS_FLOAT(output[MODEL_DENSE]);
+                }
+        }
+
+        printf("  Plant realizations (%u steps, square wave of +-%.2f V):", BENCH_STEPS, step);
+        terminal_insert_new_line();
+        for (size_t r = 0; r < 2U; r++)
+        {
+                printf("  %-5s  %lu cycles per step",
+                       model_realizations[r],
+                       (unsigned long)(total_cycles[r] / BENCH_STEPS));
+                terminal_insert_new_line();
+        }
+        printf("  max |y_modal - y_dense| = %.3g V (%.3g of the peak output)",
+               max_error,
+               (max_output > 0.0f) ? max_error / max_output : 0.0f);
+        terminal_insert_new_line();
+}
+
+// Cycles of one read of each time source, average and worst case over BENCH_STEPS reads.
+static void bench_time_reads(void)
+{
+        uint64_t timebase_cycles = 0U;
+        uint64_t systick_cycles  = 0U;
+        uint64_t swtimer_cycles  = 0U;
+        uint32_t timebase_max    = 0U;
+        uint32_t systick_max     = 0U;
+        uint32_t swtimer_max     = 0U;
+        uint32_t overhead        = bench_cycles_overhead();
+
+        for (uint32_t k = 0U; k < BENCH_STEPS; k++)
+        {
+                uint32_t start = dwt_get_cycles();
+                (void)time_now_us();
+                uint32_t cycles = dwt_get_cycles() - start - overhead;
+                timebase_cycles += cycles;
+                timebase_max = (cycles > timebase_max) ? cycles : timebase_max;
+
+                start = dwt_get_cycles();
+                (void)systick_get_ticks();
+                cycles = dwt_get_cycles() - start - overhead;
+                systick_cycles += cycles;
+                systick_max = (cycles > systick_max) ? cycles : systick_max;
+
+                start = dwt_get_cycles();
+                (void)swtimer_now_ms();
+                cycles = dwt_get_cycles() - start - overhead;
+                swtimer_cycles += cycles;
+                swtimer_max = (cycles > swtimer_max) ? cycles : swtimer_max;
+        }
+
+        printf("  Time reads, cycles avg/max: time_now_us %lu/%lu, systick_get_ticks %lu/%lu, "
+               "swtimer_now_ms %lu/%lu",
+               (unsigned long)(timebase_cycles / BENCH_STEPS),
+               (unsigned long)timebase_max,
+               (unsigned long)(systick_cycles / BENCH_STEPS),
+               (unsigned long)systick_max,
+               (unsigned long)(swtimer_cycles / BENCH_STEPS),
+               (unsigned long)swtimer_max);
+        terminal_insert_new_line();
+}
@@ -0,0 +1,159 @@
+/*
+ * boot.c
+ *
+ * Description:
+ *     Boot-time profiler and deferred startup menu.
+ *
+ *     main() marks the end of each init stage with boot_mark(). A mark stores the DWT cycle
+ *     counter and the core clock at that point, and the "boot" command reports the time from the
+ *     start of main (the cycle counter starts right after the FPU is enabled) to each mark and the
+ *     time spent in each stage. The control task marks the start of the first control step.
+ *
+ *     The time to the first control step is a start-up time on a warm start only, where the
+ *     saved mode is resumed and the loop runs at once. On a cold start the converter comes up in
+ *     idle mode and the loop waits for the user to enter mod mode, so that mark measures the
+ *     user and the report says so.
+ *
+ *     With BOOT_FAST_START set, main() does not send the startup menu. It is sent by the print
+ *     task on its first run instead, after the scheduler has started. This shortens the time to
+ *     the first control step of a warm start; a cold start still waits for mod mode.
+ *
+ * Notes:
+ *     - The time before main() (startup code, .data copy and .bss clear) is not included, the
+ *       cycle counter only runs from dwt_init().
+ *     - The cycles of a stage are converted with the core clock at the start of the stage. The
+ *       clock stage runs on HSI (16 MHz) until its last instruction switches to the PLL.
+ *     - CYCCNT wraps after about 43 s at 100 MHz. A mark reached longer than BOOT_CYCLES_RANGE_MS
+ *       after the previous one (the first control step of a cold start waits for the user) is
+ *       timed with the SysTick tick instead, with 1 ms resolution.
+ *     - Each stage is marked once, later marks of the same stage are ignored.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "boot.h"
+
+#include "cli.h"
+#include "clock.h"
+#include "dwt.h"
+#include "restart.h"
+#include "systick.h"
+#include "terminal.h"
+
+#define BOOT_CYCLES_RANGE_MS 40000UL // Largest interval timed with the cycle counter
+
+struct boot_record
+{
+        bool reached;
+        uint32_t cycles;   // DWT cycle counter at the mark
+        uint32_t clock_hz; // Core clock at the mark
+        uint32_t ms;       // SysTick tick at the mark (0 before SysTick runs)
+        uint32_t us;       // Time from the start of main
+        uint32_t stage_us; // Time from the mark reached before this one
+};
+
+static const char *const boot_stage_names[BOOT_STAGES_NUM] = {"start",
+                                                              "clock",
+                                                              "timers",
+                                                              "io",
+                                                              "plant",
+                                                              "cli",
+                                                              "watchdog",
+                                                              "first step",
+                                                              "menu"};
+
+static struct boot_record boot_records[BOOT_STAGES_NUM];
+static boot_stage_t boot_last_stage = BOOT_STAGE_START;
+static volatile bool boot_menu_pending = false;
+
+void boot_mark(boot_stage_t stage)
+{
+        uint32_t cycles            = dwt_get_cycles();
+        struct boot_record *record = &boot_records[stage];
+
+        if (record->reached)
+        {
+                return;
+        }
+
+        record->cycles   = cycles;
+        record->clock_hz = clock_get_hclk();
+        record->ms       = systick_get_ticks();
+        record->us       = 0UL;
+
+        if (stage != BOOT_STAGE_START)
+        {
+                const struct boot_record *previous = &boot_records[boot_last_stage];
+
+                if (record->ms - previous->ms > BOOT_CYCLES_RANGE_MS)
+                {
+                        record->us = previous->us + 1000UL * (record->ms - previous->ms);
+                }
+                else
+                {
+                        record->us = previous->us +
+                                     (cycles - previous->cycles) / (previous->clock_hz / 1000000UL);
+                }
+                record->stage_us = record->us - previous->us;
+        }
+
+        record->reached = true;
+        boot_last_stage = stage;
+}
+
+// Leave the startup menu to the print task (fast start).
+void boot_defer_menu(void)
+{
+        boot_menu_pending = true;
+}
+
+// Send the deferred startup menu (called by the print task).
+void boot_run_deferred(void)
+{
+        if (boot_menu_pending)
+        {
+                boot_menu_pending = false;
+                cli_init();
+                boot_mark(BOOT_STAGE_MENU);
+        }
+}
+
+void boot_print(void)
+{
+        printf("  Boot: %s start-up, fast start %s (times from the start of main)",
+               restart_is_warm() ? "warm" : "cold",
+               BOOT_FAST_START ? "on" : "off");
+        terminal_insert_new_line();
+        printf("  Clock: %s, SYSCLK %lu MHz",
+               clock_get_source_name(),
+               (unsigned long)(clock_get_sysclk() / 1000000UL));
+        terminal_insert_new_line();
+        printf("  stage        at [us]     stage [us]   core clock [MHz]");
+        terminal_insert_new_line();
+
+        for (size_t i = 0; i < BOOT_STAGES_NUM; i++)
+        {
+                const struct boot_record *record = &boot_records[i];
+
+                if (!record->reached)
+                {
+                        printf("  %-10s   not reached", boot_stage_names[i]);
+                        terminal_insert_new_line();
+                        continue;
+                }
+
+                printf("  %-10s   %-9lu   %-10lu   %lu",
+                       boot_stage_names[i],
+                       (unsigned long)record->us,
+                       (unsigned long)record->stage_us,
+                       (unsigned long)(record->clock_hz / 1000000UL));
+                if (i == BOOT_STAGE_FIRST_STEP && !restart_is_warm())
+                {
+                        printf("   (cold start: includes the wait for mod mode)");
+                }
+                terminal_insert_new_line();
+        }
+}
+
@@ -0,0 +1,248 @@
+/*
+ * c2d.c
+ *
+ * Description:
+ *     Zero-order-hold discretization of continuous-time state-space models.
+ *
+ *     For x' = Ac*x + Bc*u and a step h, the discrete matrices are read from the exponential of
+ *     the augmented matrix
+ *
+ *         expm([Ac Bc; 0 0] * h) = [Ad Bd; 0 1]
+ *
+ *     The exponential is computed with scaling and squaring: the matrix is scaled by 2^-s so
+ *     its 1-norm is at most C2D_NORM_MAX, the [6/6] Pade approximant D^-1 * N is evaluated and
+ *     the result is squared s times.
+ *
+ * Notes:
+ *     - This runs at configuration time only (startup, model loading), never in the control loop,
+ *       so it is computed in double precision. It takes a few milliseconds for an 8-state model.
+ *     - Matrices are passed row-major and contiguous: Ac and Ad are n*n, Bc and Bd are n. The
+ *       outputs may overwrite the inputs.
+ *     - With ||M||_1 <= 0.5 the truncation error of the [6/6] approximant is below 1e-15,
+ *       negligible against float storage.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "c2d.h"
+
+#include "model.h"
+
+#define C2D_DIM           (MODEL_STATES_MAX + 1) // Augmented matrix [Ac Bc; 0 0]
+#define C2D_PADE_ORDER    6
+#define C2D_NORM_MAX      0.5
+#define C2D_SQUARINGS_MAX 40
+
+static double c2d_M[C2D_DIM][C2D_DIM]; // Scaled augmented matrix
+static double c2d_P[C2D_DIM][C2D_DIM]; // Powers of M
+static double c2d_N[C2D_DIM][C2D_DIM]; // Pade numerator, then the exponential
+static double c2d_D[C2D_DIM][C2D_DIM]; // Pade denominator
+static double c2d_T[C2D_DIM][C2D_DIM]; // Product scratch
+
+static void c2d_multiply(uint8_t m, double A[][C2D_DIM], double B[][C2D_DIM], double R[][C2D_DIM]);
+static bool c2d_solve(uint8_t m);
+
+bool c2d_zoh(uint8_t n, const float *Ac, const float *Bc, float h, float *Ad, float *Bd)
+{
+        uint8_t m = n + 1U;
+
+        if (n == 0U || n > MODEL_STATES_MAX || !(h > 0.0f))
+        {
+                return false;
+        }
+
+        // M = [Ac Bc; 0 0] * h
+        for (uint8_t i = 0; i < m; i++)
+        {
+                for (uint8_t j = 0; j < m; j++)
+                {
+                        double value = 0.0;
+
+                        if (i < n)
+                        {
+                                value = (j < n) ? Ac[i * n + j] : Bc[i];
+                        }
+                        c2d_M[i][j] = value * h;
+                }
+        }
+
+        // Scale M by 2^-s so that its 1-norm (largest column sum) is at most C2D_NORM_MAX.
+        double norm = 0.0;
+        for (uint8_t j = 0; j < m; j++)
+        {
+                double sum = 0.0;
+
+                for (uint8_t i = 0; i < m; i++)
+                {
+                        sum += fabs(c2d_M[i][j]);
+                }
+                norm = fmax(norm, sum);
+        }
+        if (!isfinite(norm))
+        {
+                return false;
+        }
+
+        int squarings = 0;
+        while (norm > C2D_NORM_MAX && squarings < C2D_SQUARINGS_MAX)
+        {
+                norm *= 0.5;
+                squarings++;
+        }
+
+        for (uint8_t i = 0; i < m; i++)
+        {
+                for (uint8_t j = 0; j < m; j++)
+                {
+                        c2d_M[i][j] = ldexp(c2d_M[i][j], -squarings);
+                        c2d_P[i][j] = (i == j) ? 1.0 : 0.0;
+                        c2d_N[i][j] = c2d_P[i][j];
+                        c2d_D[i][j] = c2d_P[i][j];
+                }
+        }
+
+        // N = sum(c_k * M^k), D = sum((-1)^k * c_k * M^k) for k = 0 ... C2D_PADE_ORDER.
+        double c = 1.0;
+        for (int k = 1; k <= C2D_PADE_ORDER; k++)
+        {
+                c *= (double)(C2D_PADE_ORDER - k + 1) / (double)(k * (2 * C2D_PADE_ORDER - k + 1));
+
+                c2d_multiply(m, c2d_P, c2d_M, c2d_T);
+
+                for (uint8_t i = 0; i < m; i++)
+                {
+                        for (uint8_t j = 0; j < m; j++)
+                        {
+                                c2d_P[i][j] = c2d_T[i][j];
+                                c2d_N[i][j] += c * c2d_T[i][j];
+                                c2d_D[i][j] += ((k % 2 == 0) ? c : -c) * c2d_T[i][j];
+                        }
+                }
+        }
+
+        // expm(M) ~ D^-1 * N, left in c2d_N.
+        if (!c2d_solve(m))
+        {
+                return false;
+        }
+
+        // Undo the scaling: expm(M * 2^s) = expm(M)^(2^s).
+        for (int s = 0; s < squarings; s++)
+        {
+                c2d_multiply(m, c2d_N, c2d_N, c2d_T);
+
+                for (uint8_t i = 0; i < m; i++)
+                {
+                        for (uint8_t j = 0; j < m; j++)
+                        {
+                                c2d_N[i][j] = c2d_T[i][j];
+                        }
+                }
+        }
+
+        for (uint8_t i = 0; i < n; i++)
+        {
+                if (!isfinite(c2d_N[i][n]))
+                {
+                        return false;
+                }
+                for (uint8_t j = 0; j < n; j++)
+                {
+                        if (!isfinite(c2d_N[i][j]))
+                        {
+                                return false;
+                        }
+                }
+        }
+
+        // Ad and Bd are the top blocks of the exponential.
+        for (uint8_t i = 0; i < n; i++)
+        {
+                for (uint8_t j = 0; j < n; j++)
+                {
+                        Ad[i * n + j] = (float)c2d_N[i][j];
+                }
+                Bd[i] = (float)c2d_N[i][n];
+        }
+
+        return true;
+}
+
+// R = A * B (R must not be A or B).
+static void c2d_multiply(uint8_t m, double A[][C2D_DIM], double B[][C2D_DIM], double R[][C2D_DIM])
+{
+        for (uint8_t i = 0; i < m; i++)
+        {
+                for (uint8_t j = 0; j < m; j++)
+                {
+                        double sum = 0.0;
+
+                        for (uint8_t k = 0; k < m; k++)
+                        {
+                                sum += A[i][k] * B[k][j];
+                        }
+                        R[i][j] = sum;
+                }
+        }
+}
+
+// Solve D * X = N in place with Gauss-Jordan elimination and partial pivoting (X ends in N).
+static bool c2d_solve(uint8_t m)
+{
+        for (uint8_t col = 0; col < m; col++)
+        {
+                uint8_t pivot = col;
+
+                for (uint8_t i = col + 1U; i < m; i++)
+                {
+                        if (fabs(c2d_D[i][col]) > fabs(c2d_D[pivot][col]))
+                        {
+                                pivot = i;
+                        }
+                }
+                if (c2d_D[pivot][col] == 0.0)
+                {
+                        return false;
+                }
+
+                if (pivot != col)
+                {
+                        for (uint8_t j = 0; j < m; j++)
+                        {
+                                double t        = c2d_D[col][j];
+                                c2d_D[col][j]   = c2d_D[pivot][j];
+                                c2d_D[pivot][j] = t;
+
+                                t               = c2d_N[col][j];
+                                c2d_N[col][j]   = c2d_N[pivot][j];
+                                c2d_N[pivot][j] = t;
+                        }
+                }
+
+                double inv = 1.0 / c2d_D[col][col];
+                for (uint8_t j = 0; j < m; j++)
+                {
+                        c2d_D[col][j] *= inv;
+                        c2d_N[col][j] *= inv;
+                }
+
+                for (uint8_t i = 0; i < m; i++)
+                {
+                        double factor = c2d_D[i][col];
+
+                        if (i == col || factor == 0.0)
+                        {
+                                continue;
+                        }
+                        for (uint8_t j = 0; j < m; j++)
+                        {
+                                c2d_D[i][j] -= factor * c2d_D[col][j];
+                                c2d_N[i][j] -= factor * c2d_N[col][j];
+                        }
+                }
+        }
+
+        return true;
+}
@@ -11,6 +11,22 @@
  *     - Runs commands using a lookup table
  *     - Manages system operating modes (IDLE, CONFIG, MOD)
  *     - Provides runtime configuration of PID parameters (kp, ki, kd, reference)
+ *     - Selects the controller type (PID, LQR, PR or MPC) of each converter type and benchmarks
+ *       them
+ *     - Edits and dumps the PID gain-schedule table
+ *     - Shows the online control-performance metrics
+ *     - Starts on-target frequency-response sweeps of the loop
+ *     - Shows the power-quality analysis (RMS, harmonics, THD) of the inverter output
+ *     - Dumps the online RLS estimate of the plant model
+ *     - Loads a new plant model over UART as a binary blob
+ *     - Fast-forwards the plant model by many steps with the input held
+ *     - Shows the numerical health log of the loop and sets the action taken on a fault
+ *     - Shows the missed TIM2 releases of the loop and sets how they are caught up
+ *     - Shows the event queue counters of the scheduler
+ *     - Shows the frame timing and overruns of the cyclic executive
+ *     - Shows the task watchdog supervision and the record of the last watchdog reset
+ *     - Shows the time spent in each init stage and the time to the first control step
+ *     - Switches the core clock profile and its automatic scaling with the mode
  *     - Prints system status, menus, and help information to the terminal
  *
  *     The CLI supports:
@@ -29,22 +45,42 @@
 
 #include "cli.h"
 
+#include "bench.h"
+#include "boot.h"
+#include "clock.h"
 #include "controller.h"
+#include "cyclic.h"
+#include "fra.h"
+#include "gain_schedule.h"
 #include "gpio.h"
+#include "health.h"
+#include "metrics.h"
+#include "model.h"
+#include "pid_q31.h"
+#include "pq.h"
+#include "pr.h"
 #include "pwm.h"
+#include "snapshot.h"
+#include "supervisor.h"
+#include "swtimer.h"
+#include "sysid.h"
 #include "systick.h"
 #include "terminal.h"
+#include "timer.h"
 #include "uart.h"
 #include "utils.h"
 
 #define SEPERATOR_1    "==============================================="
 #define SEPERATOR_2    "  -----------------------------------------------"
 #define CLI_BUFFER_LEN 64
-#define MAX_ARG_NUM    2
+#define MAX_ARG_NUM    7
+
+// UART cannot change the mode for this long after the button changed it.
+#define CLI_UART_LOCK_MS 5000UL
 
 /*
- * argv[0] points to the command string, and argv[1] points to the possible
- * argument. If argv[1] points to NULL, it means the command has no argument.
+ * argv[0] points to the command string, and argv[1] to argv[MAX_ARG_NUM - 1] point to the
+ * possible arguments. If argv[i] points to NULL, it means the command has less than i arguments.
  */
 typedef struct
 {
@@ -53,17 +89,22 @@ typedef struct
         bool excessive_args;
 } command_t;
 typedef int (*cli_cmd_fn)(command_t command);
+/*
+ * min_argc and max_argc are the accepted range for argc, where the command itself is counted.
+ * So a command without arguments has min_argc = max_argc = 1.
+ */
 typedef struct
 {
         const char *name;
         cli_cmd_fn handler;
-        bool has_one_arg;
+        int min_argc;
+        int max_argc;
 } cli_command_t;
 
 volatile bool cli_stream_is_on = false;
 
 static bool cli_config_is_entered_via_uart = false;
-static uint32_t cli_uart_block_until_ms    = 0U;
+static struct swtimer cli_uart_lock_timer; // Running while UART may not change the mode
 static uint8_t cli_buffer[CLI_BUFFER_LEN];
 static int cli_cmd_line_index = 0;
 
@@ -78,39 +119,77 @@ static int cli_set_kp_handler(command_t command);
 static int cli_set_ki_handler(command_t command);
 static int cli_set_kd_handler(command_t command);
 static int cli_set_ref_handler(command_t command);
+static int cli_set_controller_handler(command_t command);
+static int cli_set_kr_handler(command_t command);
+static int cli_set_resonator_handler(command_t command);
+static int cli_gain_schedule_handler(command_t command);
+static int cli_bench_handler(command_t command);
+static int cli_metrics_handler(command_t command);
+static int cli_fra_handler(command_t command);
+static int cli_pq_handler(command_t command);
+static int cli_sysid_handler(command_t command);
+static int cli_model_handler(command_t command);
+static int cli_fast_forward_handler(command_t command);
+static int cli_health_handler(command_t command);
+static int cli_catchup_handler(command_t command);
+static int cli_events_handler(command_t command);
+static int cli_cyclic_handler(command_t command);
+static int cli_watchdog_handler(command_t command);
+static int cli_boot_handler(command_t command);
+static int cli_clock_handler(command_t command);
 static int cli_exit_command_handler(command_t command);
 static int cli_clear_command_handler(command_t command);
 static command_t cli_tokenize_command(uint8_t *cmd_str);
 static void cli_show_startup_menu(void);
 static void cli_show_system_status(converter_mode_t mode,
                                    converter_type_t type,
+                                   controller_type_t controller,
                                    float kp,
                                    float ki,
                                    float kd,
                                    float reference);
 static void cli_show_config_menu(void);
 static void cli_print_mode_change_message(converter_mode_t mode);
-
-static const cli_command_t cli_command_table[] = {{"help", cli_show_help_and_notes_handler, true},
-                                                  {"status", cli_show_status_handler, true},
-                                                  {"mode", cli_uart_set_mode_handler, false},
-                                                  {"type", cli_set_type_handler, false},
-                                                  {"stream", cli_stream_handler, true},
-                                                  {"kp", cli_set_kp_handler, false},
-                                                  {"ki", cli_set_ki_handler, false},
-                                                  {"kd", cli_set_kd_handler, false},
-                                                  {"ref", cli_set_ref_handler, false},
-                                                  {"exit", cli_exit_command_handler, true},
-                                                  {"clear", cli_clear_command_handler, true}};
+static void cli_print_q31_gain_limits(void);
+
+static const cli_command_t cli_command_table[] = {{"help", cli_show_help_and_notes_handler, 1, 1},
+                                                  {"status", cli_show_status_handler, 1, 1},
+                                                  {"mode", cli_uart_set_mode_handler, 2, 2},
+                                                  {"type", cli_set_type_handler, 2, 2},
+                                                  {"stream", cli_stream_handler, 1, 1},
+                                                  {"kp", cli_set_kp_handler, 2, 2},
+                                                  {"ki", cli_set_ki_handler, 2, 2},
+                                                  {"kd", cli_set_kd_handler, 2, 2},
+                                                  {"ref", cli_set_ref_handler, 2, 2},
+                                                  {"ctrl", cli_set_controller_handler, 2, 2},
+                                                  {"kr", cli_set_kr_handler, 2, 2},
+                                                  {"pr", cli_set_resonator_handler, 3, 3},
+                                                  {"gs", cli_gain_schedule_handler, 1, 7},
+                                                  {"bench", cli_bench_handler, 1, 1},
+                                                  {"metrics", cli_metrics_handler, 1, 3},
+                                                  {"fra", cli_fra_handler, 1, 3},
+                                                  {"pq", cli_pq_handler, 1, 1},
+                                                  {"sysid", cli_sysid_handler, 1, 3},
+                                                  {"model", cli_model_handler, 1, 3},
+                                                  {"ff", cli_fast_forward_handler, 2, 3},
+                                                  {"health", cli_health_handler, 1, 3},
+                                                  {"catchup", cli_catchup_handler, 1, 3},
+                                                  {"events", cli_events_handler, 1, 1},
+                                                  {"cyclic", cli_cyclic_handler, 1, 1},
+                                                  {"watchdog", cli_watchdog_handler, 1, 1},
+                                                  {"boot", cli_boot_handler, 1, 1},
+                                                  {"clock", cli_clock_handler, 1, 3},
+                                                  {"exit", cli_exit_command_handler, 1, 1},
+                                                  {"clear", cli_clear_command_handler, 1, 1}};
 
 void cli_init(void)
 {
         cli_show_startup_menu();
 }
 
-void cli_process_rx_byte(void)
+void cli_process_rx_byte(const struct event *event)
 {
-        uint8_t ch = uart_read_char;
+        uint8_t ch = event->data.byte;
 
         // A button press while stream is on stops the stream.
         if (cli_stream_is_on)
@@ -183,6 +262,14 @@ void cli_button_handler(void)
                         next_mode = CONFIG;
                         break;
                 case CONFIG:
+                        // Without a plant model the loop cannot run, so the button stays here.
+                        if (!model_is_available())
+                        {
+                                printf("  No plant model is loaded. Still in config mode.");
+                                terminal_insert_new_line();
+                                terminal_print_arrow();
+                                return;
+                        }
                         next_mode = MOD;
 
                         break;
@@ -193,7 +280,7 @@ void cli_button_handler(void)
                 converter_set_mode(next_mode);
                 terminal_insert_new_line();
                 cli_print_mode_change_message(next_mode);
-                cli_uart_block_until_ms = systick_get_ticks() + 5000UL;
+                swtimer_start(&cli_uart_lock_timer, NULL, CLI_UART_LOCK_MS, 0U);
         }
 }
 
@@ -301,8 +388,10 @@ static command_t cli_tokenize_command(uint8_t *cmd_str)
 static int cli_execute_command(command_t command)
 {
         /*
-         * All commands have at most two command line arguments, namely the command
-         * function like mode and its possible argument like idle (mode idle).
+         * argv[0] is the command name (like mode) and the rest are its arguments (like idle in
+         * mode idle). The parser keeps up to MAX_ARG_NUM words and each command accepts between
+         * min_argc and max_argc of them (from 1 for commands without arguments up to 7 for gs),
+         * as listed in cli_command_table.
          */
         if (command.argc == 0)
         {
@@ -332,7 +421,7 @@ static int cli_execute_command(command_t command)
                 {
                         if (strcmp(command.argv[0], (cli_command_table[i]).name) == 0)
                         {
-                                if ((cli_command_table[i]).has_one_arg && command.argc != 1)
+                                if ((cli_command_table[i]).max_argc == 1 && command.argc != 1)
                                 {
                                         printf("  The command %s does not accept any arguments! "
                                                "Try "
@@ -342,7 +431,14 @@ static int cli_execute_command(command_t command)
                                         terminal_print_arrow();
                                         return -1;
                                 }
-                                else if (!(cli_command_table[i]).has_one_arg && command.argc == 1)
+                                else if (command.argc > (cli_command_table[i]).max_argc)
+                                {
+                                        printf("  Command has too many arguments! Try again.");
+                                        terminal_insert_new_line();
+                                        terminal_print_arrow();
+                                        return -1;
+                                }
+                                else if (command.argc < (cli_command_table[i]).min_argc)
                                 {
                                         printf("  This command needs an additional argument! Try "
                                                "again.");
@@ -379,21 +475,38 @@ static int cli_show_help_and_notes_handler(command_t command)
 
 static int cli_show_status_handler(command_t command)
 {
-        float kp              = pid_get_kp();
-        float ki              = pid_get_ki();
-        float kd              = pid_get_kd();
-        float ref             = pid_get_ref();
-        converter_mode_t mode = converter_get_mode();
-        converter_type_t type = converter_get_type();
+        float kp               = pid_get_kp();
+        float ki               = pid_get_ki();
+        float kd               = pid_get_kd();
+        float ref              = pid_get_ref();
+        converter_mode_t mode  = converter_get_mode();
+        converter_type_t type  = converter_get_type();
+        controller_type_t ctrl = controller_get_type(type);
+
+        cli_show_system_status(mode, type, ctrl, kp, ki, kd, ref);
+
+        if (!model_is_available())
+        {
+                printf("  plant model   : none, mod mode is refused");
+                terminal_insert_new_line();
+                model_print_builtin_errors();
+        }
 
-        cli_show_system_status(mode, type, kp, ki, kd, ref);
+        // The last control step, read as one consistent sample.
+        struct loop_snapshot sample = snapshot_read();
+        printf("  last step     : %lu (u = %.3f V, y = %.3f V, ref = %.3f V)",
+               (unsigned long)sample.tick,
+               sample.u,
+               sample.y,
+               sample.ref);
+        terminal_insert_new_line();
         terminal_print_arrow();
         return 0;
 }
 
 static int cli_uart_set_mode_handler(command_t command)
 {
-        if (systick_get_ticks() < cli_uart_block_until_ms)
+        if (swtimer_is_active(&cli_uart_lock_timer))
         {
                 printf("  UART cannot change the mode right now! Try again in a few seconds.");
                 terminal_insert_new_line();
@@ -419,6 +532,14 @@ static int cli_uart_set_mode_handler(command_t command)
                         mode = MOD;
                 }
 
+                if (mode == MOD && !model_is_available())
+                {
+                        printf("  No plant model is loaded, see \"model\"! Try again.");
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+
                 if (converter_get_mode() != mode) // Converter mode has changed
                 {
                         if (mode == CONFIG)
@@ -518,7 +639,12 @@ static int cli_set_kp_handler(command_t command)
 {
         if (converter_get_mode() == CONFIG)
         {
-                pid_set_kp(str_to_float(command.argv[1]));
+                if (!pid_set_kp(str_to_float(command.argv[1])))
+                {
+                        cli_print_q31_gain_limits();
+                        terminal_print_arrow();
+                        return -1;
+                }
                 terminal_print_arrow();
                 return 0;
         }
@@ -535,7 +661,12 @@ static int cli_set_ki_handler(command_t command)
 {
         if (converter_get_mode() == CONFIG)
         {
-                pid_set_ki(str_to_float(command.argv[1]));
+                if (!pid_set_ki(str_to_float(command.argv[1])))
+                {
+                        cli_print_q31_gain_limits();
+                        terminal_print_arrow();
+                        return -1;
+                }
                 terminal_print_arrow();
                 return 0;
         }
@@ -552,7 +683,12 @@ static int cli_set_kd_handler(command_t command)
 {
         if (converter_get_mode() == CONFIG)
         {
-                pid_set_kd(str_to_float(command.argv[1]));
+                if (!pid_set_kd(str_to_float(command.argv[1])))
+                {
+                        cli_print_q31_gain_limits();
+                        terminal_print_arrow();
+                        return -1;
+                }
                 terminal_print_arrow();
                 return 0;
         }
@@ -606,6 +742,692 @@ static int cli_set_ref_handler(command_t command)
         }
 }
 
+static int cli_set_controller_handler(command_t command)
+{
+        // Controller type can only be changed in config mode.
+        if (converter_get_mode() != CONFIG)
+        {
+                printf("  Controller type can only be changed in config mode! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        const char *id = command.argv[1];
+        if (!isdigit((unsigned char)id[0]) || id[1] != '\0' || id[0] - '0' >= CONTROLLER_TYPES_NUM)
+        {
+                printf("  The controller id is invalid! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        // The selection applies to the current converter type only.
+        controller_type_t controller = (controller_type_t)(id[0] - '0');
+        controller_set_type(converter_get_type(), controller);
+        printf("  Controller of %s changed to %s.",
+               types[converter_get_type()],
+               controller_types[controller]);
+        terminal_insert_new_line();
+        terminal_print_arrow();
+        return 0;
+}
+
+static int cli_set_kr_handler(command_t command)
+{
+        if (converter_get_mode() == CONFIG)
+        {
+                pr_set_kr(str_to_float(command.argv[1]));
+                terminal_print_arrow();
+                return 0;
+        }
+        else
+        {
+                printf("  You can modify kr only in config mode! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+}
+
+// Harmonic resonators of the PR controller can be switched in config and mod modes.
+static int cli_set_resonator_handler(command_t command)
+{
+        if (converter_get_mode() == IDLE)
+        {
+                printf("  You cannot switch resonators in idle mode! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        bool enable;
+        if (strcmp("on", command.argv[2]) == 0)
+        {
+                enable = true;
+        }
+        else if (strcmp("off", command.argv[2]) == 0)
+        {
+                enable = false;
+        }
+        else
+        {
+                printf("  The resonator state should be on or off! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        const char *harmonic = command.argv[1];
+        if (!isdigit((unsigned char)harmonic[0]) || harmonic[1] != '\0' ||
+            !pr_set_harmonic((uint8_t)(harmonic[0] - '0'), enable))
+        {
+                printf("  Only the 3rd, 5th and 7th harmonic resonators can be switched! Try "
+                       "again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * gs                            - Dump the gain-schedule table
+ * gs set <i> <x> <kp> <ki> <kd> - Stage breakpoint i
+ * gs clear | apply              - Clear the staging table or make it active
+ * gs on | off                   - Enable or disable gain scheduling
+ * gs src <ref|y>                - Select the scheduling variable
+ */
+static int cli_gain_schedule_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                gs_dump();
+                terminal_print_arrow();
+                return 0;
+        }
+
+        if (converter_get_mode() != CONFIG)
+        {
+                printf("  The gain schedule can only be changed in config mode! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        const char *sub_command = command.argv[1];
+        int status              = 0;
+
+        if (strcmp("set", sub_command) == 0 && command.argc == 7)
+        {
+                const char *index     = command.argv[2];
+                struct gs_point point = {.x  = str_to_float(command.argv[3]),
+                                         .kp = str_to_float(command.argv[4]),
+                                         .ki = str_to_float(command.argv[5]),
+                                         .kd = str_to_float(command.argv[6])};
+
+                if (PID_FIXED_POINT && !pid_q31_gains_fit(point.kp, point.ki, point.kd))
+                {
+                        cli_print_q31_gain_limits();
+                        status = -1;
+                }
+                else if (!isdigit((unsigned char)index[0]) || index[1] != '\0' ||
+                         !gs_stage_point((uint8_t)(index[0] - '0'), point))
+                {
+                        printf("  Breakpoints must be set in order from 0 to %d! Try again.",
+                               GS_POINTS_MAX - 1);
+                        terminal_insert_new_line();
+                        status = -1;
+                }
+        }
+        else if (strcmp("clear", sub_command) == 0 && command.argc == 2)
+        {
+                gs_stage_clear();
+        }
+        else if (strcmp("apply", sub_command) == 0 && command.argc == 2)
+        {
+                status = gs_apply();
+                if (status == -1)
+                {
+                        printf("  The staging table is empty! Try again.");
+                        terminal_insert_new_line();
+                }
+                else if (status == -2)
+                {
+                        printf("  Breakpoints must be strictly increasing! Try again.");
+                        terminal_insert_new_line();
+                }
+        }
+        else if ((strcmp("on", sub_command) == 0 || strcmp("off", sub_command) == 0) &&
+                 command.argc == 2)
+        {
+                if (!gs_enable(strcmp("on", sub_command) == 0))
+                {
+                        printf("  The gain-schedule table is empty! Try again.");
+                        terminal_insert_new_line();
+                        status = -1;
+                }
+        }
+        else if (strcmp("src", sub_command) == 0 && command.argc == 3 &&
+                 (strcmp("ref", command.argv[2]) == 0 || strcmp("y", command.argv[2]) == 0))
+        {
+                gs_set_source(strcmp("ref", command.argv[2]) == 0 ? GS_SOURCE_REFERENCE
+                                                                  : GS_SOURCE_MEASUREMENT);
+        }
+        else
+        {
+                printf("  Invalid gs command! Type \"help\" to see the usage.");
+                terminal_insert_new_line();
+                status = -1;
+        }
+
+        terminal_print_arrow();
+        return status;
+}
+
+static int cli_bench_handler(command_t command)
+{
+        // The benchmark drives the plant directly, so the control loop must be stopped.
+        if (converter_get_mode() != CONFIG)
+        {
+                printf("  The benchmark can only run in config mode! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+        if (!model_is_available())
+        {
+                printf("  No plant model is loaded, see \"model\"! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        bench_run();
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * metrics              - Show the control-performance metrics
+ * metrics reset        - Start a new record now
+ * metrics band <value> - Set the settling band in percent of the step size
+ */
+static int cli_metrics_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                metrics_print();
+        }
+        else if (command.argc == 2 && strcmp("reset", command.argv[1]) == 0)
+        {
+                metrics_reset();
+        }
+        else if (command.argc == 3 && strcmp("band", command.argv[1]) == 0)
+        {
+                float band = str_to_float(command.argv[2]);
+
+                if (band <= 0.0f || band >= 100.0f)
+                {
+                        printf("  The band should be between 0 and 100 percent! Try again.");
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+                metrics_set_band(band);
+        }
+        else
+        {
+                printf("  Invalid metrics command! Type \"help\" to see the usage.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * fra                   - Show the sweep progress
+ * fra <u|r> [amplitude] - Start a sweep injecting at the controller output or the reference
+ * fra stop              - Abort the sweep
+ */
+static int cli_fra_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                fra_print_status();
+                terminal_print_arrow();
+                return 0;
+        }
+
+        if (strcmp("stop", command.argv[1]) == 0 && command.argc == 2)
+        {
+                fra_stop();
+                terminal_print_arrow();
+                return 0;
+        }
+
+        if (converter_get_mode() != MOD)
+        {
+                printf("  A frequency-response sweep can only run in mod mode! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        fra_injection_t injection;
+        if (strcmp("u", command.argv[1]) == 0)
+        {
+                injection = FRA_INJECT_OUTPUT;
+        }
+        else if (strcmp("r", command.argv[1]) == 0)
+        {
+                injection = FRA_INJECT_REFERENCE;
+        }
+        else
+        {
+                printf("  Invalid fra command! Type \"help\" to see the usage.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        float amplitude = (command.argc == 3) ? str_to_float(command.argv[2]) : 1.0f;
+        if (amplitude <= 0.0f || amplitude > REF_MAX)
+        {
+                printf("  The amplitude should be between 0 and %.2f! Try again.", REF_MAX);
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        fra_start(injection, amplitude);
+        printf("  Sweep started. Records are printed as fra,<point>,<Hz>,<dB>,<deg>.");
+        terminal_insert_new_line();
+        terminal_print_arrow();
+        return 0;
+}
+
+// pq - Show the power-quality analysis of the last period of the inverter output
+static int cli_pq_handler(command_t command)
+{
+        pq_print();
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * sysid                 - Show the estimated ARX coefficients and the fit
+ * sysid reset           - Restart the estimation
+ * sysid lambda <value>  - Set the forgetting factor
+ */
+static int cli_sysid_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                sysid_print();
+        }
+        else if (command.argc == 2 && strcmp("reset", command.argv[1]) == 0)
+        {
+                sysid_reset();
+        }
+        else if (command.argc == 3 && strcmp("lambda", command.argv[1]) == 0)
+        {
+                float lambda = str_to_float(command.argv[2]);
+
+                if (lambda < 0.9f || lambda > 1.0f)
+                {
+                        printf("  The forgetting factor should be between 0.9 and 1! Try again.");
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+                sysid_set_lambda(lambda);
+        }
+        else
+        {
+                printf("  Invalid sysid command! Type \"help\" to see the usage.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * model                 - Show the active plant model and its update kernels
+ * model load <n>        - Receive a binary model blob with n states (see Tools/model_blob.py)
+ * model <dense|modal>   - Go back to the built-in converter model in the given realization
+ */
+static int cli_model_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                model_print();
+        }
+        else if (command.argc == 2 && (strcmp("dense", command.argv[1]) == 0 ||
+                                       strcmp("modal", command.argv[1]) == 0))
+        {
+                model_realization_t realization = (strcmp("modal", command.argv[1]) == 0)
+                                                          ? MODEL_MODAL
+                                                          : MODEL_DENSE;
+                model_status_t status           = model_load_builtin(realization);
+                printf("  Built-in %s model: %s.", model_realizations[realization],
+                       model_status_messages[status]);
+                terminal_insert_new_line();
+        }
+        else if (command.argc == 3 && strcmp("load", command.argv[1]) == 0)
+        {
+                int states = (int)str_to_float(command.argv[2]);
+
+                if (states < 1 || states > MODEL_STATES_MAX)
+                {
+                        printf("  The order should be between 1 and %d! Try again.",
+                               MODEL_STATES_MAX);
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+
+                model_receive_start((uint8_t)states);
+                printf("  Waiting for %u bytes...", (unsigned)model_blob_length((uint8_t)states));
+                terminal_insert_new_line();
+
+                // The result and the prompt are printed when the transfer is finished.
+                return 0;
+        }
+        else
+        {
+                printf("  Invalid model command! Type \"help\" to see the usage.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * ff <steps> [input]    - Advance the plant by steps model steps with the input held at input
+ *                         (default: the present plant input)
+ */
+static int cli_fast_forward_handler(command_t command)
+{
+        if (converter_get_mode() == IDLE)
+        {
+                printf("  The plant can only be fast-forwarded in config or mod mode! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+        if (model_get_states() == 0U)
+        {
+                printf("  No plant model is active, see \"model\"! Try again.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        float steps = str_to_float(command.argv[1]);
+        if (steps < 1.0f || steps > (float)MODEL_FF_STEPS_MAX)
+        {
+                printf("  The number of steps should be between 1 and %lu! Try again.",
+                       (unsigned long)MODEL_FF_STEPS_MAX);
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        float input = (command.argc == 3) ? str_to_float(command.argv[2]) : u[0][0];
+
+        converter_fast_forward((uint32_t)steps, input);
+        printf("  Advanced %lu steps (%.3f ms): u = %.3f V, y = %.3f V.",
+               (unsigned long)(uint32_t)steps,
+               1000.0f * (float)(uint32_t)steps / SAMPLING_FREQUENCY,
+               u[0][0],
+               y[0][0]);
+        terminal_insert_new_line();
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * health                             - Show the fault count, the action and the fault log
+ * health clear                       - Clear the fault log
+ * health action <clamp|reset|config> - Set the action taken on a fault
+ */
+static int cli_health_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                health_print();
+        }
+        else if (command.argc == 2 && strcmp("clear", command.argv[1]) == 0)
+        {
+                health_clear_log();
+        }
+        else if (command.argc == 3 && strcmp("action", command.argv[1]) == 0)
+        {
+                size_t action;
+
+                for (action = 0; action < HEALTH_ACTIONS_NUM; action++)
+                {
+                        if (strcmp(health_actions[action], command.argv[2]) == 0)
+                        {
+                                break;
+                        }
+                }
+
+                if (action == HEALTH_ACTIONS_NUM)
+                {
+                        printf("  The action should be clamp, reset or config! Try again.");
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+
+                health_set_action((health_action_t)action);
+        }
+        else
+        {
+                printf("  Invalid health command! Type \"help\" to see the usage.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * catchup                       - Show the policy and the release counters of the control loop
+ * catchup clear                 - Clear the release counters
+ * catchup <skip|step|ff> [max]  - Set the policy (max: missed releases stepped per run for step)
+ */
+static int cli_catchup_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                struct tim2_catchup_stats stats = tim2_get_catchup_stats();
+
+                printf("  Loop releases (policy: %s", tim2_catchup_policies[tim2_get_catchup()]);
+                if (tim2_get_catchup() == TIM2_CATCHUP_STEP)
+                {
+                        printf(", up to %lu per run", (unsigned long)tim2_get_catchup_limit());
+                }
+                printf(")");
+                terminal_insert_new_line();
+                printf("  releases      : %lu", (unsigned long)stats.releases);
+                terminal_insert_new_line();
+                printf("  dropped       : %lu (simulated time behind by %.3f ms)",
+                       (unsigned long)stats.dropped,
+                       1000.0f * stats.dropped / SAMPLING_FREQUENCY);
+                terminal_insert_new_line();
+                printf("  stepped       : %lu", (unsigned long)stats.stepped);
+                terminal_insert_new_line();
+                printf("  fast-forwarded: %lu", (unsigned long)stats.forwarded);
+                terminal_insert_new_line();
+                printf("  most missed   : %lu", (unsigned long)stats.max_late);
+                terminal_insert_new_line();
+        }
+        else if (command.argc == 2 && strcmp("clear", command.argv[1]) == 0)
+        {
+                tim2_clear_catchup_stats();
+        }
+        else
+        {
+                size_t policy;
+
+                for (policy = 0; policy < TIM2_CATCHUP_POLICIES_NUM; policy++)
+                {
+                        if (strcmp(tim2_catchup_policies[policy], command.argv[1]) == 0)
+                        {
+                                break;
+                        }
+                }
+
+                float limit = (command.argc == 3) ? str_to_float(command.argv[2])
+                                                  : (float)tim2_get_catchup_limit();
+
+                if (policy == TIM2_CATCHUP_POLICIES_NUM)
+                {
+                        printf("  Invalid catchup command! Type \"help\" to see the usage.");
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+                if (limit < 1.0f || limit > 1000.0f)
+                {
+                        printf("  The limit should be between 1 and 1000! Try again.");
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+
+                tim2_set_catchup((tim2_catchup_t)policy, (uint32_t)limit);
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
+// events - Show the posted, dropped and largest waiting events and the latency of each queue
+static int cli_events_handler(command_t command)
+{
+        printf("  queue    posted       dropped   max depth   max latency [us] (capacity %u)",
+               SCHEDULER_QUEUE_CAPACITY);
+        terminal_insert_new_line();
+
+        for (size_t q = 0; q < QUEUES_NUM; q++)
+        {
+                struct scheduler_queue_stats stats = scheduler_get_queue_stats(q);
+
+                printf("  %-6s   %-10lu   %-7lu   %-9lu   %lu",
+                       scheduler_queue_names[q],
+                       (unsigned long)stats.posted,
+                       (unsigned long)stats.dropped,
+                       (unsigned long)stats.max_depth,
+                       (unsigned long)stats.max_latency_us);
+                terminal_insert_new_line();
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
+// cyclic - Show the budgets, measured task times and overruns of the cyclic executive
+static int cli_cyclic_handler(command_t command)
+{
+        cyclic_print();
+
+        terminal_print_arrow();
+        return 0;
+}
+
+// watchdog - Show the check-ins of the supervised tasks and the last task watchdog reset
+static int cli_watchdog_handler(command_t command)
+{
+        supervisor_print();
+
+        terminal_print_arrow();
+        return 0;
+}
+
+// boot - Show the time from reset to each init stage and to the first control step
+static int cli_boot_handler(command_t command)
+{
+        boot_print();
+
+        terminal_print_arrow();
+        return 0;
+}
+
+/*
+ * clock                 - Show the clock profile, the bus clocks and the switch latency
+ * clock <100|84|48|16>  - Switch the core clock to a profile (SYSCLK in MHz)
+ * clock auto <on|off>   - Run at 16 MHz in idle and config mode and at 100 MHz in mod mode
+ */
+static int cli_clock_handler(command_t command)
+{
+        if (command.argc == 1)
+        {
+                clock_print();
+        }
+        else if (command.argc == 2)
+        {
+                size_t profile;
+
+                for (profile = 0; profile < CLOCK_PROFILES_NUM; profile++)
+                {
+                        if (strcmp(clock_profile_names[profile], command.argv[1]) == 0)
+                        {
+                                break;
+                        }
+                }
+
+                if (profile == CLOCK_PROFILES_NUM)
+                {
+                        printf("  The profile should be 100, 84, 48 or 16! Try again.");
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                        return -1;
+                }
+
+                if (!clock_set_profile((clock_profile_t)profile))
+                {
+                        printf("  The PLL did not start, running at %s MHz.",
+                               clock_profile_names[clock_get_profile()]);
+                        terminal_insert_new_line();
+                }
+                clock_print();
+        }
+        else if (command.argc == 3 && strcmp("auto", command.argv[1]) == 0 &&
+                 (strcmp("on", command.argv[2]) == 0 || strcmp("off", command.argv[2]) == 0))
+        {
+                clock_set_auto_scaling(strcmp("on", command.argv[2]) == 0);
+                clock_apply_auto_scaling(converter_get_mode() == MOD);
+                clock_print();
+        }
+        else
+        {
+                printf("  Invalid clock command! Type \"help\" to see the usage.");
+                terminal_insert_new_line();
+                terminal_print_arrow();
+                return -1;
+        }
+
+        terminal_print_arrow();
+        return 0;
+}
+
 static int cli_exit_command_handler(command_t command)
 {
         /*
@@ -616,7 +1438,7 @@ static int cli_exit_command_handler(command_t command)
 
         if (converter_get_mode() == CONFIG)
         {
-                if (systick_get_ticks() < cli_uart_block_until_ms)
+                if (swtimer_is_active(&cli_uart_lock_timer))
                 {
                         printf("  UART cannot change the mode right now! Try again in a few "
                                "seconds.");
@@ -687,6 +1509,7 @@ static void cli_show_startup_menu(void)
 
         cli_show_system_status(converter_get_mode(),
                                converter_get_type(),
+                               controller_get_type(converter_get_type()),
                                pid_get_kp(),
                                pid_get_ki(),
                                pid_get_kd(),
@@ -699,8 +1522,13 @@ static void cli_show_startup_menu(void)
         terminal_print_arrow();
 }
 
-static void cli_show_system_status(
-        converter_mode_t mode, converter_type_t type, float kp, float ki, float kd, float reference)
+static void cli_show_system_status(converter_mode_t mode,
+                                   converter_type_t type,
+                                   controller_type_t controller,
+                                   float kp,
+                                   float ki,
+                                   float kd,
+                                   float reference)
 {
         printf("  System Status");
         terminal_insert_new_line();
@@ -710,12 +1538,21 @@ static void cli_show_system_status(
         terminal_insert_new_line();
         printf("  mode          : %s", modes[mode]);
         terminal_insert_new_line();
+        printf("  controller    : %s", controller_types[controller]);
+        terminal_insert_new_line();
         printf("  kp            : %-11.6f", kp);
         terminal_insert_new_line();
         printf("  ki            : %-11.6f", ki);
         terminal_insert_new_line();
         printf("  kd            : %-11.6f", kd);
         terminal_insert_new_line();
+        printf("  kr            : %-11.6f", pr_get_kr());
+        terminal_insert_new_line();
+        printf("  resonators    : 1%s%s%s",
+               pr_harmonic_is_enabled(3U) ? " 3" : "",
+               pr_harmonic_is_enabled(5U) ? " 5" : "",
+               pr_harmonic_is_enabled(7U) ? " 7" : "");
+        terminal_insert_new_line();
         printf("  reference     : %-11.6f", reference);
 
         terminal_insert_new_line();
@@ -740,6 +1577,16 @@ static void cli_show_config_menu(void)
         terminal_insert_new_line();
         printf("  ref <value>           - Set reference value");
         terminal_insert_new_line();
+        printf("  ctrl <ctrl_id>        - Set controller type of this converter type");
+        terminal_insert_new_line();
+        printf("  kr <value>            - Set resonant gain (PR controller)");
+        terminal_insert_new_line();
+        printf("  pr <3|5|7> <on|off>   - Switch harmonic resonator (PR controller)");
+        terminal_insert_new_line();
+        printf("  gs set <i> <x> <kp> <ki> <kd>, gs apply, gs on|off - Edit PID gain schedule");
+        terminal_insert_new_line();
+        printf("  bench                 - Benchmark controller types on a reference step");
+        terminal_insert_new_line();
         terminal_insert_new_line();
         printf("  Note: ref refers to the output desired DC value for DC-DC type,");
         terminal_insert_new_line();
@@ -755,7 +1602,7 @@ static void cli_show_help_and_notes(void)
         terminal_insert_new_line();
         printf("  help                  - Show this help menu");
         terminal_insert_new_line();
-        printf("  status                - Show current type, mode, kp, ki, kd, and ref");
+        printf("  status                - Show type, mode, controller, kp, ki, kd, and ref");
         terminal_insert_new_line();
         printf("  type <type_id>        - Switch to the converter type with selected id:");
         terminal_insert_new_line();
@@ -777,8 +1624,82 @@ static void cli_show_help_and_notes(void)
         terminal_insert_new_line();
         printf("  ref <voltage>         - Set reference voltage (config and mod mode only)");
         terminal_insert_new_line();
+        printf("  ctrl <ctrl_id>        - Set controller of current converter type (config mode):");
+        terminal_insert_new_line();
+        printf("                          0: PID");
+        terminal_insert_new_line();
+        printf("                          1: LQR with state observer");
+        terminal_insert_new_line();
+        printf("                          2: PR (PI + 50 Hz resonant, for inverter type)");
+        terminal_insert_new_line();
+        printf("                          3: Explicit MPC with state observer");
+        terminal_insert_new_line();
+        printf("  kr <value>            - Set resonant gain of PR controller (config mode only)");
+        terminal_insert_new_line();
+        printf("  pr <3|5|7> <on|off>   - Switch PR harmonic resonator (config and mod mode)");
+        terminal_insert_new_line();
+        printf("  gs                    - Show PID gain-schedule table");
+        terminal_insert_new_line();
+        printf("  gs set <i> <x> <kp> <ki> <kd>");
+        terminal_insert_new_line();
+        printf("                        - Stage breakpoint i at operating point x (config mode)");
+        terminal_insert_new_line();
+        printf("  gs clear | gs apply   - Clear staged table or apply it atomically (config mode)");
+        terminal_insert_new_line();
+        printf("  gs on | gs off        - Enable or disable gain scheduling (config mode)");
+        terminal_insert_new_line();
+        printf("  gs src <ref|y>        - Schedule by reference or output voltage (config mode)");
+        terminal_insert_new_line();
+        printf("  bench                 - Compare settling time and cycles of controllers (config)");
+        terminal_insert_new_line();
         printf("  stream                - Periodically print output voltage");
         terminal_insert_new_line();
+        printf("  metrics               - Show IAE, ISE, ITAE, overshoot, rise, settling, etc.");
+        terminal_insert_new_line();
+        printf("  metrics reset         - Restart the metrics record");
+        terminal_insert_new_line();
+        printf("  metrics band <value>  - Set settling band in percent of the step size");
+        terminal_insert_new_line();
+        printf("  fra <u|r> [amplitude] - Sweep open-loop (u) or closed-loop (r) response (mod)");
+        terminal_insert_new_line();
+        printf("  fra | fra stop        - Show sweep progress or abort the sweep");
+        terminal_insert_new_line();
+        printf("  pq                    - Show RMS, fundamental, harmonics and THD (inverter)");
+        terminal_insert_new_line();
+        printf("  sysid                 - Show the identified ARX plant model and its fit");
+        terminal_insert_new_line();
+        printf("  sysid reset           - Restart the plant identification");
+        terminal_insert_new_line();
+        printf("  sysid lambda <value>  - Set the RLS forgetting factor (0.9 to 1)");
+        terminal_insert_new_line();
+        printf("  model                 - Show the plant model and its update kernels");
+        terminal_insert_new_line();
+        printf("  model load <n>        - Receive a binary model with n states (model_blob.py)");
+        terminal_insert_new_line();
+        printf("  model <dense|modal>   - Restore the built-in model in dense or modal form");
+        terminal_insert_new_line();
+        printf("  ff <steps> [input]    - Advance the plant by steps with the input held");
+        terminal_insert_new_line();
+        printf("  health [clear]        - Show or clear the inf/NaN and runaway fault log");
+        terminal_insert_new_line();
+        printf("  health action <a>     - Action on a fault: clamp, reset or config");
+        terminal_insert_new_line();
+        printf("  catchup [clear]       - Show or clear the missed control-loop releases");
+        terminal_insert_new_line();
+        printf("  catchup <p> [max]     - Catch-up policy for missed releases: skip, step or ff");
+        terminal_insert_new_line();
+        printf("  events                - Show the event counters of the scheduler queues");
+        terminal_insert_new_line();
+        printf("  cyclic                - Show the frame timing of the cyclic executive");
+        terminal_insert_new_line();
+        printf("  watchdog              - Show the task check-ins and the last watchdog reset");
+        terminal_insert_new_line();
+        printf("  boot                  - Show the init stage times and time to first step");
+        terminal_insert_new_line();
+        printf("  clock [<MHz>]         - Show or switch the clock profile: 100, 84, 48 or 16");
+        terminal_insert_new_line();
+        printf("  clock auto <on|off>   - 16 MHz in idle and config mode, 100 MHz in mod mode");
+        terminal_insert_new_line();
         printf("  exit                  - Leave config mode");
         terminal_insert_new_line();
         printf("  clear                 - Clear terminal screen");
@@ -818,4 +1739,17 @@ static void cli_print_mode_change_message(converter_mode_t mode)
 
         terminal_insert_new_line();
         terminal_print_arrow();
+}
+
+// The fixed-point PID saturates gains outside its Q formats, so they are rejected.
+static void cli_print_q31_gain_limits(void)
+{
+        float kp_max, ki_max, kd_max;
+
+        pid_q31_get_gain_limits(&kp_max, &ki_max, &kd_max);
+        printf("  The fixed-point PID needs |kp| < %.0f, |ki| < %.0f and |kd| < %.6f! Try again.",
+               kp_max,
+               ki_max,
+               kd_max);
+        terminal_insert_new_line();
 }
\ No newline at end of file
@@ -10,25 +10,103 @@
  *     - Sets AHB, APB1, and APB2 prescalers
  *     - Configures the main PLL using HSE as the clock source
  *     - Enables the PLL and switches SYSCLK to the PLL output
+ *     - Falls back to a PLL fed by HSI if HSE does not start
  *
  *     The final system clock configuration is:
  *         SYSCLK = 100 MHz (from PLL)
  *         HCLK   = 100 MHz
  *         PCLK1  = 50  MHz
  *         PCLK2  = 100 MHz
+ *
+ *     The clock getters decode the RCC registers, so the peripheral rates always follow the
+ *     clock that is actually running rather than the configuration above.
+ *
+ *     clock_set_profile() switches the core at run time between the profiles of clock_profiles
+ *     (100, 84, 48 and 16 MHz). With interrupts masked it moves SYSCLK to HSI, relocks the PLL
+ *     for the new profile, adjusts the Flash wait states and then reloads SysTick, TIM2, TIM5
+ *     and the USART2 baud rate for the new clock. With auto scaling on, the converter mode
+ *     selects the profile: 16 MHz in idle and config mode, 100 MHz in mod mode.
+ *
+ * Notes:
+ *     - Every wait on a ready bit is bounded with the DWT cycle counter (dwt_init() must run
+ *       first). The core runs on HSI (16 MHz) during the waits.
+ *     - Without the ST-LINK MCO clock, HSE never becomes ready. The PLL is then fed by HSI and
+ *       SYSCLK is still 100 MHz, only less accurate (HSI is +-1 %, which the UART tolerates).
+ *     - If the PLL does not lock either, the core stays on HSI at 16 MHz and the derived clocks
+ *       follow.
+ *     - The timers keep counting through a profile switch, but at 16 MHz with the old scaling
+ *       while the PLL relocks. The time they miss there is measured with the cycle counter and
+ *       added back when they are reloaded, so the tick and the loop period do not drift.
+ *     - APB1 is HCLK / 2 in every profile, so the APB1 timer clock always equals HCLK.
+ *     - A switch waits for the byte being sent on USART2. A byte received during the switch is
+ *       lost.
+ *     - Cycle counts measured before a switch are converted to time with the current clock.
  */
 
+#include <stdbool.h>
 #include <stddef.h> // stddef.h is used to access size_t type definition.
 #include <stdint.h>
+#include <stdio.h>
 
 #include "stm32f4xx.h"
 
 #include "clock.h"
 
-#define WAIT_STATE 3
-#define PLLM_VALUE 4UL
-#define PLLN_VALUE 100UL
-#define PLLP_VALUE 2UL
+#include "dwt.h"
+#include "systick.h"
+#include "terminal.h"
+#include "timebase.h"
+#include "timer.h"
+#include "uart.h"
+
+#define PLLM_VALUE_HSE 4UL // HSE / 4 = 2 MHz VCO input
+#define PLLM_VALUE_HSI 8UL // HSI / 8 = 2 MHz VCO input
+
+// Profiles selected by auto scaling.
+#define CLOCK_PROFILE_RUN  CLOCK_PROFILE_100MHZ
+#define CLOCK_PROFILE_IDLE CLOCK_PROFILE_16MHZ
+
+// Longest waits on the ready bits, in us.
+#define CLOCK_HSE_TIMEOUT_US    100000UL // Same as the ST HAL HSE start-up timeout
+#define CLOCK_PLL_TIMEOUT_US    2000UL   // Lock takes about 100 us
+#define CLOCK_SWITCH_TIMEOUT_US 2000UL
+
+static const char *const clock_source_names[CLOCK_SOURCES_NUM] = {"HSE PLL", "HSI PLL", "HSI"};
+
+// AHB and APB prescaler divisions, indexed by the HPRE and PPREx fields of RCC_CFGR.
+static const uint16_t clock_ahb_divisions[16] = {1U, 1U, 1U, 1U, 1U, 1U, 1U, 1U,
+                                                 2U, 4U, 8U, 16U, 64U, 128U, 256U, 512U};
+static const uint8_t clock_apb_divisions[8]   = {1U, 1U, 1U, 1U, 2U, 4U, 8U, 16U};
+
+/*
+ * PLL settings and Flash wait states (2.7 V to 3.6 V) of each profile. The VCO input is 2 MHz
+ * for both PLL sources, the VCO output must be 100-432 MHz. plln = 0 runs the core from HSI.
+ */
+struct clock_profile_config
+{
+        uint32_t sysclk;
+        uint32_t plln;
+        uint32_t pllp;
+        size_t wait_states;
+};
+
+const char *const clock_profile_names[CLOCK_PROFILES_NUM] = {"100", "84", "48", "16"};
+
+static const struct clock_profile_config clock_profiles[CLOCK_PROFILES_NUM] = {
+        {100000000UL, 100UL, 2UL, 3}, // VCO 200 MHz
+        {84000000UL, 168UL, 4UL, 2},  // VCO 336 MHz
+        {48000000UL, 96UL, 4UL, 1},   // VCO 192 MHz
+        {16000000UL, 0UL, 0UL, 0}     // HSI, PLL off
+};
+
+static clock_source_t clock_source   = CLOCK_SOURCE_HSI;
+static clock_profile_t clock_profile = CLOCK_PROFILE_16MHZ;
+static bool clock_auto_scaling       = false;
+
+// Profile switches and their latency (interrupts masked until the peripherals are reloaded).
+static uint32_t clock_switches       = 0UL;
+static uint32_t clock_last_switch_us = 0UL;
+static uint32_t clock_max_switch_us  = 0UL;
 
 static const uint32_t flash_acr_latency_ws[] = {
         FLASH_ACR_LATENCY_0WS,
@@ -41,11 +119,14 @@ static const uint32_t flash_acr_latency_ws[] = {
         FLASH_ACR_LATENCY_7WS,
 };
 
-static void clock_enable_HSE(void);
+static bool clock_enable_HSE(void);
+static void clock_disable_HSE(void);
 static void clock_configure_flash_wait_states(size_t wait_state);
 static void clock_configure_prescalers(void);
-static void clock_configure_PLL(void);
-static void clock_switch_SYSCLK_to_PLL(void);
+static bool clock_configure_PLL(uint32_t source, uint32_t pllm, uint32_t plln, uint32_t pllp);
+static bool clock_switch_SYSCLK_to_PLL(void);
+static void clock_switch_SYSCLK_to_HSI(void);
+static bool clock_wait(volatile uint32_t *reg, uint32_t mask, uint32_t value, uint32_t timeout_us);
 
 /*
  * Complete system clock initialization.
@@ -53,16 +134,247 @@ static void clock_switch_SYSCLK_to_PLL(void);
  * - Enable HSE in bypass mode (8 MHz from ST-LINK MCO)
  * - Configure Flash wait states and caches
  * - Set AHB and APB prescalers
- * - Configure and enable PLL (100 MHz SYSCLK)
- * - Switch SYSCLK to PLL
+ * - Configure and enable PLL (100 MHz SYSCLK), from HSI if HSE failed
+ * - Switch SYSCLK to PLL, or stay on HSI if the PLL failed
  */
 void clock_init(void)
 {
-        clock_enable_HSE();
-        clock_configure_flash_wait_states(WAIT_STATE);
+        const struct clock_profile_config *config = &clock_profiles[CLOCK_PROFILE_100MHZ];
+
+        bool hse_ready = clock_enable_HSE();
+
+        clock_configure_flash_wait_states(config->wait_states);
         clock_configure_prescalers();
-        clock_configure_PLL();
-        clock_switch_SYSCLK_to_PLL();
+
+        if (hse_ready &&
+            clock_configure_PLL(RCC_PLLCFGR_PLLSRC_HSE,
+                                PLLM_VALUE_HSE,
+                                config->plln,
+                                config->pllp) &&
+            clock_switch_SYSCLK_to_PLL())
+        {
+                clock_source  = CLOCK_SOURCE_HSE_PLL;
+                clock_profile = CLOCK_PROFILE_100MHZ;
+                return;
+        }
+
+        clock_disable_HSE();
+
+        if (clock_configure_PLL(RCC_PLLCFGR_PLLSRC_HSI,
+                                PLLM_VALUE_HSI,
+                                config->plln,
+                                config->pllp) &&
+            clock_switch_SYSCLK_to_PLL())
+        {
+                clock_source  = CLOCK_SOURCE_HSI_PLL;
+                clock_profile = CLOCK_PROFILE_100MHZ;
+                return;
+        }
+
+        // Neither PLL works: stay on HSI with the PLL off.
+        RCC->CR &= ~RCC_CR_PLLON;
+        clock_source  = CLOCK_SOURCE_HSI;
+        clock_profile = CLOCK_PROFILE_16MHZ;
+}
+
+/*
+ * Switch the core clock to a profile and reload the clocked peripherals (call after they are
+ * initialized, from thread mode). Returns false if the PLL did not lock, the core then runs
+ * from HSI (16 MHz profile).
+ */
+bool clock_set_profile(clock_profile_t profile)
+{
+        const struct clock_profile_config *config = &clock_profiles[profile];
+
+        if (profile == clock_profile)
+        {
+                return true;
+        }
+        if (config->plln != 0UL && clock_source == CLOCK_SOURCE_HSI)
+        {
+                // No PLL source started at boot.
+                return false;
+        }
+
+        uint64_t start_us = time_now_us();
+        uint32_t primask  = __get_PRIMASK();
+        __disable_irq();
+
+        uint32_t old_hclk = clock_get_hclk();
+        size_t old_ws     = (FLASH->ACR & FLASH_ACR_LATENCY_Msk) >> FLASH_ACR_LATENCY_Pos;
+
+        uart2_wait_tx_done();
+
+        // Raise the wait states before the clock goes up, lower them only after it went down.
+        if (config->wait_states > old_ws)
+        {
+                clock_configure_flash_wait_states(config->wait_states);
+        }
+
+        // The PLL can only be reconfigured while it is off, so run from HSI meanwhile.
+        clock_switch_SYSCLK_to_HSI();
+        uint32_t hsi_start = dwt_get_cycles();
+
+        bool pll_ok = true;
+        if (config->plln != 0UL)
+        {
+                // Keep the PLL source and PLLM chosen by clock_init().
+                uint32_t pll_cfgr = RCC->PLLCFGR;
+                uint32_t pllm     = (pll_cfgr & RCC_PLLCFGR_PLLM_Msk) >> RCC_PLLCFGR_PLLM_Pos;
+
+                pll_ok = clock_configure_PLL(pll_cfgr & RCC_PLLCFGR_PLLSRC,
+                                             pllm,
+                                             config->plln,
+                                             config->pllp) &&
+                         clock_switch_SYSCLK_to_PLL();
+        }
+        if (config->plln == 0UL || !pll_ok)
+        {
+                RCC->CR &= ~RCC_CR_PLLON;
+                profile = CLOCK_PROFILE_16MHZ;
+                config  = &clock_profiles[profile];
+        }
+
+        /*
+         * The timers counted hsi_cycles at 16 MHz while scaled for old_hclk, so they are behind
+         * by hsi_cycles * (1 / HSI_CLK - 1 / old_hclk).
+         */
+        uint32_t hsi_cycles = dwt_get_cycles() - hsi_start;
+        uint32_t lost_us    = (uint32_t)((uint64_t)hsi_cycles * (old_hclk - HSI_CLK) /
+                                      ((HSI_CLK / 1000000UL) * (uint64_t)old_hclk));
+
+        systick_rescale(lost_us);
+        tim2_rescale(lost_us);
+        timebase_rescale(lost_us);
+        uart2_rescale();
+
+        if (config->wait_states < old_ws)
+        {
+                clock_configure_flash_wait_states(config->wait_states);
+        }
+
+        clock_profile = profile;
+
+        __set_PRIMASK(primask);
+
+        clock_last_switch_us = (uint32_t)(time_now_us() - start_us);
+        if (clock_last_switch_us > clock_max_switch_us)
+        {
+                clock_max_switch_us = clock_last_switch_us;
+        }
+        clock_switches++;
+
+        return pll_ok;
+}
+
+clock_profile_t clock_get_profile(void)
+{
+        return clock_profile;
+}
+
+void clock_set_auto_scaling(bool on)
+{
+        clock_auto_scaling = on;
+}
+
+// Select the profile of the converter mode if auto scaling is on (called on mode changes).
+void clock_apply_auto_scaling(bool running)
+{
+        if (clock_auto_scaling)
+        {
+                clock_set_profile(running ? CLOCK_PROFILE_RUN : CLOCK_PROFILE_IDLE);
+        }
+}
+
+void clock_print(void)
+{
+        printf("  Profile %s MHz, source %s: SYSCLK %lu, HCLK %lu, PCLK1 %lu, PCLK2 %lu MHz",
+               clock_profile_names[clock_profile],
+               clock_source_names[clock_source],
+               (unsigned long)(clock_get_sysclk() / 1000000UL),
+               (unsigned long)(clock_get_hclk() / 1000000UL),
+               (unsigned long)(clock_get_pclk1() / 1000000UL),
+               (unsigned long)(clock_get_pclk2() / 1000000UL));
+        terminal_insert_new_line();
+        printf("  Flash wait states: %lu",
+               (unsigned long)((FLASH->ACR & FLASH_ACR_LATENCY_Msk) >> FLASH_ACR_LATENCY_Pos));
+        terminal_insert_new_line();
+        printf("  Auto scaling: %s (%s MHz in idle and config mode, %s MHz in mod mode)",
+               clock_auto_scaling ? "on" : "off",
+               clock_profile_names[CLOCK_PROFILE_IDLE],
+               clock_profile_names[CLOCK_PROFILE_RUN]);
+        terminal_insert_new_line();
+        printf("  Switches: %lu, last %lu us, max %lu us",
+               (unsigned long)clock_switches,
+               (unsigned long)clock_last_switch_us,
+               (unsigned long)clock_max_switch_us);
+        terminal_insert_new_line();
+}
+
+clock_source_t clock_get_source(void)
+{
+        return clock_source;
+}
+
+const char *clock_get_source_name(void)
+{
+        return clock_source_names[clock_source];
+}
+
+// System clock decoded from the active source (SWS) and the PLL configuration.
+uint32_t clock_get_sysclk(void)
+{
+        switch (RCC->CFGR & RCC_CFGR_SWS_Msk)
+        {
+        case RCC_CFGR_SWS_HSE:
+                return HSE_CLK;
+        case RCC_CFGR_SWS_PLL:
+        {
+                uint32_t pll_cfgr = RCC->PLLCFGR;
+                uint32_t input    = (pll_cfgr & RCC_PLLCFGR_PLLSRC) ? HSE_CLK : HSI_CLK;
+                uint32_t pllm     = (pll_cfgr & RCC_PLLCFGR_PLLM_Msk) >> RCC_PLLCFGR_PLLM_Pos;
+                uint32_t plln     = (pll_cfgr & RCC_PLLCFGR_PLLN_Msk) >> RCC_PLLCFGR_PLLN_Pos;
+                uint32_t pllp =
+                        (((pll_cfgr & RCC_PLLCFGR_PLLP_Msk) >> RCC_PLLCFGR_PLLP_Pos) + 1UL) * 2UL;
+
+                return input / pllm * plln / pllp;
+        }
+        default:
+                return HSI_CLK;
+        }
+}
+
+uint32_t clock_get_hclk(void)
+{
+        return clock_get_sysclk() /
+               clock_ahb_divisions[(RCC->CFGR & RCC_CFGR_HPRE_Msk) >> RCC_CFGR_HPRE_Pos];
+}
+
+uint32_t clock_get_pclk1(void)
+{
+        return clock_get_hclk() /
+               clock_apb_divisions[(RCC->CFGR & RCC_CFGR_PPRE1_Msk) >> RCC_CFGR_PPRE1_Pos];
+}
+
+uint32_t clock_get_pclk2(void)
+{
+        return clock_get_hclk() /
+               clock_apb_divisions[(RCC->CFGR & RCC_CFGR_PPRE2_Msk) >> RCC_CFGR_PPRE2_Pos];
+}
+
+// The timers of an APB bus run at twice its clock when the bus prescaler divides.
+uint32_t clock_get_apb1_timer_clock(void)
+{
+        uint32_t pclk1 = clock_get_pclk1();
+
+        return (pclk1 == clock_get_hclk()) ? pclk1 : 2UL * pclk1;
+}
+
+uint32_t clock_get_apb2_timer_clock(void)
+{
+        uint32_t pclk2 = clock_get_pclk2();
+
+        return (pclk2 == clock_get_hclk()) ? pclk2 : 2UL * pclk2;
 }
 
 /*
@@ -73,7 +385,7 @@ void clock_init(void)
  * (PH1) is left floating. Therefore, HSE must be enabled in bypass mode
  * to accept the externally driven clock signal.
  */
-static void clock_enable_HSE(void)
+static bool clock_enable_HSE(void)
 {
         // Select bypass mode since OSC_IN is driven by an external clock.
         RCC->CR |= RCC_CR_HSEBYP;
@@ -81,16 +393,29 @@ static void clock_enable_HSE(void)
         // Enable the external high-speed clock.
         RCC->CR |= RCC_CR_HSEON;
 
-        // Wait until the HSE clock becomes ready.
-        while (!(RCC->CR & RCC_CR_HSERDY))
-                ;
+        // Wait until the HSE clock becomes ready (it does not without the ST-LINK MCO).
+        return clock_wait(&RCC->CR, RCC_CR_HSERDY, RCC_CR_HSERDY, CLOCK_HSE_TIMEOUT_US);
+}
+
+// Turn HSE off again after a failed start, the PLL is then fed by HSI.
+static void clock_disable_HSE(void)
+{
+        // The PLL must not run from HSE while HSE is stopped.
+        clock_switch_SYSCLK_to_HSI();
+        RCC->CR &= ~RCC_CR_PLLON;
+
+        RCC->CR &= ~RCC_CR_HSEON;
+        clock_wait(&RCC->CR, RCC_CR_HSERDY, 0UL, CLOCK_HSE_TIMEOUT_US);
+
+        // HSEBYP can only be written while HSE is off.
+        RCC->CR &= ~RCC_CR_HSEBYP;
 }
 
 /*
- * Configure Flash wait states for 100 MHz operation.
+ * Configure Flash wait states for the system clock.
  *
  * At 3.3 V and SYSCLK = 100 MHz, the Flash requires 3 WS (wait states) for
- * reliable read access.
+ * reliable read access (2 WS up to 90 MHz, 1 WS up to 64 MHz, 0 WS up to 30 MHz).
  */
 static void clock_configure_flash_wait_states(size_t wait_state)
 {
@@ -139,19 +464,23 @@ static void clock_configure_prescalers(void)
 }
 
 /*
- * Configure PLL to generate a 100 MHz system clock from HSE (8 MHz).
+ * Configure PLL to generate the system clock from HSE (8 MHz) or HSI (16 MHz).
+ *
+ * PLL settings for 100 MHz (the other profiles are in clock_profiles):
+ * - PLLM = 4 (HSE) or 8 (HSI) : VCO_in  = 2 MHz   (must be 1–2 MHz)
+ * - PLLN = 100                : VCO_out = 200 MHz (must be 100–432 MHz)
+ * - PLLP = 2                  : SYSCLK  = 100 MHz
  *
- * PLL settings:
- * - PLLM = 4   : VCO_in  = 2 MHz   (must be 1–2 MHz)
- * - PLLN = 100 : VCO_out = 200 MHz (must be 100–432 MHz)
- * - PLLP = 2   : SYSCLK  = 100 MHz
+ * Returns false if the PLL does not stop or lock in time.
  */
-static void clock_configure_PLL(void)
+static bool clock_configure_PLL(uint32_t source, uint32_t pllm, uint32_t plln, uint32_t pllp)
 {
         // Disable PLL before configuration.
         RCC->CR &= ~RCC_CR_PLLON;
-        while (RCC->CR & RCC_CR_PLLRDY)
-                ;
+        if (!clock_wait(&RCC->CR, RCC_CR_PLLRDY, 0UL, CLOCK_PLL_TIMEOUT_US))
+        {
+                return false;
+        }
 
         // Start from current value to preserve reserved bits.
         uint32_t pll_cfgr = RCC->PLLCFGR;
@@ -159,15 +488,15 @@ static void clock_configure_PLL(void)
         pll_cfgr &= ~(RCC_PLLCFGR_PLLM_Msk | RCC_PLLCFGR_PLLN_Msk | RCC_PLLCFGR_PLLP_Msk |
                       RCC_PLLCFGR_PLLSRC_Msk);
 
-        // Select HSE as PLL source.
-        pll_cfgr |= RCC_PLLCFGR_PLLSRC_HSE;
+        // Select HSE or HSI as PLL source.
+        pll_cfgr |= source;
 
-        pll_cfgr |= (PLLM_VALUE << 0U);
+        pll_cfgr |= (pllm << 0U);
 
-        pll_cfgr |= (PLLN_VALUE << 6U);
+        pll_cfgr |= (plln << 6U);
 
         // Set PLLP (bits 17:16), encoded as (PLLP/2 - 1)
-        pll_cfgr |= (((PLLP_VALUE / 2U) - 1U) << 16U);
+        pll_cfgr |= (((pllp / 2U) - 1U) << 16U);
 
         // Write back the configuration (reserved bits preserved).
         RCC->PLLCFGR = pll_cfgr;
@@ -176,8 +505,7 @@ static void clock_configure_PLL(void)
         RCC->CR |= RCC_CR_PLLON;
 
         // Wait until PLL is locked and ready.
-        while (!(RCC->CR & RCC_CR_PLLRDY))
-                ;
+        return clock_wait(&RCC->CR, RCC_CR_PLLRDY, RCC_CR_PLLRDY, CLOCK_PLL_TIMEOUT_US);
 }
 
 /*
@@ -185,8 +513,10 @@ static void clock_configure_PLL(void)
  *
  * SW  = 0b10: PLL selected as system clock
  * SWS = 0b10: PLL is the active system clock
+ *
+ * Returns false (and goes back to HSI) if the switch does not complete in time.
  */
-static void clock_switch_SYSCLK_to_PLL(void)
+static bool clock_switch_SYSCLK_to_PLL(void)
 {
         RCC->CFGR &= ~RCC_CFGR_SW_Msk;
 
@@ -194,6 +524,39 @@ static void clock_switch_SYSCLK_to_PLL(void)
         RCC->CFGR |= RCC_CFGR_SW_PLL;
 
         // Wait until PLL is actually used as system clock.
-        while ((RCC->CFGR & RCC_CFGR_SWS_Msk) != RCC_CFGR_SWS_PLL)
-                ;
+        if (clock_wait(&RCC->CFGR, RCC_CFGR_SWS_Msk, RCC_CFGR_SWS_PLL, CLOCK_SWITCH_TIMEOUT_US))
+        {
+                return true;
+        }
+
+        clock_switch_SYSCLK_to_HSI();
+
+        return false;
+}
+
+// Select HSI as system clock (the reset state).
+static void clock_switch_SYSCLK_to_HSI(void)
+{
+        RCC->CFGR &= ~RCC_CFGR_SW_Msk;
+        clock_wait(&RCC->CFGR, RCC_CFGR_SWS_Msk, RCC_CFGR_SWS_HSI, CLOCK_SWITCH_TIMEOUT_US);
+}
+
+/*
+ * Wait until (*reg & mask) == value, for at most timeout_us. The timeout is counted in core
+ * cycles at the current HCLK. Returns false on timeout.
+ */
+static bool clock_wait(volatile uint32_t *reg, uint32_t mask, uint32_t value, uint32_t timeout_us)
+{
+        uint32_t timeout_cycles = timeout_us * (clock_get_hclk() / 1000000UL);
+        uint32_t start          = dwt_get_cycles();
+
+        while ((*reg & mask) != value)
+        {
+                if (dwt_get_cycles() - start > timeout_cycles)
+                {
+                        return false;
+                }
+        }
+
+        return true;
 }
\ No newline at end of file
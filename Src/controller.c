@@ -6,12 +6,28 @@
  *
  * Notes:
  *     - pid_init() initializes controller parameters and state.
- *     - pid_update() computes one control step.
+ *     - pid_update() computes one control step, in float or, when PID_FIXED_POINT is 1, in Q31
+ *       fixed point (pid_q31.c). pid_float_update() always runs the float version, so the two
+ *       can be compared.
  *     - Gain and reference setter/getter functions are provided.
+ *     - controller_update() runs the controller type selected for the current converter type
+ *       (PID, LQR in lqr.c, PR in pr.c or MPC in mpc.c). Each converter type keeps its own
+ *       selection.
+ *     - controller_apply_input() must follow controller_update() with the input that really
+ *       reaches the plant, so the observer of LQR and MPC is propagated with it.
+ *     - When gain scheduling is on, the PID gains set by the user are replaced with gains
+ *       interpolated from the gain-schedule table at the current operating point.
  */
 
 #include "controller.h"
 
+#include "converter.h"
+#include "gain_schedule.h"
+#include "lqr.h"
+#include "mpc.h"
+#include "observer.h"
+#include "pid_q31.h"
+#include "pr.h"
 #include "utils.h"
 
 struct pid_controller
@@ -28,9 +44,16 @@ struct pid_controller
         float controller_out_max;
 };
 
+const char *const controller_types[CONTROLLER_TYPES_NUM] = {"PID", "LQR", "PR", "MPC"};
+
 static float reference = 40.0f; // Value of the reference at the start-up.
 static struct pid_controller pid;
 
+// Controller type selected for each converter type (indexed by converter_type_t).
+static controller_type_t controller_type_of[TYPES_NUM] = {CONTROLLER_PID, CONTROLLER_PID};
+
+static float pid_step(float kp, float ki, float kd, float reference, float measurement);
+
 void pid_init(float kp,
               float ki,
               float kd,
@@ -50,18 +73,37 @@ void pid_init(float kp,
         pid.int_out_max        = int_out_max;
         pid.controller_out_min = controller_out_min;
         pid.controller_out_max = controller_out_max;
+
+        // The fixed-point controller keeps its own copy of the limits and gains in Q format.
+        pid_q31_init(Ts, int_out_min, int_out_max, controller_out_min, controller_out_max);
+        pid_q31_set_gains(kp, ki, kd);
 }
 
 float pid_update(float reference, float measurement)
+{
+#if PID_FIXED_POINT
+        return pid_q31_update(reference, measurement);
+#else
+        return pid_step(pid.kp, pid.ki, pid.kd, reference, measurement);
+#endif
+}
+
+float pid_float_update(float reference, float measurement)
+{
+        return pid_step(pid.kp, pid.ki, pid.kd, reference, measurement);
+}
+
+// One PID step with the given gains (the user gains or the scheduled gains).
+static float pid_step(float kp, float ki, float kd, float reference, float measurement)
 {
         // Compute error.
         float error = reference - measurement;
 
         // Calculate proportional term.
-        float p = pid.kp * error;
+        float p = kp * error;
 
         // Calculate integral term.
-        pid.integral += (pid.ki * pid.Ts * error);
+        pid.integral += (ki * pid.Ts * error);
 
         // limit integral term to avoid windup.
         pid.integral = CLAMP(pid.integral, pid.int_out_min, pid.int_out_max);
@@ -69,7 +111,7 @@ float pid_update(float reference, float measurement)
         float i = pid.integral;
 
         // Calculate derivative term.
-        float d = (error - pid.prev_error) * (pid.kd / pid.Ts);
+        float d = (error - pid.prev_error) * (kd / pid.Ts);
 
         // Calculate PID controller output.
         float output = p + i + d;
@@ -83,9 +125,21 @@ float pid_update(float reference, float measurement)
         return output;
 }
 
-void pid_set_kp(float kp)
+/*
+ * The gain setters return false and keep the old gain if the fixed-point controller is built in
+ * and the new gain does not fit its Q format.
+ */
+bool pid_set_kp(float kp)
 {
+        if (PID_FIXED_POINT && !pid_q31_gains_fit(kp, pid.ki, pid.kd))
+        {
+                return false;
+        }
+
         pid.kp = kp;
+        pid_q31_set_gains(pid.kp, pid.ki, pid.kd);
+
+        return true;
 }
 
 float pid_get_kp()
@@ -93,9 +147,17 @@ float pid_get_kp()
         return pid.kp;
 }
 
-void pid_set_ki(float ki)
+bool pid_set_ki(float ki)
 {
+        if (PID_FIXED_POINT && !pid_q31_gains_fit(pid.kp, ki, pid.kd))
+        {
+                return false;
+        }
+
         pid.ki = ki;
+        pid_q31_set_gains(pid.kp, pid.ki, pid.kd);
+
+        return true;
 }
 
 float pid_get_ki()
@@ -103,9 +165,17 @@ float pid_get_ki()
         return pid.ki;
 }
 
-void pid_set_kd(float kd)
+bool pid_set_kd(float kd)
 {
+        if (PID_FIXED_POINT && !pid_q31_gains_fit(pid.kp, pid.ki, kd))
+        {
+                return false;
+        }
+
         pid.kd = kd;
+        pid_q31_set_gains(pid.kp, pid.ki, pid.kd);
+
+        return true;
 }
 
 float pid_get_kd()
@@ -131,4 +201,81 @@ void pid_clear_integrator(void)
 void pid_clear_prev_error(void)
 {
         pid.prev_error = 0;
+}
+
+float controller_update(float reference, float measurement)
+{
+        switch (controller_type_of[converter_get_type()])
+        {
+        case CONTROLLER_LQR:
+                return lqr_update(reference, measurement);
+        case CONTROLLER_PR:
+                return pr_update(reference, measurement);
+        case CONTROLLER_MPC:
+                return mpc_update(reference, measurement);
+        case CONTROLLER_PID:
+        default:
+                if (gs_is_enabled())
+                {
+                        float kp, ki, kd;
+                        float x = (gs_get_source() == GS_SOURCE_REFERENCE) ? reference : measurement;
+
+                        gs_lookup(x, &kp, &ki, &kd);
+#if PID_FIXED_POINT
+                        return pid_q31_step(kp, ki, kd, reference, measurement);
+#else
+                        return pid_step(kp, ki, kd, reference, measurement);
+#endif
+                }
+                return pid_update(reference, measurement);
+        }
+}
+
+/*
+ * Report the plant input of this step (the controller output plus a perturbation, if any). The
+ * state-feedback controllers propagate their observer with it.
+ */
+void controller_apply_input(float input)
+{
+        if (controller_uses_observer(controller_type_of[converter_get_type()]))
+        {
+                observer_predict(input);
+        }
+}
+
+bool controller_uses_observer(controller_type_t type)
+{
+        return type == CONTROLLER_LQR || type == CONTROLLER_MPC;
+}
+
+// Clear the states of all controller types so that a later switch starts from scratch.
+void controller_reset(void)
+{
+        pid_clear_integrator();
+        pid_clear_prev_error();
+        pid_q31_reset();
+        lqr_reset();
+        pr_reset();
+        mpc_reset();
+}
+
+controller_type_t controller_get_type(converter_type_t converter_type)
+{
+        return controller_type_of[converter_type];
+}
+
+void controller_set_type(converter_type_t converter_type, controller_type_t controller_type)
+{
+        controller_type_of[converter_type] = controller_type;
+        controller_reset();
+}
+
+float controller_get_out_min(void)
+{
+        return pid.controller_out_min;
+}
+
+float controller_get_out_max(void)
+{
+        return pid.controller_out_max;
 }
\ No newline at end of file
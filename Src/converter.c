@@ -8,32 +8,51 @@
  *         x[k+1] = Ad*x[k] + Bd*u[k]
  *         y[k]   = Cd*x[k] + Dd*u[k]
  *
+ *     The model is stored in continuous time (Ac, Bc) and discretized with zero-order hold for
+ *     the model step h = 1/SAMPLING_FREQUENCY when the converter is initialized, so changing the
+ *     step does not need new tables.
+ *
  * Notes:
  *     - State vector is stored inside the model instance.
  *     - converter_init() zeros the state and set the type to DC-DC ideal.
  *     - converter_reset_state() zeros the state.
+ *     - converter_get_state() copies the state out (for the loop snapshot).
+ *     - converter_clamp_state() saturates the state to a limit and zeros NaN entries (used by the
+ *       health monitor).
+ *     - converter_state_in_range() tells whether every state entry is finite and within a limit
+ *       (checked by the health monitor after each step).
  *     - converter_update() performs one simulation step.
+ *     - converter_fast_forward() advances the plant alone by many steps with the input held, in a
+ *       logarithmic number of matrix-vector products. The controller and the reference phase do
+ *       not move.
+ *     - Ad, Bd, Cd and Dd below are the built-in model. The matrices actually simulated live in
+ *       the model store (model.c), which starts with the built-in model and can be replaced at
+ *       runtime over UART.
  */
 
-#include <stdatomic.h>
+#include <math.h>
 #include <stddef.h>
 
 #include "stm32f4xx.h"
 
 #include "converter.h"
 
+#include "c2d.h"
 #include "cli.h"
+#include "clock.h"
 #include "controller.h"
+#include "fra.h"
+#include "metrics.h"
+#include "model.h"
+#include "pq.h"
 #include "pwm.h"
-#include "scheduler.h"
+#include "sysid.h"
+#include "timer.h"
 #include "utils.h"
 
-#define SAMPLING_FREQUENCY 50000.0f
-#define SINE_FREQUENCY     50.0f
-
 struct converter_model
 {
-        float x[STATES_NUM][1];
+        float x[MODEL_STATES_MAX];
 };
 
 // Phase change for reference in one time-step.
@@ -54,83 +73,130 @@ static converter_type_t converter_type = DC_DC_IDEAL;
 static converter_mode_t current_mode   = IDLE;
 
 // clang-format off
-// State-space matrices definitions
-static const float Ad[STATES_NUM][STATES_NUM] = {
-        {0.9652f, -0.0172f,  0.0057f, -0.0058f,  0.0052f, -0.0251f},
-        {0.7732f,  0.1252f,  0.2315f,  0.0700f,  0.1282f,  0.7754f},
-        {0.8278f, -0.7522f, -0.0956f,  0.3299f, -0.4855f,  0.3915f},
-        {0.9948f,  0.2655f, -0.3848f,  0.4212f,  0.3927f,  0.2899f},
-        {0.7648f, -0.4165f, -0.4855f, -0.3366f, -0.0986f,  0.7281f},
-        {1.1056f,  0.7587f, -0.1179f,  0.0748f, -0.2192f,  0.1491f},
+/*
+ * Continuous-time state-space matrices of the converter, recovered from the original 20 us
+ * discretization by Tools/continuous_model.py. Cd and Dd are the same in both forms.
+ */
+const float converter_Ac[STATES_NUM][STATES_NUM] = {
+        {-3.34761621e+02f, -3.16672410e+02f,  3.02824831e+01f,
+         -3.01892916e+02f,  1.15535755e+01f, -1.80878220e+03f},
+        { 1.42681944e+04f, -6.57561982e+03f,  3.73527257e+04f,
+          2.59265576e+03f,  2.82012237e+04f,  3.90677825e+03f},
+        { 3.97152027e+03f, -1.21378011e+05f, -1.10373496e+04f,
+          2.94469291e+04f,  8.37794469e+03f,  8.98251334e+04f},
+        { 5.16087449e+04f,  9.83865985e+03f, -3.43542681e+04f,
+         -2.02940928e+04f,  3.55512260e+04f,  1.04468165e+04f},
+        { 1.97897053e+03f, -9.16277762e+04f,  8.38170230e+03f,
+         -3.04755204e+04f, -1.09632903e+04f,  1.20297015e+05f},
+        { 7.96511720e+04f,  3.82552919e+03f, -2.70523211e+04f,
+          2.69634283e+03f, -3.62196690e+04f, -6.45383513e+03f},
+};
+const float converter_Bc[STATES_NUM][INPUTS_NUM] = {
+        { 2.44398134e+03f},
+        {-6.82417954e+03f},
+        { 1.57647914e+04f},
+        { 8.39681812e+03f},
+        {-4.82201154e+03f},
+        { 6.99540084e+03f},
 };
-static const float Bd[STATES_NUM][INPUTS_NUM] = {{0.0471f},
-                                                 {0.0377f}, 
-                                                 {0.4040f}, 
-                                                 {0.0485f}, 
-                                                 {0.0373f}, 
-                                                 {0.0539f}};
-static const float Cd[OUTPUTS_NUM][STATES_NUM] = {{0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}};
-static const float Dd[OUTPUTS_NUM][INPUTS_NUM] = {{0.0f}};
+const float converter_Cd[OUTPUTS_NUM][STATES_NUM] = {{0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f}};
+const float converter_Dd[OUTPUTS_NUM][INPUTS_NUM] = {{0.0f}};
 // clang-format on
 
+// Discrete-time matrices for the model step 1/SAMPLING_FREQUENCY, computed in converter_init().
+float converter_Ad[STATES_NUM][STATES_NUM];
+float converter_Bd[STATES_NUM][INPUTS_NUM];
+
 /*
- * This function initialize a converter model with the state vector of zero and set the type to
- * DC-DC ideal and mode to idle.
+ * This function discretizes the built-in continuous-time model for the model step, initialize a
+ * converter model with it and the state vector of zero and set the type to DC-DC ideal and mode to
+ * idle. It returns the status of the built-in model; without one, mod mode is refused.
  */
-void converter_init(void)
+model_status_t converter_init(void)
 {
+        // Zero-order-hold discretization for h = 1/SAMPLING_FREQUENCY.
+        c2d_zoh(STATES_NUM,
+                &converter_Ac[0][0],
+                &converter_Bc[0][0],
+                1.0f / SAMPLING_FREQUENCY,
+                &converter_Ad[0][0],
+                &converter_Bd[0][0]);
+
+        model_status_t status = model_init();
+
         converter_reset_state();
         converter_set_type(DC_DC_IDEAL);
         converter_set_mode(IDLE);
+
+        return status;
 }
 
 void converter_reset_state(void)
 {
-        for (size_t i = 0; i < STATES_NUM; i++)
-                (plant.x)[i][0] = 0.0f;
+        for (size_t i = 0; i < MODEL_STATES_MAX; i++)
+                (plant.x)[i] = 0.0f;
 }
 
-void converter_update(float const u[INPUTS_NUM][1], float y[OUTPUTS_NUM][1])
+void converter_get_state(float x[])
 {
-        float x_next[STATES_NUM][1];
+        for (size_t i = 0; i < MODEL_STATES_MAX; i++)
+                x[i] = (plant.x)[i];
+}
 
-        // x_(n+1) = Ad * x_n + Bd * u_n
-        for (size_t i = 0; i < STATES_NUM; i++)
+void converter_set_state(const float x[])
+{
+        for (size_t i = 0; i < MODEL_STATES_MAX; i++)
+                (plant.x)[i] = x[i];
+}
+
+void converter_clamp_state(float limit)
+{
+        for (size_t i = 0; i < MODEL_STATES_MAX; i++)
         {
-                float result = 0.0f;
+                plant.x[i] = isnan(plant.x[i]) ? 0.0f : fminf(fmaxf(plant.x[i], -limit), limit);
+        }
+}
 
-                for (size_t j = 0; j < STATES_NUM; j++)
-                {
-                        result += (Ad[i][j] * (plant.x)[j][0]);
-                }
-                for (size_t k = 0; k < INPUTS_NUM; k++)
+bool converter_state_in_range(float limit)
+{
+        for (size_t i = 0; i < MODEL_STATES_MAX; i++)
+        {
+                // Written so that a NaN entry fails the comparison.
+                if (!(fabsf(plant.x[i]) <= limit))
                 {
-                        result += Bd[i][k] * u[k][0];
+                        return false;
                 }
-
-                x_next[i][0] = result;
         }
 
-        // Update the model's state to the new state (x_n -> x_(n+1))
-        for (size_t i = 0; i < STATES_NUM; i++)
+        return true;
+}
+
+void converter_update(float const u[INPUTS_NUM][1], float y[OUTPUTS_NUM][1])
+{
+        // A newly loaded model takes over here, between two steps, starting from zero state.
+        if (model_swap_if_pending())
         {
-                (plant.x)[i][0] = x_next[i][0];
+                converter_reset_state();
         }
 
         /*
-         * y_(n+1) = Cd * x_(n+1) (state and output should be at the same time index after this
-         * function returns). Here Dd is zero and it is not included in the calculations.
+         * x_(n+1) = Ad * x_n + Bd * u_n and y_(n+1) = Cd * x_(n+1) (state and output should be at
+         * the same time index after this function returns). The model store runs the kernels
+         * chosen for the order and sparsity of the loaded model.
          */
-        for (size_t i = 0; i < OUTPUTS_NUM; i++)
-        {
-                float result = 0.0f;
+        y[0][0] = model_step(plant.x, u[0][0]);
+}
 
-                for (size_t j = 0; j < STATES_NUM; j++)
-                {
-                        result += Cd[i][j] * (plant.x)[j][0];
-                }
-                y[i][0] = result;
+// Advance the plant by steps with the input held at input (zero-order hold over the whole span).
+void converter_fast_forward(uint32_t steps, float input)
+{
+        if (model_swap_if_pending())
+        {
+                converter_reset_state();
         }
+
+        u[0][0] = input;
+        y[0][0] = model_fast_forward(plant.x, input, steps);
 }
 
 converter_type_t converter_get_type(void)
@@ -150,6 +216,9 @@ converter_mode_t converter_get_mode(void)
 
 void converter_set_mode(converter_mode_t mode)
 {
+        // Full speed only while the loop runs, if auto scaling is on.
+        clock_apply_auto_scaling(mode == MOD);
+
         if (mode == IDLE || mode == CONFIG)
         {
                 /*
@@ -164,9 +233,8 @@ void converter_set_mode(converter_mode_t mode)
                 // Reset TIM2 counter register.
                 TIM2->CNT = 0U;
 
-                // Clear PID controller integral accumulative term and previous error.
-                pid_clear_integrator();
-                pid_clear_prev_error();
+                // Clear the controller states (PID integrator and previous error, LQR observer).
+                controller_reset();
 
                 // Set plant's input and output to 0.
                 u[0][0] = 0.0f;
@@ -175,11 +243,14 @@ void converter_set_mode(converter_mode_t mode)
                 // Reset converter state vector.
                 converter_reset_state();
 
+                // Abort a frequency-response sweep, it needs the loop running.
+                fra_stop();
+
                 /*
-                 * Remove TASK0 from the scheduler so that we do not update the loop accidentally
-                 * after coming out of MOD mode.
+                 * Remove the pending loop releases from the scheduler so that we do not update the
+                 * loop accidentally after coming out of MOD mode.
                  */
-                atomic_fetch_and(&ready_flag_word, ~TASK0);
+                tim2_clear_releases();
 
                 // Turn off TIM2 PWM so that green LED turns off.
                 pwm_tim2_set_duty(0.0f);
@@ -201,6 +272,13 @@ void converter_set_mode(converter_mode_t mode)
 
                 // Turn on TIM2 PWM so that green LED turns on.
                 pwm_tim2_enable();
+
+                // Start a new performance record for the step from 0 V to the reference.
+                metrics_reset();
+                // Drop the power-quality results of the previous run.
+                pq_reset();
+                // The plant restarts from zero state, so restart the identification as well.
+                sysid_reset();
         }
 
         current_mode = mode;
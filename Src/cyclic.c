@@ -0,0 +1,302 @@
+/*
+ * cyclic.c
+ *
+ * Description:
+ *     Time-triggered cyclic executive, the alternative to the event-driven scheduler selected
+ *     with SCHEDULER_CYCLIC.
+ *
+ *     SysTick is the only base tick: it releases a minor frame every CYCLIC_MINOR_FRAME_MS. A
+ *     static table gives the tasks of each of the CYCLIC_MINOR_FRAMES minor frames of the 200 ms
+ *     major frame:
+ *     - the control loop in every frame (5 ms, the TIM2 rate),
+ *     - the button sampling in frames 1, 5, 9, ... (20 ms, the button polling period),
+ *     - the output print in frame 2 (200 ms, the SysTick print period).
+ *     Within a frame the slots run in that order. Each slot releases its task with the release
+ *     function the event-driven scheduler calls from TIM2 or a software timer, then runs the task
+ *     on the queued events, so the phasing between the tasks is fixed by the table. The CLI runs in
+ *     the slack of each frame, between the end of its slots and the next base tick.
+ *
+ * Notes:
+ *     - Every frame of the table is checked at build time: the budgets of its tasks plus the slack
+ *       kept for the CLI must fit in the minor frame. A budget is the measured WCET of the task
+ *       from cyclic_wcet.h plus CYCLIC_WCET_MARGIN_PCT percent, so the check runs on measured
+ *       times. The "cyclic" command measures the worst cases at run time (DWT CYCCNT), flags any
+ *       task above its budget (or its checked-in WCET) and a frame above its time, and prints
+ *       the lines to paste into cyclic_wcet.h.
+ *     - A frame overruns when its slots are still running at the next base tick. A frame that is
+ *       released while the previous one, or a long CLI command in the slack, is still running is
+ *       skipped. The loop is still released once for each skipped frame, so its catch-up policy
+ *       sees the missed steps.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "cyclic.h"
+
+#include "clock.h"
+#include "cyclic_wcet.h"
+#include "converter.h"
+#include "dwt.h"
+#include "scheduler.h"
+#include "supervisor.h"
+#include "systick.h"
+#include "terminal.h"
+#include "timer.h"
+#include "utils.h"
+
+#define CYCLIC_TASKS_NUM 3
+
+// Task bits of a table entry.
+#define CYCLIC_LOOP   (1U << 0U)
+#define CYCLIC_BUTTON (1U << 1U)
+#define CYCLIC_PRINT  (1U << 2U)
+
+// Frame contents used by the table.
+#define CYCLIC_L  (CYCLIC_LOOP)
+#define CYCLIC_LB (CYCLIC_LOOP | CYCLIC_BUTTON)
+#define CYCLIC_LP (CYCLIC_LOOP | CYCLIC_PRINT)
+
+// Budgets of the tasks (measured WCET plus a margin) and the slack kept for the CLI, in us.
+#define CYCLIC_WCET_MARGIN_PCT  125U
+#define CYCLIC_BUDGET_US(wcet)  (((wcet) * CYCLIC_WCET_MARGIN_PCT + 99U) / 100U)
+#define CYCLIC_BUDGET_LOOP_US   CYCLIC_BUDGET_US(CYCLIC_WCET_LOOP_US)
+#define CYCLIC_BUDGET_BUTTON_US CYCLIC_BUDGET_US(CYCLIC_WCET_BUTTON_US)
+#define CYCLIC_BUDGET_PRINT_US  CYCLIC_BUDGET_US(CYCLIC_WCET_PRINT_US)
+#define CYCLIC_SLACK_MIN_US     1000U
+
+#define CYCLIC_FRAME_COST_US(tasks)                                                                \
+        ((((tasks) & CYCLIC_LOOP) ? CYCLIC_BUDGET_LOOP_US : 0U) +                                  \
+         (((tasks) & CYCLIC_BUTTON) ? CYCLIC_BUDGET_BUTTON_US : 0U) +                              \
+         (((tasks) & CYCLIC_PRINT) ? CYCLIC_BUDGET_PRINT_US : 0U))
+
+// Static schedule, one line per 20 ms (four minor frames).
+#define CYCLIC_SCHEDULE(X)                                                                         \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_LP) X(CYCLIC_L)                                          \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)                                           \
+        X(CYCLIC_L) X(CYCLIC_LB) X(CYCLIC_L) X(CYCLIC_L)
+
+#define CYCLIC_TABLE_ENTRY(tasks) tasks,
+#define CYCLIC_CHECK_FRAME(tasks)                                                                  \
+        _Static_assert(CYCLIC_FRAME_COST_US(tasks) + CYCLIC_SLACK_MIN_US <=                        \
+                               CYCLIC_MINOR_FRAME_MS * 1000U,                                      \
+                       "A minor frame does not fit the measured WCETs of its tasks.");
+
+struct cyclic_task
+{
+        const char *name;
+        uint8_t bit;
+        scheduler_queue_t queue;
+        void (*release)(void);
+        uint32_t wcet_us;   // Checked-in measurement (cyclic_wcet.h)
+        uint32_t budget_us; // wcet_us plus the margin
+        const char *macro;  // Name of wcet_us in cyclic_wcet.h
+};
+
+static void cyclic_release_loop(void);
+
+static const uint8_t cyclic_table[] = {CYCLIC_SCHEDULE(CYCLIC_TABLE_ENTRY)};
+
+static const struct cyclic_task cyclic_tasks[CYCLIC_TASKS_NUM] = {
+        {"loop",
+         CYCLIC_LOOP,
+         QUEUE_LOOP,
+         cyclic_release_loop,
+         CYCLIC_WCET_LOOP_US,
+         CYCLIC_BUDGET_LOOP_US,
+         "CYCLIC_WCET_LOOP_US"},
+        {"button",
+         CYCLIC_BUTTON,
+         QUEUE_BUTTON,
+         timer_sample_button,
+         CYCLIC_WCET_BUTTON_US,
+         CYCLIC_BUDGET_BUTTON_US,
+         "CYCLIC_WCET_BUTTON_US"},
+        {"print",
+         CYCLIC_PRINT,
+         QUEUE_PRINT,
+         systick_release_print,
+         CYCLIC_WCET_PRINT_US,
+         CYCLIC_BUDGET_PRINT_US,
+         "CYCLIC_WCET_PRINT_US"}};
+
+CYCLIC_SCHEDULE(CYCLIC_CHECK_FRAME)
+_Static_assert(ARRAY_LEN(cyclic_table) == CYCLIC_MINOR_FRAMES,
+               "The table must hold one major frame.");
+_Static_assert(CYCLIC_MINOR_FRAME_MS * TIM2_FREQUENCY == 1000UL,
+               "A minor frame must be one control loop period.");
+_Static_assert(4U * CYCLIC_MINOR_FRAME_MS == BUTTON_POLL_PERIOD_MS,
+               "The button is sampled every fourth frame, at the button polling period.");
+_Static_assert(CYCLIC_MINOR_FRAMES * CYCLIC_MINOR_FRAME_MS == 200U,
+               "The print task runs once per major frame, every 200 ms.");
+
+static _Atomic uint32_t cyclic_released = 0UL; // Frames released by SysTick
+static uint32_t cyclic_started          = 0UL; // Frames started by the executive
+static uint32_t cyclic_task_max_cycles[CYCLIC_TASKS_NUM];
+static uint32_t cyclic_frame_max_cycles = 0UL;
+static uint32_t cyclic_overruns         = 0UL;
+static uint32_t cyclic_skipped          = 0UL;
+static uint32_t cyclic_last_overrun     = 0UL; // Minor frame of the last overrun
+
+// Called by SysTick every CYCLIC_MINOR_FRAME_MS.
+void cyclic_release_frame(void)
+{
+        atomic_fetch_add(&cyclic_released, 1UL);
+}
+
+void cyclic_run(void)
+{
+        for (;;)
+        {
+                // Slack of the frame: serve the CLI until the next frame is released.
+                while (atomic_load(&cyclic_released) == cyclic_started)
+                {
+                        scheduler_dispatch(QUEUE_UART);
+                        supervisor_check_in(SUPERVISOR_BACKGROUND);
+                }
+
+                uint32_t released = atomic_load(&cyclic_released);
+
+                // Skipped frames only release the loop, for its catch-up policy.
+                for (uint32_t skipped = cyclic_started + 1UL; skipped != released; skipped++)
+                {
+                        cyclic_release_loop();
+                        cyclic_skipped++;
+                }
+                cyclic_started = released;
+
+                uint32_t frame       = (released - 1UL) % CYCLIC_MINOR_FRAMES;
+                uint32_t frame_start = dwt_get_cycles();
+
+                for (size_t t = 0; t < CYCLIC_TASKS_NUM; t++)
+                {
+                        const struct cyclic_task *task = &cyclic_tasks[t];
+
+                        if ((cyclic_table[frame] & task->bit) == 0U)
+                        {
+                                continue;
+                        }
+
+                        uint32_t start = dwt_get_cycles();
+
+                        task->release();
+                        while (scheduler_dispatch(task->queue))
+                        {
+                        }
+
+                        uint32_t cycles = dwt_get_cycles() - start;
+                        if (cycles > cyclic_task_max_cycles[t])
+                        {
+                                cyclic_task_max_cycles[t] = cycles;
+                        }
+                }
+
+                uint32_t frame_cycles = dwt_get_cycles() - frame_start;
+                if (frame_cycles > cyclic_frame_max_cycles)
+                {
+                        cyclic_frame_max_cycles = frame_cycles;
+                }
+
+                if (atomic_load(&cyclic_released) != cyclic_started)
+                {
+                        cyclic_overruns++;
+                        cyclic_last_overrun = frame;
+                }
+
+                supervisor_check_in(SUPERVISOR_BACKGROUND);
+        }
+}
+
+void cyclic_print(void)
+{
+        const uint32_t cycles_per_us = clock_get_hclk() / 1000000UL;
+        uint32_t measured[CYCLIC_TASKS_NUM];
+        uint32_t over_budget = 0UL;
+
+        printf("  Cyclic executive (%s): %u ms minor frame, %u frames per major frame",
+               SCHEDULER_CYCLIC ? "running" : "not built in, SCHEDULER_CYCLIC is 0",
+               CYCLIC_MINOR_FRAME_MS,
+               CYCLIC_MINOR_FRAMES);
+        terminal_insert_new_line();
+        printf("  task     wcet [us]   budget [us]   measured max [us]");
+        terminal_insert_new_line();
+
+        for (size_t t = 0; t < CYCLIC_TASKS_NUM; t++)
+        {
+                const struct cyclic_task *task = &cyclic_tasks[t];
+
+                // Rounded up, so that a pasted value still covers the measurement.
+                measured[t] = (cyclic_task_max_cycles[t] + cycles_per_us - 1UL) / cycles_per_us;
+
+                const char *flag = "";
+                if (measured[t] > task->budget_us)
+                {
+                        flag = " (OVER BUDGET)";
+                        over_budget++;
+                }
+                else if (measured[t] > task->wcet_us)
+                {
+                        flag = " (above wcet)";
+                }
+
+                printf("  %-6s   %-9lu   %-11lu   %lu%s",
+                       task->name,
+                       (unsigned long)task->wcet_us,
+                       (unsigned long)task->budget_us,
+                       (unsigned long)measured[t],
+                       flag);
+                terminal_insert_new_line();
+        }
+
+        uint32_t frame_us = (cyclic_frame_max_cycles + cycles_per_us - 1UL) / cycles_per_us;
+        printf("  busiest frame : %lu us (%u us kept for the CLI)%s",
+               (unsigned long)frame_us,
+               CYCLIC_SLACK_MIN_US,
+               (frame_us + CYCLIC_SLACK_MIN_US > CYCLIC_MINOR_FRAME_MS * 1000UL) ? " (OVER)" : "");
+        terminal_insert_new_line();
+        printf("  overruns      : %lu", (unsigned long)cyclic_overruns);
+        if (cyclic_overruns != 0UL)
+        {
+                printf(" (last in frame %lu)", (unsigned long)cyclic_last_overrun);
+        }
+        terminal_insert_new_line();
+        printf("  skipped frames: %lu", (unsigned long)cyclic_skipped);
+        terminal_insert_new_line();
+
+        if (over_budget != 0UL)
+        {
+                printf("  %lu task(s) over budget: the build-time frame check no longer holds.",
+                       (unsigned long)over_budget);
+                terminal_insert_new_line();
+        }
+
+        // Measured worst cases in the form of cyclic_wcet.h, to refresh the build-time check.
+        if (!SCHEDULER_CYCLIC)
+        {
+                return;
+        }
+        printf("  Measured WCETs for Inc/cyclic_wcet.h:");
+        terminal_insert_new_line();
+        for (size_t t = 0; t < CYCLIC_TASKS_NUM; t++)
+        {
+                printf("  #define %-21s %luU", cyclic_tasks[t].macro, (unsigned long)measured[t]);
+                terminal_insert_new_line();
+        }
+}
+
+// The loop slot releases the control task only in mod mode, like TIM2 in the event scheduler.
+static void cyclic_release_loop(void)
+{
+        if (converter_get_mode() == MOD)
+        {
+                tim2_release();
+        }
+}
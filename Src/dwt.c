@@ -0,0 +1,29 @@
+/*
+ * dwt.c
+ *
+ * Description:
+ *     Enables the DWT cycle counter (CYCCNT) of the Cortex-M4 core.
+ *
+ *     CYCCNT counts core clock cycles and wraps every 2^32 cycles (about 43 s at 100 MHz), so
+ *     intervals must be computed with unsigned subtraction. It is used for benchmarking the
+ *     control loop.
+ */
+
+#include "stm32f4xx.h"
+
+#include "dwt.h"
+
+void dwt_init(void)
+{
+        // Enable the trace and debug blocks (DWT is part of them).
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+
+        // Reset and start the cycle counter.
+        DWT->CYCCNT = 0UL;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t dwt_get_cycles(void)
+{
+        return DWT->CYCCNT;
+}
@@ -0,0 +1,255 @@
+/*
+ * fra.c
+ *
+ * Description:
+ *     On-target frequency-response analyzer of the control loop.
+ *
+ *     A sine perturbation d[k] = A*sin(w*k) is added to the controller output or to the reference
+ *     at FRA_POINTS frequencies of a logarithmic sweep. At each frequency the loop first settles
+ *     for whole periods lasting at least FRA_SETTLE_STEPS, then the input and output signals are
+ *     correlated with the perturbation (single-bin DFT) over whole periods lasting at least
+ *     FRA_MEASURE_STEPS:
+ *     - Output injection: open-loop response L = -Uc/U, where Uc is the controller output and U
+ *       the plant input (controller output + perturbation).
+ *     - Reference injection: closed-loop response T = Y/D, where Y is the output voltage.
+ *
+ * Notes:
+ *     - Each frequency has an integer period of N model steps (f = 50 kHz / N), so the DFT bins
+ *       are exact and the sine oscillator is restarted at phase 0 every period.
+ *     - The sine is generated by rotating a phasor, so fra_update() costs a constant handful of
+ *       multiply-adds per step. Gain and phase are computed once per frequency point.
+ *     - Finished points are stored as records and printed from the output print task as
+ *       "fra,<point>,<frequency Hz>,<gain dB>,<phase deg>", so the control loop never prints.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "fra.h"
+
+#include "converter.h"
+#include "terminal.h"
+#include "utils.h"
+
+#define FRA_POINTS          12
+#define FRA_PERIOD_MAX      1000U // Period of the lowest frequency in model steps (50 Hz)
+#define FRA_PERIOD_MIN      10U   // Period of the highest frequency in model steps (5 kHz)
+#define FRA_SETTLE_STEPS    1000U // Minimum settling time of each point in model steps
+#define FRA_MEASURE_STEPS   1000U // Minimum correlation time of each point in model steps
+
+struct fra_record
+{
+        float frequency;
+        float gain_db;
+        float phase_deg;
+};
+
+static const char *const fra_injections[] = {"controller output (open loop)",
+                                             "reference (closed loop)"};
+
+static volatile bool fra_running = false;
+static fra_injection_t fra_injection;
+static float fra_amplitude;
+
+// Sweep state
+static uint8_t fra_point;
+static uint32_t fra_period;     // Period of the current point in model steps
+static uint32_t fra_step;       // Step inside the current period
+static uint32_t fra_period_num; // Periods done at the current point
+static uint32_t fra_settle_num; // Settling periods of the current point
+static uint32_t fra_total_num;  // Settling + correlation periods of the current point
+static float fra_cos_w;         // Phasor rotation of one step
+static float fra_sin_w;
+static float fra_cos;           // Phasor at the current step
+static float fra_sin;
+
+// Single-bin DFT accumulators of the input (a) and output (b) signals
+static float fra_a_re;
+static float fra_a_im;
+static float fra_b_re;
+static float fra_b_im;
+
+static struct fra_record fra_records[FRA_POINTS];
+static volatile uint8_t fra_records_num = 0U;
+static uint8_t fra_records_printed      = 0U;
+
+static void fra_start_point(uint8_t point);
+static void fra_finish_point(void);
+
+void fra_start(fra_injection_t injection, float amplitude)
+{
+        fra_running         = false;
+        fra_injection       = injection;
+        fra_amplitude       = amplitude;
+        fra_records_num     = 0U;
+        fra_records_printed = 0U;
+
+        fra_start_point(0U);
+        fra_running = true;
+}
+
+void fra_stop(void)
+{
+        fra_running = false;
+}
+
+bool fra_is_running(void)
+{
+        return fra_running;
+}
+
+fra_injection_t fra_get_injection(void)
+{
+        return fra_injection;
+}
+
+// Perturbation to be added at the injection point in this step (0 when the sweep is not running).
+float fra_get_perturbation(void)
+{
+        return fra_running ? fra_amplitude * fra_sin : 0.0f;
+}
+
+/*
+ * Correlate the signals of this step with the perturbation and advance the oscillator. It must be
+ * called once per control step after fra_get_perturbation().
+ */
+void fra_update(float controller_output, float plant_input, float measurement)
+{
+        if (!fra_running)
+        {
+                return;
+        }
+
+        if (fra_period_num >= fra_settle_num)
+        {
+                float a, b;
+
+                if (fra_injection == FRA_INJECT_OUTPUT)
+                {
+                        a = plant_input;
+                        b = -controller_output;
+                }
+                else
+                {
+                        a = fra_amplitude * fra_sin;
+                        b = measurement;
+                }
+
+                // X = sum x[k] * e^(-j*w*k)
+                fra_a_re += a * fra_cos;
+                fra_a_im -= a * fra_sin;
+                fra_b_re += b * fra_cos;
+                fra_b_im -= b * fra_sin;
+        }
+
+        fra_step++;
+        if (fra_step < fra_period)
+        {
+                float c = fra_cos * fra_cos_w - fra_sin * fra_sin_w;
+                fra_sin = fra_sin * fra_cos_w + fra_cos * fra_sin_w;
+                fra_cos = c;
+                return;
+        }
+
+        // Restart the oscillator at phase 0 on every period boundary to stop amplitude drift.
+        fra_step = 0U;
+        fra_cos  = 1.0f;
+        fra_sin  = 0.0f;
+        fra_period_num++;
+
+        if (fra_period_num == fra_total_num)
+        {
+                fra_finish_point();
+        }
+}
+
+// Print the records finished since the last call. Called from the output print task.
+void fra_print_records(void)
+{
+        uint8_t records_num = fra_records_num;
+
+        while (fra_records_printed < records_num)
+        {
+                const struct fra_record *rec = &fra_records[fra_records_printed];
+
+                printf("fra,%u,%.2f,%.3f,%.2f",
+                       fra_records_printed,
+                       rec->frequency,
+                       rec->gain_db,
+                       rec->phase_deg);
+                terminal_insert_new_line();
+                fra_records_printed++;
+
+                if (fra_records_printed == FRA_POINTS)
+                {
+                        printf("fra,done");
+                        terminal_insert_new_line();
+                }
+        }
+}
+
+void fra_print_status(void)
+{
+        if (fra_running)
+        {
+                printf("  Sweep running at %s: point %u of %u, %.2f Hz",
+                       fra_injections[fra_injection],
+                       fra_point + 1U,
+                       FRA_POINTS,
+                       SAMPLING_FREQUENCY / fra_period);
+        }
+        else
+        {
+                printf("  No sweep running, %u of %u points measured.", fra_records_num,
+                       FRA_POINTS);
+        }
+        terminal_insert_new_line();
+}
+
+static void fra_start_point(uint8_t point)
+{
+        // Logarithmic sweep of the period from FRA_PERIOD_MAX down to FRA_PERIOD_MIN.
+        float ratio = (float)FRA_PERIOD_MIN / (float)FRA_PERIOD_MAX;
+        float t     = (float)point / (float)(FRA_POINTS - 1);
+        float w;
+
+        fra_point      = point;
+        fra_period     = (uint32_t)(FRA_PERIOD_MAX * powf(ratio, t) + 0.5f);
+        w              = 2.0f * PI / (float)fra_period;
+        fra_cos_w      = cosf(w);
+        fra_sin_w      = sinf(w);
+        fra_cos        = 1.0f;
+        fra_sin        = 0.0f;
+        fra_step       = 0U;
+        fra_period_num = 0U;
+        fra_settle_num = (FRA_SETTLE_STEPS + fra_period - 1U) / fra_period;
+        fra_total_num  = fra_settle_num + (FRA_MEASURE_STEPS + fra_period - 1U) / fra_period;
+        fra_a_re       = 0.0f;
+        fra_a_im       = 0.0f;
+        fra_b_re       = 0.0f;
+        fra_b_im       = 0.0f;
+}
+
+static void fra_finish_point(void)
+{
+        // H = B / A
+        float a_mag2 = fra_a_re * fra_a_re + fra_a_im * fra_a_im;
+        float h_re   = (fra_b_re * fra_a_re + fra_b_im * fra_a_im) / a_mag2;
+        float h_im   = (fra_b_im * fra_a_re - fra_b_re * fra_a_im) / a_mag2;
+
+        struct fra_record *rec = &fra_records[fra_point];
+        rec->frequency         = SAMPLING_FREQUENCY / fra_period;
+        rec->gain_db           = 10.0f * log10f(h_re * h_re + h_im * h_im);
+        rec->phase_deg         = atan2f(h_im, h_re) * (180.0f / PI);
+        fra_records_num        = fra_point + 1U;
+
+        if (fra_point + 1U < FRA_POINTS)
+        {
+                fra_start_point(fra_point + 1U);
+        }
+        else
+        {
+                fra_running = false;
+        }
+}
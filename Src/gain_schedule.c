@@ -0,0 +1,228 @@
+/*
+ * gain_schedule.c
+ *
+ * Description:
+ *     Gain-scheduling table for the PID controller.
+ *
+ *     The table holds up to GS_POINTS_MAX breakpoints (x, kp, ki, kd) sorted by x, where x is the
+ *     reference or the measured output voltage. Every control step the gains are linearly
+ *     interpolated between the two breakpoints around the current operating point, and held
+ *     constant outside the table range.
+ *
+ * Notes:
+ *     - Uniformly spaced breakpoints are detected when a table is applied and are looked up in
+ *       O(1) by direct indexing. Non-uniform tables use a binary search.
+ *     - The CLI edits a staging copy. gs_apply() validates it, copies it into the table that is
+ *       not in use and then switches the active table index with one atomic store, so the control
+ *       loop always reads a complete table.
+ */
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "gain_schedule.h"
+
+#include "terminal.h"
+#include "utils.h"
+
+#define GS_UNIFORM_TOLERANCE 1e-4f // Relative spacing tolerance of a uniform table
+
+struct gs_table
+{
+        uint8_t points_num;
+        bool uniform;
+        float inv_dx; // 1 / breakpoint spacing (uniform tables only)
+        struct gs_point points[GS_POINTS_MAX];
+};
+
+static const char *const gs_sources[] = {"ref", "y"};
+
+static struct gs_table gs_tables[2];
+static _Atomic uint8_t gs_active = 0U; // Index of the table read by the control loop
+static struct gs_table gs_staging;
+static bool gs_staging_is_dirty = false; // Staging table differs from the active table
+static bool gs_enabled          = false;
+static gs_source_t gs_source    = GS_SOURCE_REFERENCE;
+
+bool gs_is_enabled(void)
+{
+        return gs_enabled;
+}
+
+// Enable or disable scheduling. Returns false if enabling is requested while the table is empty.
+bool gs_enable(bool enable)
+{
+        if (enable && gs_tables[atomic_load(&gs_active)].points_num == 0U)
+        {
+                return false;
+        }
+
+        gs_enabled = enable;
+        return true;
+}
+
+gs_source_t gs_get_source(void)
+{
+        return gs_source;
+}
+
+void gs_set_source(gs_source_t source)
+{
+        gs_source = source;
+}
+
+// Interpolate the gains of the active table at operating point x.
+void gs_lookup(float x, float *kp, float *ki, float *kd)
+{
+        const struct gs_table *table = &gs_tables[atomic_load(&gs_active)];
+        const struct gs_point *p     = table->points;
+        uint8_t last                 = table->points_num - 1U;
+
+        if (last == 0U || x <= p[0].x)
+        {
+                *kp = p[0].kp;
+                *ki = p[0].ki;
+                *kd = p[0].kd;
+                return;
+        }
+        if (x >= p[last].x)
+        {
+                *kp = p[last].kp;
+                *ki = p[last].ki;
+                *kd = p[last].kd;
+                return;
+        }
+
+        // Find i such that p[i].x <= x < p[i + 1].x.
+        uint8_t i;
+        if (table->uniform)
+        {
+                i = (uint8_t)((x - p[0].x) * table->inv_dx);
+                if (i >= last)
+                {
+                        i = last - 1U;
+                }
+        }
+        else
+        {
+                uint8_t lo = 0U;
+                uint8_t hi = last;
+                while (hi - lo > 1)
+                {
+                        uint8_t mid = (uint8_t)((lo + hi) / 2U);
+                        if (p[mid].x <= x)
+                        {
+                                lo = mid;
+                        }
+                        else
+                        {
+                                hi = mid;
+                        }
+                }
+                i = lo;
+        }
+
+        float t = (x - p[i].x) / (p[i + 1U].x - p[i].x);
+
+        *kp = p[i].kp + t * (p[i + 1U].kp - p[i].kp);
+        *ki = p[i].ki + t * (p[i + 1U].ki - p[i].ki);
+        *kd = p[i].kd + t * (p[i + 1U].kd - p[i].kd);
+}
+
+/*
+ * Write a breakpoint into the staging table. A point can overwrite an existing one or be appended
+ * right after the last one. Returns false if the index leaves a gap or is out of range.
+ */
+bool gs_stage_point(uint8_t index, struct gs_point point)
+{
+        if (index >= GS_POINTS_MAX || index > gs_staging.points_num)
+        {
+                return false;
+        }
+
+        gs_staging.points[index] = point;
+        if (index == gs_staging.points_num)
+        {
+                gs_staging.points_num++;
+        }
+        gs_staging_is_dirty = true;
+
+        return true;
+}
+
+void gs_stage_clear(void)
+{
+        gs_staging.points_num = 0U;
+        gs_staging_is_dirty   = true;
+}
+
+/*
+ * Validate the staging table and make it the active table.
+ * Returns 0 on success, -1 if the table is empty and -2 if breakpoints are not strictly increasing.
+ */
+int gs_apply(void)
+{
+        const struct gs_point *p = gs_staging.points;
+        uint8_t n                = gs_staging.points_num;
+
+        if (n == 0U)
+        {
+                return -1;
+        }
+
+        gs_staging.uniform = true;
+        for (uint8_t i = 1U; i < n; i++)
+        {
+                if (p[i].x <= p[i - 1U].x)
+                {
+                        return -2;
+                }
+
+                float dx0 = p[1].x - p[0].x;
+                float dx  = p[i].x - p[i - 1U].x;
+                if (ABS_FLOAT(dx - dx0) > GS_UNIFORM_TOLERANCE * dx0)
+                {
+                        gs_staging.uniform = false;
+                }
+        }
+        gs_staging.inv_dx = (n > 1U) ? 1.0f / (p[1].x - p[0].x) : 0.0f;
+
+        // Fill the table that is not in use, then publish it with a single atomic store.
+        uint8_t next    = (uint8_t)(atomic_load(&gs_active) ^ 1U);
+        gs_tables[next] = gs_staging;
+        atomic_store(&gs_active, next);
+        gs_staging_is_dirty = false;
+
+        return 0;
+}
+
+void gs_dump(void)
+{
+        const struct gs_table *table = &gs_tables[atomic_load(&gs_active)];
+
+        printf("  Gain schedule (%s, source %s, %u points, %s lookup)",
+               gs_enabled ? "on" : "off",
+               gs_sources[gs_source],
+               table->points_num,
+               table->uniform ? "uniform" : "binary search");
+        terminal_insert_new_line();
+
+        for (uint8_t i = 0U; i < table->points_num; i++)
+        {
+                printf("  %u: x = %8.3f  kp = %-11.6f ki = %-11.6f kd = %.6f",
+                       i,
+                       table->points[i].x,
+                       table->points[i].kp,
+                       table->points[i].ki,
+                       table->points[i].kd);
+                terminal_insert_new_line();
+        }
+
+        if (gs_staging_is_dirty)
+        {
+                printf("  The staging table (%u points) is waiting for \"gs apply\".",
+                       gs_staging.points_num);
+                terminal_insert_new_line();
+        }
+}
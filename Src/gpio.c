@@ -157,8 +157,8 @@ bool gpio_read_pin_input(gpio_port_t port, gpio_pin_t pin)
 }
 
 /*
- * This function handles push-button bounce. It is called by tim3_read_button function in timer.c
- * which in turn is called every 20 ms by TIM3 interrupt.
+ * This function handles push-button bounce. It is called every 20 ms by the button polling timer
+ * in timer.c.
  */
 bool gpio_button_is_pressed(void)
 {
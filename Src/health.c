@@ -0,0 +1,210 @@
+/*
+ * health.c
+ *
+ * Description:
+ *     Numerical health monitor of the control loop.
+ *
+ *     Unstable gains or a bad model can drive the plant and controller states to inf or NaN. Two
+ *     cheap checks catch this once per control step:
+ *     - The cumulative exception flags of the FPU (invalid operation, division by zero and
+ *       overflow in FPSCR), which are set by any instruction of the step and stay set, so one
+ *       register read covers every value computed in the step.
+ *     - A magnitude limit on the plant state, input and output. The comparison is false for NaN,
+ *       so a NaN that only propagates (without raising a flag) is caught here. The state is
+ *       checked as well because it can diverge while the output (one weighted sum of it) stays
+ *       small.
+ *
+ *     On a fault the configured action is taken and the event is logged with its time stamp.
+ *
+ * Notes:
+ *     - health_clear_flags() is called at the start of the control task, before the catch-up of
+ *       missed releases, and health_check() at the end of every loop step. health_check() clears
+ *       the flags after reading them, so each step is watched on its own and the first step of a
+ *       task also covers the catch-up before it (a plant fast-forward raises its flags there). A
+ *       healthy step costs one FPSCR read, one FPSCR write and two comparisons plus one per
+ *       state.
+ *     - The actions:
+ *         clamp  - Saturate the plant state, input and output to the limit (NaN becomes 0) and
+ *                  clear the controller states, which cannot be inspected from here.
+ *         reset  - Zero the plant state, input and output and clear the controller states.
+ *         config - Go to config mode, which stops the loop and clears all states.
+ *     - Events are printed by the SysTick print task, so the control loop never prints.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "stm32f4xx.h"
+
+#include "health.h"
+
+#include "controller.h"
+#include "converter.h"
+#include "terminal.h"
+#include "timebase.h"
+
+#define HEALTH_FPSCR_IOC     (1UL << 0U) // Invalid operation
+#define HEALTH_FPSCR_DZC     (1UL << 1U) // Division by zero
+#define HEALTH_FPSCR_OFC     (1UL << 2U) // Overflow
+#define HEALTH_FPSCR_FLAGS   0x9FUL      // All cumulative exception flags (IOC to IXC and IDC)
+#define HEALTH_FPSCR_FAULTS  (HEALTH_FPSCR_IOC | HEALTH_FPSCR_DZC | HEALTH_FPSCR_OFC)
+#define HEALTH_MAGNITUDE     (1UL << 8U) // Cause bit of an out-of-range plant value
+#define HEALTH_VOLTAGE_LIMIT 1000.0f     // Largest plant state, input and output accepted
+#define HEALTH_LOG_LEN       8U
+
+struct health_event
+{
+        uint64_t time_us;
+        uint32_t causes; // FPSCR fault flags and HEALTH_MAGNITUDE
+        float input;
+        float output;
+        health_action_t action;
+};
+
+const char *const health_actions[HEALTH_ACTIONS_NUM] = {"clamp", "reset", "config"};
+
+static health_action_t health_action = HEALTH_ACTION_RESET;
+static struct health_event health_log[HEALTH_LOG_LEN];
+static uint32_t health_events_num = 0U; // Events since the log was cleared
+static uint32_t health_printed    = 0U; // Events already printed by health_print_events()
+
+static void health_fault(uint32_t causes);
+static float health_clamp(float value);
+static void health_print_event(const struct health_event *event);
+
+void health_clear_flags(void)
+{
+        __set_FPSCR(__get_FPSCR() & ~HEALTH_FPSCR_FLAGS);
+}
+
+void health_check(void)
+{
+        uint32_t causes = __get_FPSCR() & HEALTH_FPSCR_FAULTS;
+        bool in_range   = fabsf(u[0][0]) <= HEALTH_VOLTAGE_LIMIT &&
+                        fabsf(y[0][0]) <= HEALTH_VOLTAGE_LIMIT &&
+                        converter_state_in_range(HEALTH_VOLTAGE_LIMIT);
+
+        // The next step is watched on its own.
+        health_clear_flags();
+
+        if (causes == 0U && in_range)
+        {
+                return;
+        }
+
+        if (!in_range)
+        {
+                causes |= HEALTH_MAGNITUDE;
+        }
+
+        health_fault(causes);
+}
+
+health_action_t health_get_action(void)
+{
+        return health_action;
+}
+
+void health_set_action(health_action_t action)
+{
+        health_action = action;
+}
+
+void health_clear_log(void)
+{
+        health_events_num = 0U;
+        health_printed    = 0U;
+}
+
+void health_print(void)
+{
+        printf("  Numerical health (limit %.0f V, action on fault: %s)",
+               HEALTH_VOLTAGE_LIMIT,
+               health_actions[health_action]);
+        terminal_insert_new_line();
+        printf("  faults: %lu", (unsigned long)health_events_num);
+        terminal_insert_new_line();
+
+        // The log keeps the last HEALTH_LOG_LEN events.
+        uint32_t first = (health_events_num > HEALTH_LOG_LEN) ? health_events_num - HEALTH_LOG_LEN
+                                                              : 0U;
+        for (uint32_t i = first; i < health_events_num; i++)
+        {
+                health_print_event(&health_log[i % HEALTH_LOG_LEN]);
+        }
+}
+
+// Print the events logged since the last call (called from the SysTick print task).
+void health_print_events(void)
+{
+        if (health_events_num - health_printed > HEALTH_LOG_LEN)
+        {
+                health_printed = health_events_num - HEALTH_LOG_LEN;
+        }
+
+        while (health_printed != health_events_num)
+        {
+                health_print_event(&health_log[health_printed % HEALTH_LOG_LEN]);
+                health_printed++;
+        }
+}
+
+static void health_fault(uint32_t causes)
+{
+        struct health_event *event = &health_log[health_events_num % HEALTH_LOG_LEN];
+
+        event->time_us = time_now_us();
+        event->causes  = causes;
+        event->input   = u[0][0];
+        event->output  = y[0][0];
+        event->action  = health_action;
+        health_events_num++;
+
+        switch (health_action)
+        {
+        case HEALTH_ACTION_CLAMP:
+                converter_clamp_state(HEALTH_VOLTAGE_LIMIT);
+                controller_reset();
+                u[0][0] = health_clamp(u[0][0]);
+                y[0][0] = health_clamp(y[0][0]);
+                break;
+        case HEALTH_ACTION_CONFIG:
+                converter_set_mode(CONFIG);
+                break;
+        case HEALTH_ACTION_RESET:
+        default:
+                converter_reset_state();
+                controller_reset();
+                u[0][0] = 0.0f;
+                y[0][0] = 0.0f;
+                break;
+        }
+
+        health_clear_flags();
+}
+
+static float health_clamp(float value)
+{
+        if (isnan(value))
+        {
+                return 0.0f;
+        }
+
+        return fminf(fmaxf(value, -HEALTH_VOLTAGE_LIMIT), HEALTH_VOLTAGE_LIMIT);
+}
+
+static void health_print_event(const struct health_event *event)
+{
+        printf("  health: %lu.%06lu s, fault: %s%s%s%s(u = %g V, y = %g V) -> %s",
+               (unsigned long)(event->time_us / 1000000ULL),
+               (unsigned long)(event->time_us % 1000000ULL),
+               (event->causes & HEALTH_FPSCR_IOC) ? "invalid " : "",
+               (event->causes & HEALTH_FPSCR_DZC) ? "div-by-zero " : "",
+               (event->causes & HEALTH_FPSCR_OFC) ? "overflow " : "",
+               (event->causes & HEALTH_MAGNITUDE) ? "out-of-range " : "",
+               event->input,
+               event->output,
+               health_actions[event->action]);
+        terminal_insert_new_line();
+}
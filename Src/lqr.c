@@ -0,0 +1,72 @@
+/*
+ * lqr.c
+ *
+ * Description:
+ *     Discrete LQR state-feedback controller with integral action.
+ *
+ *     Implements:
+ *         x_hat    = observer estimate of x[k] from u and y
+ *         xi[k+1]  = xi[k] + (r[k] - y[k])
+ *         u[k]     = -K*(x_hat - Nx*r[k]) - Ki*xi[k] + Nu*r[k]
+ *
+ * Notes:
+ *     - K and Ki come from the discrete algebraic Riccati equation of the plant augmented with the
+ *       integrator. Nx and Nu are the steady-state feedforward gains for a unit reference. All of
+ *       them are computed on the host by Tools/lqr_design.py and compiled in as constant tables.
+ *     - The plant state is never read directly, the observer runs from u and y only.
+ *     - lqr_update() only corrects the observer. The caller propagates it with the input that
+ *       really reaches the plant (controller_apply_input()), which differs from the controller
+ *       output while a frequency-response sweep perturbs it.
+ *     - The output is limited to the same range as the PID controller output and the integrator
+ *       is frozen while the output is saturated (conditional integration anti-windup).
+ */
+
+#include <stddef.h>
+
+#include "lqr.h"
+
+#include "controller.h"
+#include "converter.h"
+#include "observer.h"
+#include "utils.h"
+
+// clang-format off
+// Generated by Tools/lqr_design.py (closed-loop spectral radius 0.9322).
+static const float lqr_K[STATES_NUM]  = { 10.457619f,  1.276647f, -0.477008f,  0.530440f,
+                                          -0.691342f,  2.578676f};
+static const float lqr_Ki             = -0.289912f;
+static const float lqr_Nx[STATES_NUM] = {-0.023518f,  1.029178f,  0.258800f,  0.794659f,
+                                         -0.068865f,  1.000000f};
+static const float lqr_Nu             = 0.965507f;
+// clang-format on
+
+static float lqr_integral = 0.0f; // Integral of the tracking error
+
+void lqr_reset(void)
+{
+        lqr_integral = 0.0f;
+        observer_reset();
+}
+
+float lqr_update(float reference, float measurement)
+{
+        const float *x_hat = observer_correct(measurement);
+
+        float output = lqr_Nu * reference - lqr_Ki * lqr_integral;
+
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                output -= lqr_K[i] * (x_hat[i] - lqr_Nx[i] * reference);
+        }
+
+        float out_min = controller_get_out_min();
+        float out_max = controller_get_out_max();
+
+        // Integrate only while the output is not saturated to avoid windup.
+        if (output > out_min && output < out_max)
+        {
+                lqr_integral += (reference - measurement);
+        }
+
+        return CLAMP(output, out_min, out_max);
+}
@@ -1,35 +1,63 @@
 #include <stddef.h>
 #include <stdio.h>
 
+#include "boot.h"
 #include "cli.h"
 #include "clock.h"
 #include "controller.h"
 #include "converter.h"
+#include "dwt.h"
 #include "fpu.h"
 #include "gpio.h"
 #include "iwdg.h"
+#include "model.h"
+#include "pr.h"
 #include "pwm.h"
+#include "restart.h"
 #include "scheduler.h"
+#include "supervisor.h"
 #include "systick.h"
+#include "terminal.h"
+#include "timebase.h"
 #include "timer.h"
 #include "uart.h"
 
 int main(void)
 {
         /* ---------- Start of initialization phase ---------- */
-        // Initialize peripherals and utilities.
+        /*
+         * Enable the FPU before anything else. With the hard-float ABI the compiler may emit FPU
+         * instructions in any function, and one executed with the FPU off is a UsageFault (NOCP).
+         */
         fpu_enable();
+
+        // Start the cycle counter next, it timestamps the init stages (boot command).
+        dwt_init();
+        boot_mark(BOOT_STAGE_START);
+
+        // Read the reset cause first, it decides between a cold and a warm start-up.
+        restart_init();
+
+        // The event queues must be ready before the first interrupt can post to them.
+        scheduler_init();
+
+        // Initialize peripherals and utilities.
         clock_init();
+        boot_mark(BOOT_STAGE_CLOCK);
+
+        timebase_init();
         systick_init();
         tim2_init(TIM2_FREQUENCY);
         pwm_tim2_init();
-        tim3_init(TIM3_FREQUENCY);
+        boot_mark(BOOT_STAGE_TIMERS);
+
         gpio_init();
+        timer_button_init();
         uart2_init();
-        scheduler_init();
+        boot_mark(BOOT_STAGE_IO);
 
-        // Initialize the plant (converter).
-        converter_init();
+        // Initialize the plant (converter). A rejected built-in model is reported below.
+        model_status_t model_status = converter_init();
 
         // Initialize the PID controller (Coefficients are set to 0 and should be set by the user).
         pid_init(0.0f,        // kp
@@ -41,14 +69,46 @@ int main(void)
                  -60.000000f, // controller_out_min (controller output minimum value)
                  60.000000f); // controller_out_max (controller output maximum value)
 
+        // Compute the resonator coefficients of the PR controller (resonant gain kr starts at 0).
+        pr_init();
+        boot_mark(BOOT_STAGE_PLANT);
+
         // Disable buffering for stdout so that printf outputs immediately.
         setbuf(stdout, NULL);
 
-        // Initialize the CLI.
-        cli_init();
+        // Without a plant model the start-up goes on, but mod mode is refused until one is loaded.
+        model_print_builtin_errors();
+        if (model_status != MODEL_OK)
+        {
+                printf("  No plant model to run. Load one with \"model load\" to use mod mode.");
+                terminal_insert_new_line();
+        }
+
+        /*
+         * Initialize the CLI. After a watchdog reset with a saved operating point the startup menu
+         * is skipped and the converter resumes where it was. With fast start the menu is sent
+         * later by the print task.
+         */
+        if (restart_is_warm())
+        {
+                restart_resume();
+        }
+        else if (BOOT_FAST_START)
+        {
+                boot_defer_menu();
+        }
+        else
+        {
+                cli_init();
+        }
+        boot_mark(BOOT_STAGE_CLI);
 
         // Initialize the independent watchdog.
         iwdg_init();
+
+        // Start the task supervision, which refreshes the watchdogs while all tasks check in.
+        supervisor_init();
+        boot_mark(BOOT_STAGE_WATCHDOG);
         /* ---------- End of initialization phase ---------- */
 
         // Background loop. Run the prioritized cooperative scheduler.
@@ -0,0 +1,187 @@
+/*
+ * metrics.c
+ *
+ * Description:
+ *     Online control-performance metrics of the control loop.
+ *
+ *     Every control step metrics_update() does a constant amount of work to accumulate, since the
+ *     last change of the reference set by the user:
+ *     - IAE, ISE and ITAE of the tracking error (in model time, h = 20 us)
+ *     - Peak overshoot in percent of the step size
+ *     - 10 % to 90 % rise time and settling time to a configurable band
+ *     - Time spent with the controller output saturated
+ *
+ * Notes:
+ *     - The setpoint is the value set with the "ref" command. In inverter type the error is taken
+ *       against the instantaneous sinusoidal reference and the overshoot is the peak output
+ *       above the amplitude. Rise and settling times are left out there: the instantaneous sine
+ *       never stays within a band of its amplitude, and the per-period amplitude is reported by
+ *       the "pq" command instead.
+ *     - metrics_reset() makes the next update start a new record, as if the reference changed.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "metrics.h"
+
+#include "controller.h"
+#include "converter.h"
+#include "terminal.h"
+#include "utils.h"
+
+#define METRICS_DEFAULT_BAND 2.0f // Settling band in percent of the step size
+
+static struct metrics metrics;
+static bool metrics_is_started = false;
+static bool metrics_is_step    = true; // Rise and settling apply (DC-DC type)
+static float metrics_band      = METRICS_DEFAULT_BAND;
+static float metrics_setpoint;   // Setpoint of the current record
+static float metrics_start;      // Output at the start of the record
+static float metrics_step;       // |setpoint - start|, at least a small value
+static float metrics_direction;  // +1 for a rising step, -1 for a falling step
+static bool metrics_passed_10;   // The output has passed 10 % of the step
+static uint32_t metrics_rise_10; // Step where the output passed 10 % of the step
+
+static void metrics_start_record(float setpoint, float measurement);
+
+void metrics_reset(void)
+{
+        metrics_is_started = false;
+}
+
+void metrics_update(float setpoint, float reference, float measurement, float input)
+{
+        if (!metrics_is_started || setpoint != metrics_setpoint)
+        {
+                metrics_start_record(setpoint, measurement);
+        }
+
+        const float Ts = 1.0f / SAMPLING_FREQUENCY;
+        float error    = reference - measurement;
+        float abs_err  = ABS_FLOAT(error);
+        float t        = metrics.steps * Ts;
+
+        metrics.steps++;
+        metrics.iae += abs_err * Ts;
+        metrics.ise += error * error * Ts;
+        metrics.itae += t * abs_err * Ts;
+
+        // Progress of the output along the step direction, as a fraction of the step size.
+        float progress = (measurement - metrics_start) * metrics_direction / metrics_step;
+
+        if (progress > 1.0f && 100.0f * (progress - 1.0f) > metrics.overshoot)
+        {
+                metrics.overshoot = 100.0f * (progress - 1.0f);
+        }
+        if (metrics_is_step)
+        {
+                // Both can be passed in the same step, then the rise time is 0 steps.
+                if (!metrics_passed_10 && progress >= 0.1f)
+                {
+                        metrics_passed_10 = true;
+                        metrics_rise_10   = metrics.steps;
+                }
+                if (!metrics.risen && progress >= 0.9f)
+                {
+                        metrics.risen      = true;
+                        metrics.rise_steps = metrics.steps - metrics_rise_10;
+                }
+
+                // settling_steps ends up one past the last step outside the band.
+                float deviation = measurement - metrics_setpoint;
+                if (ABS_FLOAT(deviation) > 0.01f * metrics_band * metrics_step)
+                {
+                        metrics.settling_steps = metrics.steps;
+                }
+        }
+
+        if (input <= controller_get_out_min() || input >= controller_get_out_max())
+        {
+                metrics.saturated_steps++;
+        }
+}
+
+struct metrics metrics_get(void)
+{
+        return metrics;
+}
+
+float metrics_get_band(void)
+{
+        return metrics_band;
+}
+
+void metrics_set_band(float band_percent)
+{
+        metrics_band = band_percent;
+}
+
+void metrics_print(void)
+{
+        const float ms_per_step = 1000.0f / SAMPLING_FREQUENCY;
+
+        printf("  Control Performance (since last reference change)");
+        terminal_insert_new_line();
+        printf("  steps         : %lu (%.3f ms)",
+               (unsigned long)metrics.steps,
+               metrics.steps * ms_per_step);
+        terminal_insert_new_line();
+        printf("  IAE           : %-11.6f V*s", metrics.iae);
+        terminal_insert_new_line();
+        printf("  ISE           : %-11.6f V^2*s", metrics.ise);
+        terminal_insert_new_line();
+        printf("  ITAE          : %-11.6f V*s^2", metrics.itae);
+        terminal_insert_new_line();
+        printf("  overshoot     : %.2f %%", metrics.overshoot);
+        terminal_insert_new_line();
+        if (!metrics_is_step)
+        {
+                printf("  rise time     : - (DC-DC type only)");
+        }
+        else if (metrics.risen)
+        {
+                printf("  rise time     : %.3f ms", metrics.rise_steps * ms_per_step);
+        }
+        else
+        {
+                printf("  rise time     : -");
+        }
+        terminal_insert_new_line();
+        if (!metrics_is_step)
+        {
+                printf("  settling time : - (DC-DC type only, see \"pq\" for the amplitude)");
+        }
+        else if (metrics.settling_steps < metrics.steps)
+        {
+                printf("  settling time : %.3f ms (%.1f %% band)",
+                       metrics.settling_steps * ms_per_step,
+                       metrics_band);
+        }
+        else
+        {
+                printf("  settling time : - (%.1f %% band)", metrics_band);
+        }
+        terminal_insert_new_line();
+        printf("  saturated     : %.3f ms", metrics.saturated_steps * ms_per_step);
+        terminal_insert_new_line();
+}
+
+static void metrics_start_record(float setpoint, float measurement)
+{
+        metrics            = (struct metrics){0};
+        metrics_is_started = true;
+        metrics_is_step    = converter_get_type() == DC_DC_IDEAL;
+        metrics_passed_10  = false;
+        metrics_rise_10    = 0U;
+        metrics_setpoint   = setpoint;
+        metrics_start      = measurement;
+        metrics_direction  = (setpoint >= measurement) ? 1.0f : -1.0f;
+        metrics_step       = ABS_FLOAT(setpoint - measurement);
+
+        // Avoid dividing by zero when the reference is changed to the current output.
+        if (metrics_step < 1e-3f)
+        {
+                metrics_step = 1e-3f;
+        }
+}
@@ -0,0 +1,136 @@
+/*
+ * modal.c
+ *
+ * Description:
+ *     Real modal (block-diagonal) realization of the converter model.
+ *
+ *     In the modal coordinates of Tools/modal_model.py the continuous model splits into
+ *     independent blocks, one per real pole sigma (1x1) or complex pair sigma +- j*omega (2x2):
+ *
+ *         [ sigma  omega]
+ *         [-omega  sigma]
+ *
+ *     modal_discretize() discretizes every block in closed form for the step h (zero-order hold):
+ *
+ *         Ad = e^(sigma*h) * [cos(omega*h) sin(omega*h); -sin(omega*h) cos(omega*h)]
+ *         Bd = M^-1 * (Ad - I) * Bc, with M the continuous block
+ *
+ *     and then rescales the coordinates of each block so that its input vector becomes [1; 0]
+ *     (or 1). A 2x2 block then costs 4 multiply-adds and one add per step instead of a dense row
+ *     of the full matrix.
+ *
+ * Notes:
+ *     - The rescaling matrix of a 2x2 block has the same [p q; -q p] form as the block, so the
+ *       block is unchanged and only C absorbs the inverse scaling.
+ *     - The output is the same as the dense realization up to float rounding: for a +-40 V square
+ *       wave the difference stays below 1e-5 of the peak output ("bench" measures it on target).
+ *     - Per step the three 2x2 blocks cost 12 multiply-adds for A (36 in the dense Ad) and 3 adds
+ *       for B (6 multiply-adds), plus 6 multiply-adds for C (a single copy in the dense form).
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "modal.h"
+
+#include "converter.h"
+#include "utils.h"
+
+struct modal_block
+{
+        uint8_t size; // 1 for a real pole, 2 for a complex pair
+        float sigma;  // Real part of the pole (rad/s)
+        float omega;  // Imaginary part of the pole (rad/s)
+};
+
+// clang-format off
+// Modal form of the continuous converter model, generated by Tools/modal_model.py.
+static const struct modal_block modal_blocks[] = {
+        {2, -1.51880993e+02f,  1.08132069e+04f},
+        {2, -6.51840849e+03f,  1.16884010e+05f},
+        {2, -2.11591852e+04f,  4.86534339e+04f},
+};
+static const float modal_Bc[STATES_NUM] = {
+         1.94756777e+03f,  1.94102816e+04f, -6.78240001e+03f,
+        -2.04576477e+04f, -1.03918431e+04f,  2.10643539e+04f,
+};
+static const float modal_Cc[STATES_NUM] = {
+         5.71997419e-01f,  0.00000000e+00f,  1.11652622e-02f,
+        -3.37603836e-01f,  9.09576439e-02f, -2.01212382e-04f,
+};
+// clang-format on
+
+/*
+ * Write the discrete modal model for the step h in model blob order (A, B, C, D of STATES_NUM
+ * states) to values. Returns false if the tables do not describe STATES_NUM states.
+ */
+bool modal_discretize(float h, float *values)
+{
+        const size_t n = STATES_NUM;
+        float *A       = values;
+        float *B       = &values[n * n];
+        float *C       = &values[n * n + n];
+        size_t i       = 0U;
+
+        for (size_t k = 0; k < n * n; k++)
+        {
+                A[k] = 0.0f;
+        }
+
+        for (size_t b = 0; b < ARRAY_LEN(modal_blocks); b++)
+        {
+                const struct modal_block *block = &modal_blocks[b];
+                double sigma                    = block->sigma;
+                double omega                    = block->omega;
+                double decay                    = exp(sigma * h);
+
+                if (i + block->size > n)
+                {
+                        return false;
+                }
+
+                if (block->size == 1U)
+                {
+                        // Bd = (e^(sigma*h) - 1) / sigma * Bc, rescaled to 1.
+                        double gain = (sigma != 0.0) ? (decay - 1.0) / sigma : (double)h;
+                        double bd   = gain * modal_Bc[i];
+
+                        A[i * n + i] = (float)decay;
+                        B[i]         = 1.0f;
+                        C[i]         = (float)(modal_Cc[i] * bd);
+                }
+                else
+                {
+                        double a = decay * cos(omega * h);
+                        double s = decay * sin(omega * h);
+
+                        // M^-1 * (Ad - I) = [g1 g2; -g2 g1]
+                        double norm = sigma * sigma + omega * omega;
+                        double g1   = (sigma * (a - 1.0) + omega * s) / norm;
+                        double g2   = (sigma * s - omega * (a - 1.0)) / norm;
+
+                        // Bd = [p; q]
+                        double p = g1 * modal_Bc[i] + g2 * modal_Bc[i + 1];
+                        double q = -g2 * modal_Bc[i] + g1 * modal_Bc[i + 1];
+
+                        A[i * n + i]           = (float)a;
+                        A[i * n + i + 1]       = (float)s;
+                        A[(i + 1) * n + i]     = (float)-s;
+                        A[(i + 1) * n + i + 1] = (float)a;
+
+                        // z = S * x with S = [p q; -q p] / (p^2 + q^2) maps Bd to [1; 0].
+                        B[i]     = 1.0f;
+                        B[i + 1] = 0.0f;
+                        C[i]     = (float)(modal_Cc[i] * p + modal_Cc[i + 1] * q);
+                        C[i + 1] = (float)(-modal_Cc[i] * q + modal_Cc[i + 1] * p);
+                }
+
+                i += block->size;
+        }
+
+        values[n * n + 2U * n] = converter_Dd[0][0];
+
+        return i == n;
+}
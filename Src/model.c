@@ -0,0 +1,859 @@
+/*
+ * model.c
+ *
+ * Description:
+ *     Runtime-loadable state-space model of the plant.
+ *
+ *     The plant simulated by converter_update() is x[k+1] = A*x[k] + B*u[k], y = C*x + D*u of any
+ *     order up to MODEL_STATES_MAX (single input, single output). At startup the store holds the
+ *     built-in converter matrices from converter.c. A new model is received over UART as a binary
+ *     blob (little-endian):
+ *
+ *         offset 0   : 'S', 'S' (magic), version, n (number of states)
+ *         offset 4   : float A[n][n] (row-major), B[n], C[n], D
+ *         offset end : uint32 CRC-32 (zlib) of all the preceding bytes
+ *
+ *     Version 1 blobs hold a discrete model for the model step 1/SAMPLING_FREQUENCY. Version 2
+ *     blobs hold a continuous model, which is discretized with zero-order hold (c2d.c) when it
+ *     is loaded.
+ *
+ *     A blob is accepted only if the header, the CRC and the order are valid, every value is
+ *     finite and the spectral radius estimate of A is below 1. Tools/model_blob.py builds and
+ *     sends blobs.
+ *
+ * Notes:
+ *     - Two model buffers are kept. A loaded model is written to the inactive one and becomes
+ *       active in model_swap_if_pending(), which converter_update() calls at the start of a step,
+ *       so a step never sees a half-written model. The plant state restarts from zero on a swap.
+ *     - When a model is loaded its update kernels are chosen once: an in-place kernel over 1x1
+ *       and 2x2 blocks if A is block-diagonal (with a cheaper variant when the input enters each
+ *       block with a unit gain), a CSR sparse kernel if at most half of A is nonzero, or else a
+ *       dense kernel compiled for exactly its order; the output is a single copy if C selects
+ *       one state, and D*u is only added when D is nonzero. A small model does not pay for
+ *       MODEL_STATES_MAX.
+ *     - The built-in model is available in two realizations with the same output: dense (Ad, Bd
+ *       from converter.c) and modal (block-diagonal, modal.c), which takes the block kernel.
+ *     - D*u uses the input held over the step (there is no future input to use).
+ *     - If neither built-in realization is accepted at start-up, the firmware still starts
+ *       without a plant model: mod mode is refused (model_is_available()) and the error is shown
+ *       by the "model" and "status" commands until a model is loaded over UART.
+ *     - The spectral radius is estimated as ||A^(2^m)||^(1/2^m) with m = 24 squarings,
+ *       normalizing after each squaring (so nothing overflows) and summing the log of the norms
+ *       in double. The Frobenius norm bounds the spectral radius from above, so the estimate
+ *       never accepts an unstable model, but it is not only conservative: it overshoots by up to
+ *       (sqrt(n)*cond(V))^(1/2^m), V being the eigenvectors. With m = 10 that slack rejected
+ *       stable, lightly damped filters at the 50 kHz model rate (a pole radius of 0.9999 came
+ *       out above 1); with m = 24 it is below 1e-6 for any reasonable conditioning.
+ *     - The model-based controllers (LQR, MPC and the observer) keep their tables designed for
+ *       the built-in model.
+ *     - model_fast_forward() advances the active model by k steps with the input held constant in
+ *       O(log k) matrix-vector products. With P_i = A^(2^i) and
+ *       s_i = (I + A + ... + A^(2^i - 1))*B, one jump of 2^i steps is x = P_i*x + s_i*u, and
+ *       jumps of any lengths can be chained in any order. The levels are computed on first use
+ *       (P_(i+1) = P_i^2, s_(i+1) = P_i*s_i + s_i) and dropped when another model is swapped in.
+ *       Levels up to 2^24 are kept (6.5 KB for n = 8), so every count up to MODEL_FF_STEPS_MAX
+ *       takes at most one jump per set bit; only longer counts repeat the top level.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "model.h"
+
+#include "c2d.h"
+#include "converter.h"
+#include "modal.h"
+#include "systick.h"
+#include "terminal.h"
+#include "uart.h"
+#include "utils.h"
+
+#define MODEL_MAGIC            0x53U // 'S'
+#define MODEL_DISCRETE         1U // Blob versions
+#define MODEL_CONTINUOUS       2U
+#define MODEL_HEADER_LEN       4U
+#define MODEL_CRC_LEN          4U
+#define MODEL_VALUES_NUM(n)    ((n) * (n) + 2U * (n) + 1U) // Entries of A, B, C and D
+#define MODEL_BLOB_LEN_MAX     (MODEL_HEADER_LEN + 4U * MODEL_VALUES_NUM(MODEL_STATES_MAX) + \
+                                MODEL_CRC_LEN)
+#define MODEL_RADIUS_SQUARINGS 24     // Estimate the spectral radius from A^(2^24)
+#define MODEL_RADIUS_MAX       1.0f
+#define MODEL_RECEIVE_TIMEOUT  5000UL // Binary transfer timeout in ms
+#define MODEL_FF_LEVELS        25     // Cached powers A^1 ... A^(2^24)
+
+const char *const model_realizations[] = {"dense", "modal"};
+
+const char *const model_status_messages[] = {"model accepted",
+                                             "wrong blob length",
+                                             "wrong magic or version",
+                                             "order out of range",
+                                             "CRC mismatch",
+                                             "value is not finite or discretization failed",
+                                             "spectral radius not below 1",
+                                             "a model swap is still pending"};
+
+static struct model model_buffers[2];
+static volatile uint8_t model_active    = 0U;
+static volatile bool model_swap_pending = false;
+static const char *model_origin[2];     // Where each buffer's model came from
+
+// Result of loading each built-in realization at start-up (modal is only tried if dense fails)
+static model_status_t model_builtin_status[2] = {MODEL_OK, MODEL_OK};
+
+// Binary transfer state
+static uint8_t model_rx_buffer[MODEL_BLOB_LEN_MAX];
+static uint16_t model_rx_length;
+static bool model_rx_active = false;
+static uint32_t model_rx_deadline;
+
+// Scratch matrices of the spectral radius estimate
+static float model_scratch[2][MODEL_STATES_MAX][MODEL_STATES_MAX];
+
+// Fast-forward cache of the active model: A^(2^i) and (I + A + ... + A^(2^i - 1))*B
+static float model_ff_power[MODEL_FF_LEVELS][MODEL_STATES_MAX][MODEL_STATES_MAX];
+static float model_ff_sum[MODEL_FF_LEVELS][MODEL_STATES_MAX];
+static uint8_t model_ff_levels = 0U; // Number of valid levels
+
+static model_status_t model_build(struct model *model, const float *values, uint8_t n);
+static bool model_builtin_values(model_realization_t realization, float *values);
+static model_status_t model_stage(const float *values, uint8_t n, const char *origin);
+static void model_select_kernels(struct model *model);
+static float model_spectral_radius(const struct model *model);
+static void model_sparse_step(const struct model *model, float *x, float input);
+static void model_block_step(const struct model *model, float *x, float input);
+static void model_block_step_unit(const struct model *model, float *x, float input);
+static float model_output(const struct model *model, const float *x, float input);
+static void model_ff_extend(const struct model *model, uint8_t level);
+
+/*
+ * Dense state update compiled for a fixed order n, so the loops have constant bounds and the
+ * compiler can unroll them.
+ */
+#define MODEL_DENSE_KERNEL(n)                                                                      \
+        static void model_dense_step_##n(const struct model *model, float *x, float input)         \
+        {                                                                                          \
+                float x_next[n];                                                                   \
+                                                                                                   \
+                for (int i = 0; i < (n); i++)                                                      \
+                {                                                                                  \
+                        float sum = model->B[i] * input;                                           \
+                                                                                                   \
+                        for (int j = 0; j < (n); j++)                                              \
+                        {                                                                          \
+                                sum += model->A[i][j] * x[j];                                      \
+                        }                                                                          \
+                        x_next[i] = sum;                                                           \
+                }                                                                                  \
+                for (int i = 0; i < (n); i++)                                                      \
+                {                                                                                  \
+                        x[i] = x_next[i];                                                          \
+                }                                                                                  \
+        }
+
+MODEL_DENSE_KERNEL(1)
+MODEL_DENSE_KERNEL(2)
+MODEL_DENSE_KERNEL(3)
+MODEL_DENSE_KERNEL(4)
+MODEL_DENSE_KERNEL(5)
+MODEL_DENSE_KERNEL(6)
+MODEL_DENSE_KERNEL(7)
+MODEL_DENSE_KERNEL(8)
+
+static const model_kernel_t model_dense_kernels[MODEL_STATES_MAX + 1] = {NULL,
+                                                                         model_dense_step_1,
+                                                                         model_dense_step_2,
+                                                                         model_dense_step_3,
+                                                                         model_dense_step_4,
+                                                                         model_dense_step_5,
+                                                                         model_dense_step_6,
+                                                                         model_dense_step_7,
+                                                                         model_dense_step_8};
+
+_Static_assert(MODEL_STATES_MAX == 8, "Add a dense kernel for every order up to the maximum.");
+_Static_assert(STATES_NUM <= MODEL_STATES_MAX, "The built-in model must fit in the store.");
+_Static_assert((1UL << (MODEL_FF_LEVELS - 1)) >= MODEL_FF_STEPS_MAX,
+               "A fast-forward must take at most one jump per cached level.");
+
+/*
+ * Load the built-in converter matrices into the active buffer: the dense realization, or the
+ * modal one if the dense one is rejected. If neither is accepted there is no plant to simulate;
+ * the start-up goes on (main() reports it) and mod mode is refused until a model is loaded.
+ */
+model_status_t model_init(void)
+{
+        model_status_t status = model_load_builtin(MODEL_DENSE);
+
+        model_builtin_status[MODEL_DENSE] = status;
+        if (status != MODEL_OK)
+        {
+                status                            = model_load_builtin(MODEL_MODAL);
+                model_builtin_status[MODEL_MODAL] = status;
+        }
+
+        model_swap_if_pending();
+        return status;
+}
+
+size_t model_blob_length(uint8_t states)
+{
+        return MODEL_HEADER_LEN + 4U * MODEL_VALUES_NUM((size_t)states) + MODEL_CRC_LEN;
+}
+
+model_status_t model_load_blob(const uint8_t *blob, size_t length)
+{
+        float values[MODEL_VALUES_NUM(MODEL_STATES_MAX)];
+
+        if (length < MODEL_HEADER_LEN + MODEL_CRC_LEN)
+        {
+                return MODEL_ERR_LENGTH;
+        }
+        if (blob[0] != MODEL_MAGIC || blob[1] != MODEL_MAGIC ||
+            (blob[2] != MODEL_DISCRETE && blob[2] != MODEL_CONTINUOUS))
+        {
+                return MODEL_ERR_HEADER;
+        }
+
+        uint8_t n = blob[3];
+        if (n == 0U || n > MODEL_STATES_MAX)
+        {
+                return MODEL_ERR_ORDER;
+        }
+        if (length != model_blob_length(n))
+        {
+                return MODEL_ERR_LENGTH;
+        }
+
+        uint32_t crc;
+        memcpy(&crc, &blob[length - MODEL_CRC_LEN], sizeof(crc));
+        if (crc != crc32(blob, length - MODEL_CRC_LEN))
+        {
+                return MODEL_ERR_CRC;
+        }
+
+        // The blob is packed, so copy the floats out instead of casting (unaligned access).
+        memcpy(values, &blob[MODEL_HEADER_LEN], length - MODEL_HEADER_LEN - MODEL_CRC_LEN);
+
+        // A and B of a continuous model are replaced by their discretization (C and D are kept).
+        if (blob[2] == MODEL_CONTINUOUS &&
+            !c2d_zoh(n, values, &values[n * n], 1.0f / SAMPLING_FREQUENCY, values, &values[n * n]))
+        {
+                return MODEL_ERR_VALUE;
+        }
+
+        return model_stage(values, n, "loaded");
+}
+
+// Stage the built-in converter model in the given realization.
+model_status_t model_load_builtin(model_realization_t realization)
+{
+        float values[MODEL_VALUES_NUM(STATES_NUM)];
+
+        if (!model_builtin_values(realization, values))
+        {
+                return MODEL_ERR_VALUE;
+        }
+
+        return model_stage(values,
+                           STATES_NUM,
+                           (realization == MODEL_MODAL) ? "built-in modal" : "built-in dense");
+}
+
+// Build the built-in model in the given realization into model, without making it active.
+model_status_t model_build_builtin(struct model *model, model_realization_t realization)
+{
+        float values[MODEL_VALUES_NUM(STATES_NUM)];
+
+        if (!model_builtin_values(realization, values))
+        {
+                return MODEL_ERR_VALUE;
+        }
+
+        return model_build(model, values, STATES_NUM);
+}
+
+/*
+ * Build a model from values (A, B, C, D in blob order): check them, estimate the spectral radius
+ * and choose the update kernels. The model is not made active.
+ */
+static model_status_t model_build(struct model *model, const float *values, uint8_t n)
+{
+        for (size_t k = 0; k < MODEL_VALUES_NUM((size_t)n); k++)
+        {
+                if (!isfinite(values[k]))
+                {
+                        return MODEL_ERR_VALUE;
+                }
+        }
+
+        *model        = (struct model){0};
+        model->states = n;
+
+        size_t k = 0U;
+        for (int i = 0; i < n; i++)
+        {
+                for (int j = 0; j < n; j++)
+                {
+                        model->A[i][j] = values[k++];
+                }
+        }
+        for (int i = 0; i < n; i++)
+        {
+                model->B[i] = values[k++];
+        }
+        for (int i = 0; i < n; i++)
+        {
+                model->C[i] = values[k++];
+        }
+        model->D = values[k];
+
+        model->radius = model_spectral_radius(model);
+        if (!(model->radius < MODEL_RADIUS_MAX))
+        {
+                return MODEL_ERR_UNSTABLE;
+        }
+
+        model_select_kernels(model);
+
+        return MODEL_OK;
+}
+
+// Values of the built-in model (STATES_NUM states) in the given realization, in blob order.
+static bool model_builtin_values(model_realization_t realization, float *values)
+{
+        if (realization == MODEL_MODAL)
+        {
+                return modal_discretize(1.0f / SAMPLING_FREQUENCY, values);
+        }
+
+        size_t k = 0U;
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                for (size_t j = 0; j < STATES_NUM; j++)
+                {
+                        values[k++] = converter_Ad[i][j];
+                }
+        }
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                values[k++] = converter_Bd[i][0];
+        }
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                values[k++] = converter_Cd[0][i];
+        }
+        values[k] = converter_Dd[0][0];
+
+        return true;
+}
+
+// Make the staged model active. Called only at the start of a plant step.
+bool model_swap_if_pending(void)
+{
+        if (!model_swap_pending)
+        {
+                return false;
+        }
+
+        model_active       = 1U - model_active;
+        model_swap_pending = false;
+        model_ff_levels    = 0U;
+        return true;
+}
+
+// One plant step of the active model: x = A*x + B*input, returns the output of the new state.
+float model_step(float x[MODEL_STATES_MAX], float input)
+{
+        return model_run(&model_buffers[model_active], x, input);
+}
+
+// One step of the given model with the kernels chosen for it.
+float model_run(const struct model *model, float x[MODEL_STATES_MAX], float input)
+{
+        model->state_kernel(model, x, input);
+
+        return model_output(model, x, input);
+}
+
+/*
+ * Advance the active model by steps with the input held constant, using the largest cached jump
+ * that fits each time. Returns the output of the final state.
+ */
+float model_fast_forward(float x[MODEL_STATES_MAX], float input, uint32_t steps)
+{
+        const struct model *model = &model_buffers[model_active];
+        uint8_t n                 = model->states;
+
+        while (steps != 0U)
+        {
+                uint8_t level = MODEL_FF_LEVELS - 1U;
+
+                if (steps < (1UL << level))
+                {
+                        level = (uint8_t)(31 - __builtin_clz(steps));
+                }
+                model_ff_extend(model, level);
+
+                float x_next[MODEL_STATES_MAX];
+                for (uint8_t i = 0; i < n; i++)
+                {
+                        float sum = model_ff_sum[level][i] * input;
+
+                        for (uint8_t j = 0; j < n; j++)
+                        {
+                                sum += model_ff_power[level][i][j] * x[j];
+                        }
+                        x_next[i] = sum;
+                }
+                for (uint8_t i = 0; i < n; i++)
+                {
+                        x[i] = x_next[i];
+                }
+
+                steps -= 1UL << level;
+        }
+
+        return model_output(model, x, input);
+}
+
+static float model_output(const struct model *model, const float *x, float input)
+{
+        float output;
+
+        if (model->output_is_selector)
+        {
+                output = x[model->output_index];
+        }
+        else
+        {
+                output = 0.0f;
+                for (int i = 0; i < model->states; i++)
+                {
+                        output += model->C[i] * x[i];
+                }
+        }
+
+        if (model->has_feedthrough)
+        {
+                output += model->D * input;
+        }
+
+        return output;
+}
+
+uint8_t model_get_states(void)
+{
+        return model_buffers[model_active].states;
+}
+
+// Tell whether there is a model to simulate, active or waiting to be swapped in.
+bool model_is_available(void)
+{
+        return model_buffers[model_active].states != 0U || model_swap_pending;
+}
+
+// Print the built-in realizations rejected at start-up, if any.
+void model_print_builtin_errors(void)
+{
+        for (size_t i = 0; i < ARRAY_LEN(model_builtin_status); i++)
+        {
+                if (model_builtin_status[i] != MODEL_OK)
+                {
+                        printf("  Built-in %s model rejected: %s.",
+                               model_realizations[i],
+                               model_status_messages[model_builtin_status[i]]);
+                        terminal_insert_new_line();
+                }
+        }
+}
+
+// Arm the UART to receive a blob of a model with the given order.
+bool model_receive_start(uint8_t states)
+{
+        if (states == 0U || states > MODEL_STATES_MAX)
+        {
+                return false;
+        }
+
+        model_rx_length   = (uint16_t)model_blob_length(states);
+        model_rx_deadline = systick_get_ticks() + MODEL_RECEIVE_TIMEOUT;
+        model_rx_active   = true;
+        uart2_raw_receive_start(model_rx_buffer, model_rx_length);
+        return true;
+}
+
+// Called periodically from the print task: finish the transfer when complete or timed out.
+void model_receive_poll(void)
+{
+        if (!model_rx_active)
+        {
+                return;
+        }
+
+        uint16_t received = uart2_raw_receive_count();
+
+        if (received < model_rx_length)
+        {
+                if ((int32_t)(systick_get_ticks() - model_rx_deadline) >= 0)
+                {
+                        uart2_raw_receive_stop();
+                        model_rx_active = false;
+                        printf("  Model transfer timed out after %u of %u bytes.",
+                               received,
+                               model_rx_length);
+                        terminal_insert_new_line();
+                        terminal_print_arrow();
+                }
+                return;
+        }
+
+        uart2_raw_receive_stop();
+        model_rx_active = false;
+
+        model_status_t status = model_load_blob(model_rx_buffer, model_rx_length);
+        printf("  Model transfer: %s.", model_status_messages[status]);
+        terminal_insert_new_line();
+        if (status == MODEL_OK)
+        {
+                printf("  The model is swapped in at the next step of the control loop.");
+                terminal_insert_new_line();
+        }
+        terminal_print_arrow();
+}
+
+void model_print(void)
+{
+        const struct model *model = &model_buffers[model_active];
+
+        model_print_builtin_errors();
+        if (model->states == 0U)
+        {
+                printf("  Plant model   : none, mod mode is refused until a model is loaded");
+                terminal_insert_new_line();
+                if (model_swap_pending)
+                {
+                        printf("  A %s model with %u states is waiting to be swapped in.",
+                               model_origin[1U - model_active],
+                               model_buffers[1U - model_active].states);
+                        terminal_insert_new_line();
+                }
+                return;
+        }
+
+        printf("  Plant model   : %s, %u states, spectral radius %.5f",
+               model_origin[model_active],
+               model->states,
+               model->radius);
+        terminal_insert_new_line();
+        if (model->state_kernel == model_block_step || model->state_kernel == model_block_step_unit)
+        {
+                printf("  state update  : block-diagonal (%u blocks%s)",
+                       model->blocks,
+                       (model->state_kernel == model_block_step_unit) ? ", unit input" : "");
+        }
+        else if (model->state_kernel == model_sparse_step)
+        {
+                printf("  state update  : sparse (%u of %u nonzeros in A)",
+                       model->nonzeros,
+                       model->states * model->states);
+        }
+        else
+        {
+                printf("  state update  : dense, order %u", model->states);
+        }
+        terminal_insert_new_line();
+        if (model->output_is_selector)
+        {
+                printf("  output        : x%u", model->output_index + 1U);
+        }
+        else
+        {
+                printf("  output        : C*x");
+        }
+        printf("%s", model->has_feedthrough ? " + D*u" : "");
+        terminal_insert_new_line();
+        if (model_swap_pending)
+        {
+                printf("  A %s model with %u states is waiting to be swapped in.",
+                       model_origin[1U - model_active],
+                       model_buffers[1U - model_active].states);
+                terminal_insert_new_line();
+        }
+}
+
+// Build the model (A, B, C, D in blob order) in the inactive buffer and mark it for the swap.
+static model_status_t model_stage(const float *values, uint8_t n, const char *origin)
+{
+        if (model_swap_pending)
+        {
+                return MODEL_ERR_BUSY;
+        }
+
+        uint8_t staged        = 1U - model_active;
+        model_status_t status = model_build(&model_buffers[staged], values, n);
+
+        if (status == MODEL_OK)
+        {
+                model_origin[staged] = origin;
+                model_swap_pending   = true;
+        }
+
+        return status;
+}
+
+static void model_select_kernels(struct model *model)
+{
+        uint8_t n = model->states;
+
+        /*
+         * Split A into diagonal blocks of size 1 or 2. A block has size 2 when its first state is
+         * coupled to the next one; the rows of a block must be zero outside of it.
+         */
+        bool is_block_diagonal = true;
+        bool input_is_unit     = true;
+        uint8_t blocks         = 0U;
+
+        for (uint8_t i = 0; i < n;)
+        {
+                uint8_t size =
+                        (i + 1U < n && (model->A[i][i + 1] != 0.0f || model->A[i + 1][i] != 0.0f))
+                                ? 2U
+                                : 1U;
+
+                for (uint8_t r = i; r < i + size; r++)
+                {
+                        for (uint8_t c = 0; c < n; c++)
+                        {
+                                if ((c < i || c >= i + size) && model->A[r][c] != 0.0f)
+                                {
+                                        is_block_diagonal = false;
+                                }
+                        }
+                }
+
+                // Unit input: B is 1 at the first state of every block and 0 at the second.
+                if (model->B[i] != 1.0f || (size == 2U && model->B[i + 1] != 0.0f))
+                {
+                        input_is_unit = false;
+                }
+
+                model->block_start[blocks++] = i;
+                i += size;
+        }
+        model->block_start[blocks] = n;
+        model->blocks              = blocks;
+
+        // Build the CSR form of A and use it if at most half of the entries are nonzero.
+        uint8_t k = 0U;
+        for (uint8_t i = 0; i < n; i++)
+        {
+                model->row_start[i] = k;
+                for (uint8_t j = 0; j < n; j++)
+                {
+                        if (model->A[i][j] != 0.0f)
+                        {
+                                model->columns[k] = j;
+                                model->values[k]  = model->A[i][j];
+                                k++;
+                        }
+                }
+        }
+        model->row_start[n] = k;
+        model->nonzeros     = k;
+
+        if (is_block_diagonal)
+        {
+                model->state_kernel = input_is_unit ? model_block_step_unit : model_block_step;
+        }
+        else if (2U * k <= (uint32_t)n * n)
+        {
+                model->state_kernel = model_sparse_step;
+        }
+        else
+        {
+                model->state_kernel = model_dense_kernels[n];
+        }
+
+        // The output is a copy of one state if C is a unit row vector.
+        uint8_t nonzeros = 0U;
+        for (uint8_t i = 0; i < n; i++)
+        {
+                if (model->C[i] != 0.0f)
+                {
+                        nonzeros++;
+                        model->output_index = i;
+                }
+        }
+        model->output_is_selector = (nonzeros == 1U && model->C[model->output_index] == 1.0f);
+
+        model->has_feedthrough = (model->D != 0.0f);
+}
+
+static float model_spectral_radius(const struct model *model)
+{
+        uint8_t n                   = model->states;
+        float(*M)[MODEL_STATES_MAX] = model_scratch[0];
+        float(*S)[MODEL_STATES_MAX] = model_scratch[1];
+        double log_norm             = 0.0; // M = A^(2^k) / exp(log_norm) with ||M|| = 1
+
+        for (int s = -1; s < MODEL_RADIUS_SQUARINGS; s++)
+        {
+                // S = A for the first pass, M * M afterwards.
+                float norm = 0.0f;
+
+                for (int i = 0; i < n; i++)
+                {
+                        for (int j = 0; j < n; j++)
+                        {
+                                float sum = 0.0f;
+
+                                if (s < 0)
+                                {
+                                        sum = model->A[i][j];
+                                }
+                                else
+                                {
+                                        for (int l = 0; l < n; l++)
+                                        {
+                                                sum += M[i][l] * M[l][j];
+                                        }
+                                }
+                                S[i][j] = sum;
+                                norm += sum * sum;
+                        }
+                }
+
+                norm = sqrtf(norm);
+                if (norm == 0.0f)
+                {
+                        // A is nilpotent.
+                        return 0.0f;
+                }
+
+                for (int i = 0; i < n; i++)
+                {
+                        for (int j = 0; j < n; j++)
+                        {
+                                M[i][j] = S[i][j] / norm;
+                        }
+                }
+                log_norm = 2.0 * log_norm + (double)logf(norm);
+        }
+
+        // The first pass was A itself, so the last matrix is A^(2^MODEL_RADIUS_SQUARINGS).
+        return (float)exp(log_norm / (double)(1UL << MODEL_RADIUS_SQUARINGS));
+}
+
+static void model_sparse_step(const struct model *model, float *x, float input)
+{
+        float x_next[MODEL_STATES_MAX];
+
+        for (int i = 0; i < model->states; i++)
+        {
+                float sum = model->B[i] * input;
+
+                for (int k = model->row_start[i]; k < model->row_start[i + 1]; k++)
+                {
+                        sum += model->values[k] * x[model->columns[k]];
+                }
+                x_next[i] = sum;
+        }
+        for (int i = 0; i < model->states; i++)
+        {
+                x[i] = x_next[i];
+        }
+}
+
+// State update of a block-diagonal A: 1x1 and 2x2 blocks updated in place.
+static void model_block_step(const struct model *model, float *x, float input)
+{
+        for (uint8_t b = 0; b < model->blocks; b++)
+        {
+                uint8_t i = model->block_start[b];
+
+                if (model->block_start[b + 1] - i == 1U)
+                {
+                        x[i] = model->A[i][i] * x[i] + model->B[i] * input;
+                }
+                else
+                {
+                        float x1 = x[i];
+                        float x2 = x[i + 1];
+
+                        x[i] = model->A[i][i] * x1 + model->A[i][i + 1] * x2 +
+                               model->B[i] * input;
+                        x[i + 1] = model->A[i + 1][i] * x1 + model->A[i + 1][i + 1] * x2 +
+                                   model->B[i + 1] * input;
+                }
+        }
+}
+
+// Same as model_block_step() when the input enters every block with a unit gain at its first state.
+static void model_block_step_unit(const struct model *model, float *x, float input)
+{
+        for (uint8_t b = 0; b < model->blocks; b++)
+        {
+                uint8_t i = model->block_start[b];
+
+                if (model->block_start[b + 1] - i == 1U)
+                {
+                        x[i] = model->A[i][i] * x[i] + input;
+                }
+                else
+                {
+                        float x1 = x[i];
+                        float x2 = x[i + 1];
+
+                        x[i]     = model->A[i][i] * x1 + model->A[i][i + 1] * x2 + input;
+                        x[i + 1] = model->A[i + 1][i] * x1 + model->A[i + 1][i + 1] * x2;
+                }
+        }
+}
+
+// Compute the fast-forward levels up to and including level if they are not cached yet.
+static void model_ff_extend(const struct model *model, uint8_t level)
+{
+        uint8_t n = model->states;
+
+        if (model_ff_levels == 0U)
+        {
+                for (uint8_t i = 0; i < n; i++)
+                {
+                        for (uint8_t j = 0; j < n; j++)
+                        {
+                                model_ff_power[0][i][j] = model->A[i][j];
+                        }
+                        model_ff_sum[0][i] = model->B[i];
+                }
+                model_ff_levels = 1U;
+        }
+
+        while (model_ff_levels <= level)
+        {
+                uint8_t l = model_ff_levels;
+
+                for (uint8_t i = 0; i < n; i++)
+                {
+                        float sum = model_ff_sum[l - 1][i];
+
+                        for (uint8_t j = 0; j < n; j++)
+                        {
+                                float product = 0.0f;
+
+                                for (uint8_t k = 0; k < n; k++)
+                                {
+                                        product += model_ff_power[l - 1][i][k] *
+                                                   model_ff_power[l - 1][k][j];
+                                }
+                                model_ff_power[l][i][j] = product;
+                                sum += model_ff_power[l - 1][i][j] * model_ff_sum[l - 1][j];
+                        }
+                        model_ff_sum[l][i] = sum;
+                }
+
+                model_ff_levels++;
+        }
+}
@@ -0,0 +1,451 @@
+/*
+ * mpc.c
+ *
+ * Description:
+ *     Explicit model-predictive controller for the converter model.
+ *
+ *     The MPC problem (horizon 3, quadratic cost on the deviation from the steady state of the
+ *     reference, Riccati terminal cost and the controller output limits as input constraints) is
+ *     solved offline as a multi-parametric QP by Tools/mpc_design.py. Its solution is a
+ *     piecewise-affine law over the parameter theta = [x_hat; r]:
+ *
+ *         if H_i*theta <= k_i then u = F_i*theta + g_i
+ *
+ *     so at run time each step only needs a region search and one affine evaluation.
+ *
+ * Notes:
+ *     - x_hat comes from the same observer as the LQR controller (see observer.c). As for LQR, the
+ *       caller propagates it with the plant input (controller_apply_input()).
+ *     - Regions are searched sequentially and a region is left at its first violated row. The
+ *       unconstrained region is stored first since it is the most likely one near the reference.
+ *     - The tables are computed for output limits of -60 V and 60 V (controller_out_min and
+ *       controller_out_max in main.c) and must be regenerated if those limits change.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mpc.h"
+
+#include "controller.h"
+#include "converter.h"
+#include "dwt.h"
+#include "observer.h"
+#include "utils.h"
+
+#define MPC_PARAMS_NUM  (STATES_NUM + 1) // theta = [x_hat; r]
+#define MPC_TOLERANCE   1e-4f            // Tolerance of the region membership test
+
+// Table dimensions generated by Tools/mpc_design.py.
+#define MPC_REGIONS_NUM 27
+#define MPC_ROWS_MAX    6
+
+struct mpc_region
+{
+        uint8_t rows_num;
+        float H[MPC_ROWS_MAX][MPC_PARAMS_NUM];
+        float k[MPC_ROWS_MAX];
+        float F[MPC_PARAMS_NUM];
+        float g;
+};
+
+// clang-format off
+// Generated by Tools/mpc_design.py (27 regions, at most 6 rows per region, horizon 3).
+static const struct mpc_region mpc_regions[MPC_REGIONS_NUM] = {
+        // region 0
+        {6,
+         {
+          {-9.986186f, -1.028341f, 0.5077381f, -0.489186f, 0.6846859f, -2.176001f, 4.269483f},
+          {-8.193402f, -1.973536f, -0.444126f, -0.2406402f, -0.5001039f, 0.597076f, 2.478585f},
+          {-3.3936f, 1.481276f, -0.5199906f, 0.1865381f, -0.6928062f, -0.4553343f, -0.2448371f},
+          {9.986186f, 1.028341f, -0.5077381f, 0.489186f, -0.6846859f, 2.176001f, -4.269483f},
+          {8.193402f, 1.973536f, 0.444126f, 0.2406402f, 0.5001039f, -0.597076f, -2.478585f},
+          {3.3936f, -1.481276f, 0.5199906f, -0.1865381f, 0.6928062f, 0.4553343f, 0.2448371f},
+         },
+         {60.0f, 60.0f, 60.0f, 60.0f, 60.0f, 60.0f},
+         {-9.986186f, -1.028341f, 0.5077381f, -0.489186f, 0.6846859f, -2.176001f, 4.269483f},
+         0.0f},
+        // region 1
+        {5,
+         {
+          {-11.3538f, -0.4313916f, 0.2981835f, -0.4140117f, 0.405487f, -2.3595f, 4.170815f},
+          {-8.519066f, -1.831387f, -0.4940264f, -0.2227392f, -0.5665885f, 0.5533802f, 2.45509f},
+          {11.3538f, 0.4313916f, -0.2981835f, 0.4140117f, -0.405487f, 2.3595f, -4.170815f},
+          {8.519066f, 1.831387f, 0.4940264f, 0.2227392f, 0.5665885f, -0.5533802f, -2.45509f},
+          {1.19039f, -0.5195943f, 0.1823996f, -0.06543288f, 0.243019f, 0.1597198f, 0.08588271f},
+         },
+         {84.17982f, 65.75785f, 35.82018f, 54.24215f, -21.04649f},
+         {-11.3538f, -0.4313916f, 0.2981835f, -0.4140117f, 0.405487f, -2.3595f, 4.170815f},
+         -24.17982f},
+        // region 2
+        {5,
+         {
+          {-11.3538f, -0.4313916f, 0.2981835f, -0.4140117f, 0.405487f, -2.3595f, 4.170815f},
+          {-8.519066f, -1.831387f, -0.4940264f, -0.2227392f, -0.5665885f, 0.5533802f, 2.45509f},
+          {11.3538f, 0.4313916f, -0.2981835f, 0.4140117f, -0.405487f, 2.3595f, -4.170815f},
+          {8.519066f, 1.831387f, 0.4940264f, 0.2227392f, 0.5665885f, -0.5533802f, -2.45509f},
+          {-1.19039f, 0.5195943f, -0.1823996f, 0.06543288f, -0.243019f, -0.1597198f, -0.08588271f},
+         },
+         {35.82018f, 54.24215f, 84.17982f, 65.75785f, -21.04649f},
+         {-11.3538f, -0.4313916f, 0.2981835f, -0.4140117f, 0.405487f, -2.3595f, 4.170815f},
+         24.17982f},
+        // region 3
+        {5,
+         {
+          {-12.9088f, -1.732307f, 0.3493172f, -0.575023f, 0.5062974f, -1.963023f, 5.153602f},
+          {-4.451933f, 1.226356f, -0.5773578f, 0.1554549f, -0.757404f, -0.3782106f, 0.07531887f},
+          {12.9088f, 1.732307f, -0.3493172f, 0.575023f, -0.5062974f, 1.963023f, -5.153602f},
+          {4.451933f, -1.226356f, 0.5773578f, -0.1554549f, 0.757404f, 0.3782106f, -0.07531887f},
+          {3.86849f, 0.9317992f, 0.2096927f, 0.1136175f, 0.2361225f, -0.2819076f, -1.170256f},
+         },
+         {81.40216f, 67.75013f, 38.59784f, 52.24987f, -28.32882f},
+         {-12.9088f, -1.732307f, 0.3493172f, -0.575023f, 0.5062974f, -1.963023f, 5.153602f},
+         -21.40216f},
+        // region 4
+        {5,
+         {
+          {-12.9088f, -1.732307f, 0.3493172f, -0.575023f, 0.5062974f, -1.963023f, 5.153602f},
+          {-4.451933f, 1.226356f, -0.5773578f, 0.1554549f, -0.757404f, -0.3782106f, 0.07531887f},
+          {12.9088f, 1.732307f, -0.3493172f, 0.575023f, -0.5062974f, 1.963023f, -5.153602f},
+          {4.451933f, -1.226356f, 0.5773578f, -0.1554549f, 0.757404f, 0.3782106f, -0.07531887f},
+          {-3.86849f, -0.9317992f, -0.2096927f, -0.1136175f, -0.2361225f, 0.2819076f, 1.170256f},
+         },
+         {38.59784f, 52.24987f, 81.40216f, 67.75013f, -28.32882f},
+         {-12.9088f, -1.732307f, 0.3493172f, -0.575023f, 0.5062974f, -1.963023f, 5.153602f},
+         21.40216f},
+        // region 5
+        {5,
+         {
+          {-12.38226f, -2.404889f, -0.2311477f, -0.4458365f, -0.2129022f, -0.3156801f, 4.269483f},
+          {-9.763599f, 0.8253162f, -0.1961141f, -0.1255044f, -0.2560581f, -1.843364f, 2.478585f},
+          {12.38226f, 2.404889f, 0.2311477f, 0.4458365f, 0.2129022f, 0.3156801f, -4.269483f},
+          {9.763599f, -0.8253162f, 0.1961141f, 0.1255044f, 0.2560581f, 1.843364f, -2.478585f},
+          {5.544546f, 0.5709573f, -0.2819072f, 0.2716066f, -0.3801524f, 1.208163f, -2.370509f},
+         },
+         {85.16789f, 98.27286f, 34.83211f, 21.72714f, -33.31329f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 6
+        {5,
+         {
+          {-12.38226f, -2.404889f, -0.2311477f, -0.4458365f, -0.2129022f, -0.3156801f, 4.269483f},
+          {-9.763599f, 0.8253162f, -0.1961141f, -0.1255044f, -0.2560581f, -1.843364f, 2.478585f},
+          {12.38226f, 2.404889f, 0.2311477f, 0.4458365f, 0.2129022f, 0.3156801f, -4.269483f},
+          {9.763599f, -0.8253162f, 0.1961141f, 0.1255044f, 0.2560581f, 1.843364f, -2.478585f},
+          {-5.544546f, -0.5709573f, 0.2819072f, -0.2716066f, 0.3801524f, -1.208163f, 2.370509f},
+         },
+         {34.83211f, 21.72714f, 85.16789f, 98.27286f, -33.31329f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 7
+        {4,
+         {
+          {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+          {14.87973f, 1.18938f, -0.09371196f, 0.5062007f, -0.170983f, 2.130462f, -5.186946f},
+          {4.072735f, 0.8755366f, 0.2361807f, 0.1064856f, 0.2708706f, -0.2645561f, -1.173712f},
+          {1.581226f, -0.4355741f, 0.2050645f, -0.05521408f, 0.2690129f, 0.1343319f, -0.02675157f},
+         },
+         {111.3962f, 8.603808f, -31.43705f, -24.06332f},
+         {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+         -51.39619f},
+        // region 8
+        {4,
+         {
+          {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+          {14.87973f, 1.18938f, -0.09371196f, 0.5062007f, -0.170983f, 2.130462f, -5.186946f},
+          {4.072735f, 0.8755366f, 0.2361807f, 0.1064856f, 0.2708706f, -0.2645561f, -1.173712f},
+          {-1.581226f, 0.4355741f, -0.2050645f, 0.05521408f, -0.2690129f, -0.1343319f, 0.02675157f},
+         },
+         {58.27034f, 61.72966f, -25.9317f, -18.55798f},
+         {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+         1.729659f},
+        // region 9
+        {4,
+         {
+          {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+          {14.87973f, 1.18938f, -0.09371196f, 0.5062007f, -0.170983f, 2.130462f, -5.186946f},
+          {-4.072735f, -0.8755366f, -0.2361807f, -0.1064856f, -0.2708706f, 0.2645561f, 1.173712f},
+          {1.581226f, -0.4355741f, 0.2050645f, -0.05521408f, 0.2690129f, 0.1343319f, -0.02675157f},
+         },
+         {61.72966f, 58.27034f, -25.9317f, -18.55798f},
+         {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+         -1.729659f},
+        // region 10
+        {4,
+         {
+          {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+          {14.87973f, 1.18938f, -0.09371196f, 0.5062007f, -0.170983f, 2.130462f, -5.186946f},
+          {-4.072735f, -0.8755366f, -0.2361807f, -0.1064856f, -0.2708706f, 0.2645561f, 1.173712f},
+          {-1.581226f, 0.4355741f, -0.2050645f, 0.05521408f, -0.2690129f, -0.1343319f, 0.02675157f},
+         },
+         {8.603808f, 111.3962f, -31.43705f, -24.06332f},
+         {-14.87973f, -1.18938f, 0.09371196f, -0.5062007f, 0.170983f, -2.130462f, 5.186946f},
+         51.39619f},
+        // region 11
+        {4,
+         {
+          {-15.86496f, -2.110497f, -0.3011021f, -0.4906043f, -0.3042389f, -0.9732132f, 5.153602f},
+          {15.86496f, 2.110497f, 0.3011021f, 0.4906043f, 0.3042389f, 0.9732132f, -5.153602f},
+          {8.485084f, 0.3223938f, -0.2228428f, 0.3094052f, -0.3030344f, 1.763335f, -3.116994f},
+          {4.609853f, -0.3896705f, 0.09259467f, 0.0592565f, 0.1208971f, 0.8703388f, -1.170256f},
+         },
+         {120.2221f, -0.2220887f, -62.91048f, -46.39923f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 12
+        {4,
+         {
+          {-15.86496f, -2.110497f, -0.3011021f, -0.4906043f, -0.3042389f, -0.9732132f, 5.153602f},
+          {15.86496f, 2.110497f, 0.3011021f, 0.4906043f, 0.3042389f, 0.9732132f, -5.153602f},
+          {8.485084f, 0.3223938f, -0.2228428f, 0.3094052f, -0.3030344f, 1.763335f, -3.116994f},
+          {-4.609853f, 0.3896705f, -0.09259467f, -0.0592565f, -0.1208971f, -0.8703388f, 1.170256f},
+         },
+         {77.41776f, 42.58224f, -26.76965f, -10.2584f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 13
+        {4,
+         {
+          {-14.95752f, -0.1834504f, -0.2930724f, -0.3125171f, -0.3453631f, -1.975781f, 4.269483f},
+          {14.95752f, 0.1834504f, 0.2930724f, 0.3125171f, 0.3453631f, 1.975781f, -4.269483f},
+          {8.428323f, 1.131046f, -0.2280738f, 0.3754401f, -0.3305683f, 1.281684f, -3.364855f},
+          {6.874896f, 1.335246f, 0.1283382f, 0.247538f, 0.1182079f, 0.1752724f, -2.370509f},
+         },
+         {133.9978f, -13.9978f, -53.14855f, -47.28705f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 14
+        {4,
+         {
+          {-14.95752f, -0.1834504f, -0.2930724f, -0.3125171f, -0.3453631f, -1.975781f, 4.269483f},
+          {14.95752f, 0.1834504f, 0.2930724f, 0.3125171f, 0.3453631f, 1.975781f, -4.269483f},
+          {8.428323f, 1.131046f, -0.2280738f, 0.3754401f, -0.3305683f, 1.281684f, -3.364855f},
+          {-6.874896f, -1.335246f, -0.1283382f, -0.247538f, -0.1182079f, -0.1752724f, 2.370509f},
+         },
+         {83.66201f, 36.33799f, -25.20104f, -19.33954f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 15
+        {4,
+         {
+          {-15.86496f, -2.110497f, -0.3011021f, -0.4906043f, -0.3042389f, -0.9732132f, 5.153602f},
+          {15.86496f, 2.110497f, 0.3011021f, 0.4906043f, 0.3042389f, 0.9732132f, -5.153602f},
+          {-8.485084f, -0.3223938f, 0.2228428f, -0.3094052f, 0.3030344f, -1.763335f, 3.116994f},
+          {4.609853f, -0.3896705f, 0.09259467f, 0.0592565f, 0.1208971f, 0.8703388f, -1.170256f},
+         },
+         {42.58224f, 77.41776f, -26.76965f, -10.2584f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 16
+        {4,
+         {
+          {-15.86496f, -2.110497f, -0.3011021f, -0.4906043f, -0.3042389f, -0.9732132f, 5.153602f},
+          {15.86496f, 2.110497f, 0.3011021f, 0.4906043f, 0.3042389f, 0.9732132f, -5.153602f},
+          {-8.485084f, -0.3223938f, 0.2228428f, -0.3094052f, 0.3030344f, -1.763335f, 3.116994f},
+          {-4.609853f, 0.3896705f, -0.09259467f, -0.0592565f, -0.1208971f, -0.8703388f, 1.170256f},
+         },
+         {-0.2220887f, 120.2221f, -62.91048f, -46.39923f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 17
+        {4,
+         {
+          {-14.95752f, -0.1834504f, -0.2930724f, -0.3125171f, -0.3453631f, -1.975781f, 4.269483f},
+          {14.95752f, 0.1834504f, 0.2930724f, 0.3125171f, 0.3453631f, 1.975781f, -4.269483f},
+          {-8.428323f, -1.131046f, 0.2280738f, -0.3754401f, 0.3305683f, -1.281684f, 3.364855f},
+          {6.874896f, 1.335246f, 0.1283382f, 0.247538f, 0.1182079f, 0.1752724f, -2.370509f},
+         },
+         {36.33799f, 83.66201f, -25.20104f, -19.33954f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 18
+        {4,
+         {
+          {-14.95752f, -0.1834504f, -0.2930724f, -0.3125171f, -0.3453631f, -1.975781f, 4.269483f},
+          {14.95752f, 0.1834504f, 0.2930724f, 0.3125171f, 0.3453631f, 1.975781f, -4.269483f},
+          {-8.428323f, -1.131046f, 0.2280738f, -0.3754401f, 0.3305683f, -1.281684f, 3.364855f},
+          {-6.874896f, -1.335246f, -0.1283382f, -0.247538f, -0.1182079f, -0.1752724f, 2.370509f},
+         },
+         {-13.9978f, 133.9978f, -53.14855f, -47.28705f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 19
+        {3,
+         {
+          {15.18698f, 1.21394f, -0.09564699f, 0.5166532f, -0.1745136f, 2.174454f, -5.29405f},
+          {10.35844f, 1.377971f, 0.1965935f, 0.320322f, 0.1986416f, 0.6354238f, -3.364855f},
+          {8.304738f, 0.1018556f, 0.1627201f, 0.1735162f, 0.191753f, 1.096996f, -2.370509f},
+         },
+         {-113.6964f, -78.49459f, -74.39847f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 20
+        {3,
+         {
+          {15.18698f, 1.21394f, -0.09564699f, 0.5166532f, -0.1745136f, 2.174454f, -5.29405f},
+          {10.35844f, 1.377971f, 0.1965935f, 0.320322f, 0.1986416f, 0.6354238f, -3.364855f},
+          {-8.304738f, -0.1018556f, -0.1627201f, -0.1735162f, -0.191753f, -1.096996f, 2.370509f},
+         },
+         {-59.47355f, -50.54708f, 7.771878f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 21
+        {3,
+         {
+          {15.18698f, 1.21394f, -0.09564699f, 0.5166532f, -0.1745136f, 2.174454f, -5.29405f},
+          {-10.35844f, -1.377971f, -0.1965935f, -0.320322f, -0.1986416f, -0.6354238f, 3.364855f},
+          {8.304738f, 0.1018556f, 0.1627201f, 0.1735162f, 0.191753f, 1.096996f, -2.370509f},
+         },
+         {-63.0043f, 0.1450047f, -46.45095f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 22
+        {3,
+         {
+          {15.18698f, 1.21394f, -0.09564699f, 0.5166532f, -0.1745136f, 2.174454f, -5.29405f},
+          {-10.35844f, -1.377971f, -0.1965935f, -0.320322f, -0.1986416f, -0.6354238f, 3.364855f},
+          {-8.304738f, -0.1018556f, -0.1627201f, -0.1735162f, -0.191753f, -1.096996f, 2.370509f},
+         },
+         {-8.781466f, -27.80251f, -20.17563f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         60.0f},
+        // region 23
+        {3,
+         {
+          {-15.18698f, -1.21394f, 0.09564699f, -0.5166532f, 0.1745136f, -2.174454f, 5.29405f},
+          {10.35844f, 1.377971f, 0.1965935f, 0.320322f, 0.1986416f, 0.6354238f, -3.364855f},
+          {8.304738f, 0.1018556f, 0.1627201f, 0.1735162f, 0.191753f, 1.096996f, -2.370509f},
+         },
+         {-8.781466f, -27.80251f, -20.17563f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 24
+        {3,
+         {
+          {-15.18698f, -1.21394f, 0.09564699f, -0.5166532f, 0.1745136f, -2.174454f, 5.29405f},
+          {10.35844f, 1.377971f, 0.1965935f, 0.320322f, 0.1986416f, 0.6354238f, -3.364855f},
+          {-8.304738f, -0.1018556f, -0.1627201f, -0.1735162f, -0.191753f, -1.096996f, 2.370509f},
+         },
+         {-63.0043f, 0.1450047f, -46.45095f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 25
+        {3,
+         {
+          {-15.18698f, -1.21394f, 0.09564699f, -0.5166532f, 0.1745136f, -2.174454f, 5.29405f},
+          {-10.35844f, -1.377971f, -0.1965935f, -0.320322f, -0.1986416f, -0.6354238f, 3.364855f},
+          {8.304738f, 0.1018556f, 0.1627201f, 0.1735162f, 0.191753f, 1.096996f, -2.370509f},
+         },
+         {-59.47355f, -50.54708f, 7.771878f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+        // region 26
+        {3,
+         {
+          {-15.18698f, -1.21394f, 0.09564699f, -0.5166532f, 0.1745136f, -2.174454f, 5.29405f},
+          {-10.35844f, -1.377971f, -0.1965935f, -0.320322f, -0.1986416f, -0.6354238f, 3.364855f},
+          {-8.304738f, -0.1018556f, -0.1627201f, -0.1735162f, -0.191753f, -1.096996f, 2.370509f},
+         },
+         {-113.6964f, -78.49459f, -74.39847f},
+         {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f},
+         -60.0f},
+};
+// clang-format on
+
+static const struct mpc_region *mpc_find_region(const float theta[MPC_PARAMS_NUM]);
+
+void mpc_reset(void)
+{
+        observer_reset();
+}
+
+float mpc_update(float reference, float measurement)
+{
+        const float *x_hat = observer_correct(measurement);
+        float theta[MPC_PARAMS_NUM];
+
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                theta[i] = x_hat[i];
+        }
+        theta[STATES_NUM] = reference;
+
+        const struct mpc_region *region = mpc_find_region(theta);
+
+        // The regions cover the whole parameter space, so a miss can only be a rounding corner.
+        if (region == NULL)
+        {
+                region = &mpc_regions[0];
+        }
+
+        float output = region->g;
+        for (size_t j = 0; j < MPC_PARAMS_NUM; j++)
+        {
+                output += region->F[j] * theta[j];
+        }
+
+        return CLAMP(output, controller_get_out_min(), controller_get_out_max());
+}
+
+uint32_t mpc_get_regions_num(void)
+{
+        return MPC_REGIONS_NUM;
+}
+
+/*
+ * Measure the cycles of a region search that has to test every row of every region, which is an
+ * upper bound of the search in mpc_update().
+ */
+uint32_t mpc_measure_worst_case(void)
+{
+        static const float theta[MPC_PARAMS_NUM] = {0.0f};
+        volatile uint32_t rows_passed            = 0U;
+
+        uint32_t start = dwt_get_cycles();
+        for (size_t r = 0; r < MPC_REGIONS_NUM; r++)
+        {
+                const struct mpc_region *region = &mpc_regions[r];
+
+                for (size_t i = 0; i < region->rows_num; i++)
+                {
+                        float lhs = 0.0f;
+                        for (size_t j = 0; j < MPC_PARAMS_NUM; j++)
+                        {
+                                lhs += region->H[i][j] * theta[j];
+                        }
+                        if (lhs <= region->k[i] + MPC_TOLERANCE)
+                        {
+                                rows_passed++;
+                        }
+                }
+        }
+
+        return dwt_get_cycles() - start;
+}
+
+static const struct mpc_region *mpc_find_region(const float theta[MPC_PARAMS_NUM])
+{
+        for (size_t r = 0; r < MPC_REGIONS_NUM; r++)
+        {
+                const struct mpc_region *region = &mpc_regions[r];
+                bool inside                     = true;
+
+                for (size_t i = 0; i < region->rows_num && inside; i++)
+                {
+                        float lhs = 0.0f;
+                        for (size_t j = 0; j < MPC_PARAMS_NUM; j++)
+                        {
+                                lhs += region->H[i][j] * theta[j];
+                        }
+                        inside = (lhs <= region->k[i] + MPC_TOLERANCE);
+                }
+
+                if (inside)
+                {
+                        return region;
+                }
+        }
+
+        return NULL;
+}
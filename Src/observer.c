@@ -0,0 +1,78 @@
+/*
+ * observer.c
+ *
+ * Description:
+ *     Steady-state Kalman filter (current estimator form) for the converter state vector.
+ *
+ *     Implements:
+ *         x[k|k]   = x[k|k-1] + M*(y[k] - Cd*x[k|k-1])
+ *         x[k+1|k] = Ad*x[k|k] + Bd*u[k]
+ *
+ * Notes:
+ *     - The observer runs only from the plant input u and output y, so state-feedback controllers
+ *       never read the plant state directly.
+ *     - observer_correct() must be called once per step before the control law is evaluated, and
+ *       observer_predict() once per step after the plant input is known.
+ *     - The gain M is computed on the host by Tools/lqr_design.py from the same Ad, Bd and Cd.
+ */
+
+#include <stddef.h>
+
+#include "observer.h"
+
+#include "converter.h"
+
+// clang-format off
+// Generated by Tools/lqr_design.py (observer spectral radius 0.8235).
+static const float observer_M[STATES_NUM] = { 0.168331f,  0.420020f,  0.075577f,  0.478194f,
+                                               0.051612f,  0.583495f};
+// clang-format on
+
+static float x_hat[STATES_NUM];
+
+void observer_reset(void)
+{
+        for (size_t i = 0; i < STATES_NUM; i++)
+                x_hat[i] = 0.0f;
+}
+
+// Apply the measurement update and return the filtered state estimate x[k|k].
+const float *observer_correct(float measurement)
+{
+        float innovation = measurement;
+
+        for (size_t j = 0; j < STATES_NUM; j++)
+        {
+                innovation -= converter_Cd[0][j] * x_hat[j];
+        }
+
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                x_hat[i] += observer_M[i] * innovation;
+        }
+
+        return x_hat;
+}
+
+// Propagate the filtered estimate one step ahead with the input that was applied to the plant.
+void observer_predict(float input)
+{
+        float x_next[STATES_NUM];
+
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                float result = converter_Bd[i][0] * input;
+
+                for (size_t j = 0; j < STATES_NUM; j++)
+                {
+                        result += converter_Ad[i][j] * x_hat[j];
+                }
+
+                x_next[i] = result;
+        }
+
+        for (size_t i = 0; i < STATES_NUM; i++)
+        {
+                x_hat[i] = x_next[i];
+        }
+}
@@ -0,0 +1,210 @@
+/*
+ * pid_q31.c
+ *
+ * Description:
+ *     Fixed-point version of the discrete-time PID controller, using the saturating arithmetic of
+ *     the Cortex-M4 DSP extension (QADD/QSUB, SMULL/SMLAL).
+ *
+ *     Each signal has its own Q format:
+ *     - Voltages (reference, measurement, error, integral and output) are Q31 with a full scale of
+ *       PID_Q31_VOLTAGE_FS, so 1.0 (2^31) is 128 V.
+ *     - kp and kd/Ts are Q8.23 (range +-256).
+ *     - ki*Ts is Q0.31 (range +-1).
+ *
+ *     The proportional and derivative products are accumulated in 64 bits (SMULL followed by
+ *     SMLAL) and saturated once. The integral and the output sum use QADD.
+ *
+ * Notes:
+ *     - Every overflow saturates at the edge of the Q range instead of wrapping, so the result of
+ *       an overflow is the same every time. The error and its difference saturate at +-128 V.
+ *     - Products are truncated towards minus infinity (arithmetic shift).
+ *     - kp and kd/Ts saturate at +-INT32_MAX (not INT32_MIN), so the 64-bit sum of the two
+ *       products cannot overflow.
+ *     - Tools/pid_q31_ref.py is an integer reference model of this file. Tools/pid_q31_test.py
+ *       builds it on the host (Tools/host) and checks it against the model bit for bit.
+ *     - The limits and the user gains are converted to Q format once, when they are set. The
+ *       scheduled gains of pid_q31_step() are converted on every call.
+ *     - A gain outside its Q format would be saturated, so the loop would run with a different
+ *       gain. pid_q31_gains_fit() checks the gains and the setters in controller.c reject the ones
+ *       that do not fit (|kp| < 256, |ki| < 1/Ts, |kd| < 256*Ts).
+ *     - controller.c uses this controller instead of the float one when PID_FIXED_POINT is 1.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "stm32f4xx.h"
+
+#include "pid_q31.h"
+
+#include "utils.h"
+
+#define PID_Q31_VOLTAGE_FS 128.0f        // Voltage represented by 1.0 in Q31
+#define PID_Q31_GAIN_FS    256.0f        // Gain represented by 1.0 in Q8.23
+#define PID_Q31_GAIN_SHIFT 23            // Fractional bits of a Q8.23 gain
+#define PID_Q31_ONE        2147483648.0f // 2^31
+
+struct pid_q31_gains
+{
+        q31_t kp;    // Q8.23
+        q31_t ki_ts; // Q0.31
+        q31_t kd_ts; // Q8.23
+};
+
+struct pid_q31_controller
+{
+        struct pid_q31_gains gains;
+        float Ts;
+        q31_t prev_error;
+        q31_t integral;
+        q31_t int_out_min;
+        q31_t int_out_max;
+        q31_t controller_out_min;
+        q31_t controller_out_max;
+};
+
+static struct pid_q31_controller pid_q31;
+
+static q31_t pid_q31_run(const struct pid_q31_gains *gains, q31_t reference, q31_t measurement);
+static struct pid_q31_gains pid_q31_convert_gains(float kp, float ki, float kd);
+static q31_t pid_q31_from_float(float value, float full_scale);
+static q31_t pid_q31_saturate(int64_t value);
+
+void pid_q31_init(float Ts,
+                  float int_out_min,
+                  float int_out_max,
+                  float controller_out_min,
+                  float controller_out_max)
+{
+        pid_q31.Ts                 = Ts;
+        pid_q31.int_out_min        = pid_q31_from_float(int_out_min, PID_Q31_VOLTAGE_FS);
+        pid_q31.int_out_max        = pid_q31_from_float(int_out_max, PID_Q31_VOLTAGE_FS);
+        pid_q31.controller_out_min = pid_q31_from_float(controller_out_min, PID_Q31_VOLTAGE_FS);
+        pid_q31.controller_out_max = pid_q31_from_float(controller_out_max, PID_Q31_VOLTAGE_FS);
+
+        pid_q31_reset();
+}
+
+void pid_q31_set_gains(float kp, float ki, float kd)
+{
+        pid_q31.gains = pid_q31_convert_gains(kp, ki, kd);
+}
+
+// True if the gains are inside the range of their Q formats.
+bool pid_q31_gains_fit(float kp, float ki, float kd)
+{
+        float kp_max, ki_max, kd_max;
+
+        pid_q31_get_gain_limits(&kp_max, &ki_max, &kd_max);
+
+        return ABS_FLOAT(kp) < kp_max && ABS_FLOAT(ki) < ki_max && ABS_FLOAT(kd) < kd_max;
+}
+
+// Largest magnitudes of the gains (exclusive) for the sampling time of the controller.
+void pid_q31_get_gain_limits(float *kp_max, float *ki_max, float *kd_max)
+{
+        *kp_max = PID_Q31_GAIN_FS;
+        *ki_max = 1.0f / pid_q31.Ts;
+        *kd_max = PID_Q31_GAIN_FS * pid_q31.Ts;
+}
+
+void pid_q31_reset(void)
+{
+        pid_q31.integral   = 0;
+        pid_q31.prev_error = 0;
+}
+
+float pid_q31_update(float reference, float measurement)
+{
+        q31_t output = pid_q31_run(&pid_q31.gains,
+                                   pid_q31_from_float(reference, PID_Q31_VOLTAGE_FS),
+                                   pid_q31_from_float(measurement, PID_Q31_VOLTAGE_FS));
+
+        return (float)output * (PID_Q31_VOLTAGE_FS / PID_Q31_ONE);
+}
+
+// One step with the given gains (the scheduled gains).
+float pid_q31_step(float kp, float ki, float kd, float reference, float measurement)
+{
+        struct pid_q31_gains gains = pid_q31_convert_gains(kp, ki, kd);
+
+        q31_t output = pid_q31_run(&gains,
+                                   pid_q31_from_float(reference, PID_Q31_VOLTAGE_FS),
+                                   pid_q31_from_float(measurement, PID_Q31_VOLTAGE_FS));
+
+        return (float)output * (PID_Q31_VOLTAGE_FS / PID_Q31_ONE);
+}
+
+static q31_t pid_q31_run(const struct pid_q31_gains *gains, q31_t reference, q31_t measurement)
+{
+        // Compute error.
+        q31_t error = __QSUB(reference, measurement);
+
+        // Integral term: Q0.31 * Q31 shifted by 31 stays inside Q31 except for -1 * -1.
+        q31_t integral_step = pid_q31_saturate(((int64_t)gains->ki_ts * error) >> 31);
+        pid_q31.integral    = __QADD(pid_q31.integral, integral_step);
+
+        // limit integral term to avoid windup.
+        pid_q31.integral = CLAMP(pid_q31.integral, pid_q31.int_out_min, pid_q31.int_out_max);
+
+        // Proportional and derivative terms share the Q8.23 gain format, so they are summed in 64
+        // bits and saturated once.
+        int64_t accumulator = (int64_t)gains->kp * error;
+        accumulator += (int64_t)gains->kd_ts * __QSUB(error, pid_q31.prev_error);
+        q31_t pd = pid_q31_saturate(accumulator >> PID_Q31_GAIN_SHIFT);
+
+        // Calculate PID controller output and apply output saturation.
+        q31_t output = __QADD(pd, pid_q31.integral);
+        output       = CLAMP(output, pid_q31.controller_out_min, pid_q31.controller_out_max);
+
+        // Save state for next call.
+        pid_q31.prev_error = error;
+
+        return output;
+}
+
+static struct pid_q31_gains pid_q31_convert_gains(float kp, float ki, float kd)
+{
+        struct pid_q31_gains gains = {
+                .kp    = pid_q31_from_float(kp, PID_Q31_GAIN_FS),
+                .ki_ts = pid_q31_from_float(ki * pid_q31.Ts, 1.0f),
+                .kd_ts = pid_q31_from_float(kd / pid_q31.Ts, PID_Q31_GAIN_FS),
+        };
+
+        // kp * error + kd_ts * difference overflows 64 bits only if both gains are INT32_MIN.
+        gains.kp    = CLAMP(gains.kp, -INT32_MAX, INT32_MAX);
+        gains.kd_ts = CLAMP(gains.kd_ts, -INT32_MAX, INT32_MAX);
+
+        return gains;
+}
+
+// value / full_scale in Q31, saturated (C leaves out-of-range float to integer undefined).
+static q31_t pid_q31_from_float(float value, float full_scale)
+{
+        float scaled = value * (PID_Q31_ONE / full_scale);
+
+        if (scaled >= PID_Q31_ONE)
+        {
+                return INT32_MAX;
+        }
+        if (scaled <= -PID_Q31_ONE)
+        {
+                return INT32_MIN;
+        }
+
+        return (q31_t)scaled;
+}
+
+static q31_t pid_q31_saturate(int64_t value)
+{
+        if (value > INT32_MAX)
+        {
+                return INT32_MAX;
+        }
+        if (value < INT32_MIN)
+        {
+                return INT32_MIN;
+        }
+
+        return (q31_t)value;
+}
@@ -0,0 +1,179 @@
+/*
+ * pq.c
+ *
+ * Description:
+ *     Power-quality analyzer of the inverter output voltage.
+ *
+ *     Every control step pq_update() accumulates, over one period of the reference:
+ *     - The sum of squares of the output voltage for the RMS value
+ *     - DFT bins of the fundamental and of the first PQ_ODD_HARMONICS odd harmonics
+ *
+ *     The window is synchronized to the reference phase: it closes when the phase wraps, so each
+ *     window is exactly one period and the bins need no leakage correction. At the wrap the bins
+ *     are turned into the RMS value, the fundamental amplitude and its amplitude and phase error
+ *     against the reference, the harmonic amplitudes and the THD, and the accumulators restart.
+ *
+ * Notes:
+ *     - No sample buffers are kept. The harmonic phasors e^(j*h*phase) are built from the
+ *       fundamental phasor by complex multiplication, so a step costs one sinf/cosf pair and a
+ *       few multiply-adds per harmonic.
+ *     - The first window starts at the first wrap after pq_reset(), so partial periods after a
+ *       mode or type change are never reported.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "pq.h"
+
+#include "controller.h"
+#include "terminal.h"
+#include "utils.h"
+
+#define PQ_BINS (PQ_ODD_HARMONICS + 1) // Fundamental + odd harmonics
+
+static bool pq_is_started = false; // A window has been opened at a phase wrap
+static float pq_last_phase;
+static uint32_t pq_samples;
+static float pq_square_sum;
+static float pq_bin_re[PQ_BINS]; // sum of y*sin(h*phase)
+static float pq_bin_im[PQ_BINS]; // sum of y*cos(h*phase)
+
+static struct pq_result pq_result;
+
+static void pq_close_window(void);
+static void pq_clear_window(void);
+
+void pq_reset(void)
+{
+        pq_is_started = false;
+        pq_last_phase = 0.0f;
+        pq_result     = (struct pq_result){0};
+}
+
+void pq_update(float phase, float measurement)
+{
+        // The reference phase only decreases when it wraps at the start of a new period.
+        bool wrapped  = phase < pq_last_phase;
+        pq_last_phase = phase;
+
+        if (wrapped)
+        {
+                if (pq_is_started)
+                {
+                        pq_close_window();
+                }
+                pq_clear_window();
+                pq_is_started = true;
+        }
+
+        if (!pq_is_started)
+        {
+                return;
+        }
+
+        pq_samples++;
+        pq_square_sum += measurement * measurement;
+
+        // Phasor of the fundamental and its square, which steps between odd harmonics.
+        float c  = cosf(phase);
+        float s  = sinf(phase);
+        float c2 = c * c - s * s;
+        float s2 = 2.0f * s * c;
+
+        for (int i = 0; i < PQ_BINS; i++)
+        {
+                pq_bin_re[i] += measurement * s;
+                pq_bin_im[i] += measurement * c;
+
+                // e^(j*(h+2)*phase) = e^(j*h*phase) * e^(j*2*phase)
+                float c_next = c * c2 - s * s2;
+                s            = s * c2 + c * s2;
+                c            = c_next;
+        }
+}
+
+struct pq_result pq_get(void)
+{
+        return pq_result;
+}
+
+void pq_print(void)
+{
+        if (pq_result.periods == 0U)
+        {
+                printf("  No complete period analyzed yet (inverter type in mod mode only).");
+                terminal_insert_new_line();
+                return;
+        }
+
+        printf("  Power Quality (last period of %lu)", (unsigned long)pq_result.periods);
+        terminal_insert_new_line();
+        printf("  RMS           : %.3f V", pq_result.rms);
+        terminal_insert_new_line();
+        printf("  fundamental   : %.3f V (error %+.3f V, %+.2f deg)",
+               pq_result.fundamental,
+               pq_result.amplitude_error,
+               pq_result.phase_error);
+        terminal_insert_new_line();
+        for (int i = 0; i < PQ_ODD_HARMONICS; i++)
+        {
+                printf("  harmonic %-5d: %.4f V", 2 * i + 3, pq_result.harmonics[i]);
+                terminal_insert_new_line();
+        }
+        printf("  THD           : %.3f %%", pq_result.thd);
+        terminal_insert_new_line();
+}
+
+static void pq_close_window(void)
+{
+        if (pq_samples == 0U)
+        {
+                return;
+        }
+
+        float scale = 2.0f / (float)pq_samples;
+
+        /*
+         * For y = a*sin(phase + phi): sum(y*sin) = n*a*cos(phi)/2 and sum(y*cos) = n*a*sin(phi)/2,
+         * so a = 2/n * |bin| and phi = atan2(im, re) relative to the reference sin(phase).
+         */
+        float fundamental = scale * sqrtf(pq_bin_re[0] * pq_bin_re[0] +
+                                          pq_bin_im[0] * pq_bin_im[0]);
+        float harmonic_square_sum = 0.0f;
+
+        for (int i = 1; i < PQ_BINS; i++)
+        {
+                float a = scale * sqrtf(pq_bin_re[i] * pq_bin_re[i] + pq_bin_im[i] * pq_bin_im[i]);
+                pq_result.harmonics[i - 1] = a;
+                harmonic_square_sum += a * a;
+        }
+
+        pq_result.periods++;
+        pq_result.rms             = sqrtf(pq_square_sum / (float)pq_samples);
+        pq_result.fundamental     = fundamental;
+        pq_result.amplitude_error = fundamental - ABS_FLOAT(pid_get_ref());
+        pq_result.phase_error     = atan2f(pq_bin_im[0], pq_bin_re[0]) * (180.0f / PI);
+        pq_result.thd = (fundamental > 0.0f) ? 100.0f * sqrtf(harmonic_square_sum) / fundamental
+                                             : 0.0f;
+
+        // A negative reference amplitude is a sine shifted by 180 degrees.
+        if (pid_get_ref() < 0.0f)
+        {
+                pq_result.phase_error += (pq_result.phase_error > 0.0f) ? -180.0f : 180.0f;
+        }
+}
+
+static void pq_clear_window(void)
+{
+        pq_samples    = 0U;
+        pq_square_sum = 0.0f;
+
+        for (int i = 0; i < PQ_BINS; i++)
+        {
+                pq_bin_re[i] = 0.0f;
+                pq_bin_im[i] = 0.0f;
+        }
+}
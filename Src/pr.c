@@ -0,0 +1,166 @@
+/*
+ * pr.c
+ *
+ * Description:
+ *     Proportional-resonant (PI + resonant) controller for the inverter type.
+ *
+ *     Implements:
+ *         u = kp*e + ki*integral(e) + kr * sum_h R_h(z)*e
+ *
+ *     where each resonator is the damped resonant term
+ *         R_h(s) = 2*wc*s / (s^2 + 2*wc*s + (h*w0)^2)
+ *     discretized with the Tustin transform pre-warped at h*w0, so the peak of unit gain sits
+ *     exactly at the harmonic frequency. Each resonator is one biquad (direct form II transposed).
+ *
+ * Notes:
+ *     - kp and ki are shared with the PID controller, kr is specific to this controller.
+ *     - The fundamental resonator (50 Hz) is always on. The 3rd, 5th and 7th harmonic resonators
+ *       can be enabled from the CLI.
+ *     - Coefficients are computed in double precision by pr_init(), because the poles are very
+ *       close to z = 1 at the 50 kHz model rate.
+ */
+
+#include <math.h>
+#include <stddef.h>
+
+#include "pr.h"
+
+#include "controller.h"
+#include "converter.h"
+#include "utils.h"
+
+#define PR_RESONATORS_NUM 4
+#define PR_OMEGA_C        10.0 // Resonator bandwidth in rad/s
+
+struct pr_biquad
+{
+        float b0;
+        float a1;
+        float a2;
+        float s1;
+        float s2;
+};
+
+// Harmonic order of each resonator (index 0 is the fundamental).
+static const uint8_t pr_harmonics[PR_RESONATORS_NUM] = {1U, 3U, 5U, 7U};
+
+static struct pr_biquad pr_resonators[PR_RESONATORS_NUM];
+static bool pr_enabled[PR_RESONATORS_NUM] = {true, false, false, false};
+static float pr_kr                        = 0.0f;
+static float pr_integral                  = 0.0f;
+
+static int pr_find_resonator(uint8_t harmonic);
+
+void pr_init(void)
+{
+        double Ts = 1.0 / SAMPLING_FREQUENCY;
+
+        for (size_t i = 0; i < PR_RESONATORS_NUM; i++)
+        {
+                double w0 = 2.0 * PI * SINE_FREQUENCY * pr_harmonics[i];
+                // Pre-warped Tustin constant: s = K * (z - 1) / (z + 1).
+                double K  = w0 / tan(w0 * Ts / 2.0);
+                double a0 = K * K + 2.0 * PR_OMEGA_C * K + w0 * w0;
+
+                // b1 is zero and b2 = -b0 for this resonator.
+                pr_resonators[i].b0 = (float)(2.0 * PR_OMEGA_C * K / a0);
+                pr_resonators[i].a1 = (float)(2.0 * (w0 * w0 - K * K) / a0);
+                pr_resonators[i].a2 = (float)((K * K - 2.0 * PR_OMEGA_C * K + w0 * w0) / a0);
+        }
+
+        pr_reset();
+}
+
+void pr_reset(void)
+{
+        pr_integral = 0.0f;
+
+        for (size_t i = 0; i < PR_RESONATORS_NUM; i++)
+        {
+                pr_resonators[i].s1 = 0.0f;
+                pr_resonators[i].s2 = 0.0f;
+        }
+}
+
+float pr_update(float reference, float measurement)
+{
+        float error = reference - measurement;
+        float res   = 0.0f;
+
+        for (size_t i = 0; i < PR_RESONATORS_NUM; i++)
+        {
+                if (pr_enabled[i])
+                {
+                        struct pr_biquad *bq = &pr_resonators[i];
+                        float out            = bq->b0 * error + bq->s1;
+
+                        bq->s1 = -bq->a1 * out + bq->s2;
+                        bq->s2 = -bq->b0 * error - bq->a2 * out;
+                        res += out;
+                }
+        }
+
+        float out_min = controller_get_out_min();
+        float out_max = controller_get_out_max();
+        float output  = pid_get_kp() * error + pr_integral + pr_kr * res;
+
+        // Integrate only while the output is not saturated to avoid windup.
+        if (output > out_min && output < out_max)
+        {
+                pr_integral += pid_get_ki() * error / SAMPLING_FREQUENCY;
+        }
+
+        return CLAMP(output, out_min, out_max);
+}
+
+void pr_set_kr(float kr)
+{
+        pr_kr = kr;
+}
+
+float pr_get_kr(void)
+{
+        return pr_kr;
+}
+
+// Enable or disable a harmonic resonator. Returns false if the harmonic is not available.
+bool pr_set_harmonic(uint8_t harmonic, bool enable)
+{
+        int i = pr_find_resonator(harmonic);
+
+        // The fundamental resonator cannot be disabled.
+        if (i <= 0)
+        {
+                return false;
+        }
+
+        if (enable && !pr_enabled[i])
+        {
+                // Start a newly enabled resonator from rest.
+                pr_resonators[i].s1 = 0.0f;
+                pr_resonators[i].s2 = 0.0f;
+        }
+        pr_enabled[i] = enable;
+
+        return true;
+}
+
+bool pr_harmonic_is_enabled(uint8_t harmonic)
+{
+        int i = pr_find_resonator(harmonic);
+
+        return (i >= 0) && pr_enabled[i];
+}
+
+static int pr_find_resonator(uint8_t harmonic)
+{
+        for (size_t i = 0; i < PR_RESONATORS_NUM; i++)
+        {
+                if (pr_harmonics[i] == harmonic)
+                {
+                        return (int)i;
+                }
+        }
+
+        return -1;
+}
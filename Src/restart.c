@@ -0,0 +1,225 @@
+/*
+ * restart.c
+ *
+ * Description:
+ *     Warm restart after a watchdog or software reset.
+ *
+ *     The print task saves the operating point every 200 ms into a CRC-guarded record in the
+ *     .noinit RAM section, which start-up does not clear:
+ *     - converter mode and type, controller type of each converter type,
+ *     - PID gains, resonant gain and reference,
+ *     - plant state, plant input and reference phase of the last control step.
+ *
+ *     restart_init() runs first in main(). It reads and clears the reset flags of RCC_CSR and
+ *     checks the record. After an IWDG, WWDG or software reset with a valid record the start-up
+ *     is warm: main() skips the startup menu and restart_resume() puts the saved operating point
+ *     back and re-enters the saved mode, so the loop is back in regulation a few milliseconds
+ *     after the reset instead of starting from zero state and zero gains.
+ *
+ * Notes:
+ *     - Power-on, brown-out and pin resets are always cold, RAM content is not trusted then.
+ *     - Controller internals (PID integrator, observer and resonator states) are not saved, they
+ *       restart from zero around the restored plant state.
+ *     - The plant state is only restored if the model order is still the one it was saved with.
+ *       A model loaded over UART is not kept, the built-in one is used after any reset. If the
+ *       built-in model is rejected, a saved mod mode resumes in idle mode.
+ *     - A debugger flash ends in a software reset, so the record left by the previous firmware
+ *       image can pass the CRC. The record carries a layout word (RESTART_VERSION and its size),
+ *       which must be raised whenever a field changes meaning, and every enum and the model order
+ *       are range-checked before they are used as indices. A record failing any check gives a
+ *       cold start.
+ *     - A fault that resets the device again right after resuming would otherwise loop forever.
+ *       After RESTART_WARM_MAX warm restarts that each ran less than RESTART_STABLE_MS, the next
+ *       start-up is cold.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "stm32f4xx.h"
+
+#include "restart.h"
+
+#include "cli.h"
+#include "controller.h"
+#include "converter.h"
+#include "model.h"
+#include "pr.h"
+#include "snapshot.h"
+#include "systick.h"
+#include "terminal.h"
+#include "utils.h"
+
+#define RESTART_MAGIC     0x57524D53UL // "WRMS"
+#define RESTART_VERSION   1UL          // Raise when the meaning of a record field changes
+#define RESTART_WARM_MAX  3UL          // Warm restarts in a row before a cold start
+#define RESTART_STABLE_MS 10000UL      // Run time after which the restart count is cleared
+
+#define RESTART_WARM_FLAGS (RCC_CSR_IWDGRSTF | RCC_CSR_WWDGRSTF | RCC_CSR_SFTRSTF)
+#define RESTART_COLD_FLAGS (RCC_CSR_PORRSTF | RCC_CSR_BORRSTF)
+
+// Operating point saved for a warm restart.
+struct restart_record
+{
+        uint32_t magic;
+        uint32_t layout;        // RESTART_LAYOUT of the firmware that wrote the record
+        uint32_t warm_restarts; // Warm restarts in a row that did not run RESTART_STABLE_MS
+        uint32_t mode;
+        uint32_t converter_type;
+        uint32_t controller_types[TYPES_NUM];
+        float kp;
+        float ki;
+        float kd;
+        float kr;
+        float ref;
+        float phase;
+        float u;
+        uint32_t states; // Model order of x
+        float x[MODEL_STATES_MAX];
+        uint32_t crc; // CRC-32 of all the preceding fields
+};
+
+#define RESTART_LAYOUT ((RESTART_VERSION << 16U) | (uint32_t)sizeof(struct restart_record))
+
+__attribute__((section(".noinit"))) static struct restart_record restart_record;
+
+static uint32_t restart_reset_flags = 0UL;
+static bool restart_warm            = false;
+
+static uint32_t restart_crc(const struct restart_record *record);
+static bool restart_record_is_sane(const struct restart_record *record);
+
+// Read and clear the reset cause and decide between cold and warm start-up (call first in main).
+void restart_init(void)
+{
+        restart_reset_flags = RCC->CSR;
+        RCC->CSR |= RCC_CSR_RMVF;
+
+        bool record_is_valid = (restart_record.magic == RESTART_MAGIC) &&
+                               (restart_record.layout == RESTART_LAYOUT) &&
+                               (restart_record.crc == restart_crc(&restart_record)) &&
+                               restart_record_is_sane(&restart_record);
+
+        restart_warm = record_is_valid && (restart_reset_flags & RESTART_WARM_FLAGS) != 0UL &&
+                       (restart_reset_flags & RESTART_COLD_FLAGS) == 0UL &&
+                       restart_record.warm_restarts < RESTART_WARM_MAX;
+
+        if (restart_warm)
+        {
+                restart_record.warm_restarts++;
+                restart_record.crc = restart_crc(&restart_record);
+        }
+        else
+        {
+                // Nothing is resumed from an old record, the first save writes a new one.
+                restart_record.magic         = 0UL;
+                restart_record.warm_restarts = 0UL;
+        }
+}
+
+bool restart_is_warm(void)
+{
+        return restart_warm;
+}
+
+// RCC_CSR reset flags read at start-up (RCC_CSR_xxxRSTF).
+uint32_t restart_get_reset_flags(void)
+{
+        return restart_reset_flags;
+}
+
+// Put the saved operating point back and re-enter the saved mode (warm start-up only).
+void restart_resume(void)
+{
+        const struct restart_record *record = &restart_record;
+
+        converter_set_type((converter_type_t)record->converter_type);
+        for (size_t i = 0; i < TYPES_NUM; i++)
+        {
+                controller_set_type((converter_type_t)i,
+                                    (controller_type_t)record->controller_types[i]);
+        }
+        pid_set_kp(record->kp);
+        pid_set_ki(record->ki);
+        pid_set_kd(record->kd);
+        pr_set_kr(record->kr);
+        pid_set_ref(record->ref);
+
+        // Without a plant model the loop cannot run, so a saved mod mode resumes in idle.
+        converter_mode_t mode = (converter_mode_t)record->mode;
+        if (mode == MOD && !model_is_available())
+        {
+                mode = IDLE;
+        }
+        converter_set_mode(mode);
+
+        if (mode == MOD && record->states == model_get_states())
+        {
+                converter_set_state(record->x);
+                converter_ref_phase = record->phase;
+                u[0][0]             = record->u;
+        }
+
+        printf("  Warm restart (reset #%lu in a row), resumed in %s mode.",
+               (unsigned long)record->warm_restarts,
+               modes[mode]);
+        terminal_insert_new_line();
+        terminal_print_arrow();
+}
+
+// Save the operating point (called every 200 ms by the print task, in thread mode).
+void restart_save(void)
+{
+        struct loop_snapshot sample = snapshot_read();
+        converter_type_t type       = converter_get_type();
+
+        restart_record.magic  = RESTART_MAGIC;
+        restart_record.layout = RESTART_LAYOUT;
+        if (systick_get_ticks() >= RESTART_STABLE_MS)
+        {
+                restart_record.warm_restarts = 0UL;
+        }
+        restart_record.mode           = converter_get_mode();
+        restart_record.converter_type = type;
+        for (size_t i = 0; i < TYPES_NUM; i++)
+        {
+                restart_record.controller_types[i] = controller_get_type((converter_type_t)i);
+        }
+        restart_record.kp     = pid_get_kp();
+        restart_record.ki     = pid_get_ki();
+        restart_record.kd     = pid_get_kd();
+        restart_record.kr     = pr_get_kr();
+        restart_record.ref    = pid_get_ref();
+        restart_record.phase  = sample.phase;
+        restart_record.u      = sample.u;
+        restart_record.states = model_get_states();
+        for (size_t i = 0; i < MODEL_STATES_MAX; i++)
+        {
+                restart_record.x[i] = sample.x[i];
+        }
+        restart_record.crc = restart_crc(&restart_record);
+}
+
+static uint32_t restart_crc(const struct restart_record *record)
+{
+        return crc32((const uint8_t *)record, offsetof(struct restart_record, crc));
+}
+
+// Range-check every field that is used as an enum or an index (the CRC only covers corruption).
+static bool restart_record_is_sane(const struct restart_record *record)
+{
+        if (record->mode >= MODES_NUM || record->converter_type >= TYPES_NUM ||
+            record->states > MODEL_STATES_MAX)
+        {
+                return false;
+        }
+        for (size_t i = 0; i < TYPES_NUM; i++)
+        {
+                if (record->controller_types[i] >= CONTROLLER_TYPES_NUM)
+                {
+                        return false;
+                }
+        }
+
+        return true;
+}
@@ -8,7 +8,7 @@ int _write(int file, char *ptr, int len)
 
         for (DataIdx = 0; DataIdx < len; DataIdx++)
         {
-                uart2_write_char_blocking(ptr[DataIdx]);
+                uart2_write_char(ptr[DataIdx]);
         }
         return len;
 }
\ No newline at end of file
@@ -1,3 +1,29 @@
+/*
+ * scheduler.c
+ *
+ * Description:
+ *     Prioritized cooperative scheduler driven by event queues.
+ *
+ *     Every task has a fixed-capacity event queue. Interrupt handlers post typed events (a
+ *     received byte, a timer tick number, a button edge) with a time stamp, and scheduler_run()
+ *     hands them to the tasks one at a time, always from the highest-priority queue that is not
+ *     empty. A task therefore waits at most for the one handler that is running when its event
+ *     arrives.
+ *
+ * Notes:
+ *     - The queues are lock-free with many producers and one consumer. A producer claims a slot
+ *       by advancing the head with compare-and-swap (LDREX/STREX), fills it and then publishes it
+ *       through the slot sequence number. Interrupt handlers of any priority can post to the same
+ *       queue, because a preempted claim is simply retried.
+ *     - Only scheduler_run() and scheduler_flush() consume, both from thread mode.
+ *     - A full queue drops the new event and counts it, events are never merged.
+ *     - Events are stamped with the microsecond time base when posted, and the longest wait until
+ *       their task runs is kept per queue.
+ *     - With SCHEDULER_CYCLIC set, scheduler_run() hands over to the cyclic executive, which
+ *       releases and dispatches the tasks from its static schedule table instead.
+ */
+
+#include <stdatomic.h>
 #include <stddef.h>
 
 #include "stm32f4xx.h"
@@ -5,50 +31,194 @@
 #include "scheduler.h"
 
 #include "cli.h"
-#include "iwdg.h"
+#include "cyclic.h"
+#include "supervisor.h"
 #include "systick.h"
+#include "timebase.h"
 #include "timer.h"
 
-#define TASKS_NUM 4
+typedef void (*task_handler)(const struct event *event);
+
+struct event_slot
+{
+        _Atomic uint32_t sequence; // Position + 1 when the event is ready, position when free
+        struct event event;
+};
+
+struct event_queue
+{
+        struct event_slot slots[SCHEDULER_QUEUE_CAPACITY];
+        _Atomic uint32_t head; // Next position to claim by producers
+        _Atomic uint32_t tail; // Next position to consume
+        _Atomic uint32_t posted;
+        _Atomic uint32_t dropped;
+        uint32_t max_depth;
+        uint32_t max_latency_us;
+};
+
+_Static_assert((SCHEDULER_QUEUE_CAPACITY & (SCHEDULER_QUEUE_CAPACITY - 1U)) == 0U,
+               "The queue capacity must be a power of two.");
 
-typedef void (*task_handler)(void);
+const char *const scheduler_queue_names[QUEUES_NUM] = {"loop", "uart", "button", "print"};
 
-_Atomic uint32_t ready_flag_word;
+static struct event_queue scheduler_queues[QUEUES_NUM];
+static task_handler task_arr[QUEUES_NUM];
 
-static task_handler task_arr[TASKS_NUM];
+static bool scheduler_take(struct event_queue *queue, struct event *event);
 
 void scheduler_init(void)
 {
         // Tasks ordered based on their priority (index 0 has the highest priority).
-        task_arr[0] = tim2_update_loop;
-        task_arr[1] = cli_process_rx_byte;
-        task_arr[2] = tim3_read_button;
-        task_arr[3] = systick_print_output;
+        task_arr[QUEUE_LOOP]   = tim2_update_loop;
+        task_arr[QUEUE_UART]   = cli_process_rx_byte;
+        task_arr[QUEUE_BUTTON] = timer_read_button;
+        task_arr[QUEUE_PRINT]  = systick_print_output;
+
+        for (size_t q = 0; q < QUEUES_NUM; q++)
+        {
+                for (uint32_t i = 0U; i < SCHEDULER_QUEUE_CAPACITY; i++)
+                {
+                        atomic_init(&scheduler_queues[q].slots[i].sequence, i);
+                }
+                atomic_init(&scheduler_queues[q].head, 0U);
+                atomic_init(&scheduler_queues[q].tail, 0U);
+                atomic_init(&scheduler_queues[q].posted, 0U);
+                atomic_init(&scheduler_queues[q].dropped, 0U);
+        }
 }
 
 // This function implements a prioritized scheduler.
 void scheduler_run(void)
 {
+        if (SCHEDULER_CYCLIC)
+        {
+                cyclic_run(); // This function never returns.
+        }
+
         for (;;)
         {
-                task_handler task = NULL;
-                for (uint8_t p = 0U; p < TASKS_NUM; p++) // p is task priority
+                for (uint8_t p = 0U; p < QUEUES_NUM; p++) // p is task priority
                 {
-                        __disable_irq();
-                        if (ready_flag_word & (1UL << p))
+                        if (scheduler_dispatch(p))
                         {
-                                ready_flag_word &= ~(1UL << p);
-                                __enable_irq();
+                                break;
+                        }
+                }
+                supervisor_check_in(SUPERVISOR_BACKGROUND);
+        }
+}
+
+// Run the task of a queue with its oldest event. Returns false if the queue was empty.
+bool scheduler_dispatch(scheduler_queue_t queue)
+{
+        struct event event;
+
+        if (!scheduler_take(&scheduler_queues[queue], &event))
+        {
+                return false;
+        }
 
-                                task = task_arr[p];
+        uint32_t latency_us = (uint32_t)(time_now_us() - event.time_us);
+        if (latency_us > scheduler_queues[queue].max_latency_us)
+        {
+                scheduler_queues[queue].max_latency_us = latency_us;
+        }
+
+        (*task_arr[queue])(&event);
+        return true;
+}
+
+// Post an event to a task (callable from any interrupt handler). Returns false if it was dropped.
+bool scheduler_post(scheduler_queue_t queue, const struct event *event)
+{
+        struct event_queue *q = &scheduler_queues[queue];
+        uint32_t position     = atomic_load_explicit(&q->head, memory_order_relaxed);
+        struct event_slot *slot;
+
+        for (;;)
+        {
+                slot               = &q->slots[position & (SCHEDULER_QUEUE_CAPACITY - 1U)];
+                uint32_t sequence  = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+                int32_t difference = (int32_t)(sequence - position);
+
+                if (difference == 0)
+                {
+                        // The slot is free, claim it (position is reloaded if another post won).
+                        if (atomic_compare_exchange_weak_explicit(&q->head,
+                                                                  &position,
+                                                                  position + 1U,
+                                                                  memory_order_relaxed,
+                                                                  memory_order_relaxed))
+                        {
                                 break;
                         }
-                        __enable_irq();
                 }
-                if (task != NULL)
+                else if (difference < 0)
                 {
-                        (*task)();
+                        // The slot still holds an event that was not consumed: the queue is full.
+                        atomic_fetch_add_explicit(&q->dropped, 1U, memory_order_relaxed);
+                        return false;
                 }
-                iwdg_pet_the_dog();
+                else
+                {
+                        position = atomic_load_explicit(&q->head, memory_order_relaxed);
+                }
+        }
+
+        slot->event = *event;
+        atomic_store_explicit(&slot->sequence, position + 1U, memory_order_release);
+
+        atomic_fetch_add_explicit(&q->posted, 1U, memory_order_relaxed);
+
+        // A preempting post may overwrite a larger depth here, it is only a statistic.
+        uint32_t depth = position + 1U - atomic_load_explicit(&q->tail, memory_order_relaxed);
+        if (depth > q->max_depth)
+        {
+                q->max_depth = depth;
         }
-}
\ No newline at end of file
+
+        return true;
+}
+
+// Discard the events waiting for a task (thread mode only).
+void scheduler_flush(scheduler_queue_t queue)
+{
+        struct event event;
+
+        while (scheduler_take(&scheduler_queues[queue], &event))
+        {
+        }
+}
+
+struct scheduler_queue_stats scheduler_get_queue_stats(scheduler_queue_t queue)
+{
+        struct event_queue *q = &scheduler_queues[queue];
+
+        return (struct scheduler_queue_stats){
+                .posted         = atomic_load_explicit(&q->posted, memory_order_relaxed),
+                .dropped        = atomic_load_explicit(&q->dropped, memory_order_relaxed),
+                .max_depth      = q->max_depth,
+                .max_latency_us = q->max_latency_us,
+        };
+}
+
+// Take the oldest event of a queue if it is ready (the single consumer side).
+static bool scheduler_take(struct event_queue *queue, struct event *event)
+{
+        uint32_t position       = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        struct event_slot *slot = &queue->slots[position & (SCHEDULER_QUEUE_CAPACITY - 1U)];
+        uint32_t sequence       = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+        if (sequence != position + 1U)
+        {
+                return false;
+        }
+
+        *event = slot->event;
+        atomic_store_explicit(&slot->sequence,
+                              position + SCHEDULER_QUEUE_CAPACITY,
+                              memory_order_release);
+        atomic_store_explicit(&queue->tail, position + 1U, memory_order_relaxed);
+
+        return true;
+}
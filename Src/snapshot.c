@@ -0,0 +1,79 @@
+/*
+ * snapshot.c
+ *
+ * Description:
+ *     Consistent per-step snapshot of the loop signals for readers outside the control loop
+ *     (stream output, status and telemetry).
+ *
+ *     The control step publishes one struct loop_snapshot at its end through a sequence lock:
+ *     - The writer makes the sequence odd, copies the sample, then makes the sequence even again.
+ *     - A reader copies the sample between two reads of the sequence and retries when the
+ *       sequence was odd or changed, so it never returns a mix of two steps.
+ *
+ *     Neither side disables interrupts or blocks the other; the writer never waits.
+ *
+ * Notes:
+ *     - There is one writer (the control loop). Readers must not preempt the writer, or they
+ *       would retry forever while it is halfway through a sample. Today all of them run as
+ *       cooperative tasks next to it, and a preempting control loop is always the writer side.
+ *     - The fences keep the compiler and the core from moving the sample copies outside the
+ *       sequence updates.
+ */
+
+#include <stdatomic.h>
+
+#include "snapshot.h"
+
+static _Atomic uint32_t snapshot_sequence = 0U;
+static volatile struct loop_snapshot snapshot_sample;
+
+void snapshot_publish(const struct loop_snapshot *sample)
+{
+        uint32_t sequence = atomic_load_explicit(&snapshot_sequence, memory_order_relaxed);
+
+        atomic_store_explicit(&snapshot_sequence, sequence + 1U, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+
+        snapshot_sample.tick     = sample->tick;
+        snapshot_sample.time_us  = sample->time_us;
+        snapshot_sample.setpoint = sample->setpoint;
+        snapshot_sample.ref      = sample->ref;
+        snapshot_sample.phase    = sample->phase;
+        snapshot_sample.u        = sample->u;
+        snapshot_sample.y        = sample->y;
+        for (int i = 0; i < MODEL_STATES_MAX; i++)
+        {
+                snapshot_sample.x[i] = sample->x[i];
+        }
+
+        atomic_store_explicit(&snapshot_sequence, sequence + 2U, memory_order_release);
+}
+
+struct loop_snapshot snapshot_read(void)
+{
+        struct loop_snapshot sample;
+        uint32_t before;
+        uint32_t after;
+
+        do
+        {
+                before = atomic_load_explicit(&snapshot_sequence, memory_order_acquire);
+
+                sample.tick     = snapshot_sample.tick;
+                sample.time_us  = snapshot_sample.time_us;
+                sample.setpoint = snapshot_sample.setpoint;
+                sample.ref      = snapshot_sample.ref;
+                sample.phase    = snapshot_sample.phase;
+                sample.u        = snapshot_sample.u;
+                sample.y        = snapshot_sample.y;
+                for (int i = 0; i < MODEL_STATES_MAX; i++)
+                {
+                        sample.x[i] = snapshot_sample.x[i];
+                }
+
+                atomic_thread_fence(memory_order_acquire);
+                after = atomic_load_explicit(&snapshot_sequence, memory_order_relaxed);
+        } while ((before & 1U) != 0U || before != after);
+
+        return sample;
+}
@@ -0,0 +1,273 @@
+/*
+ * supervisor.c
+ *
+ * Description:
+ *     Task-aware watchdog supervision.
+ *
+ *     The supervised tasks check in with supervisor_check_in(), which sets their bit in a
+ *     liveness bitmask. Every SUPERVISOR_PERIOD_MS a software timer collects the bitmask and
+ *     checks that every expected task checked in within its window. Only then are the IWDG and
+ *     the WWDG refreshed. A wedged or starved task therefore stops the refreshes and the device
+ *     is reset, while the old code kept petting the IWDG as long as the background loop ran.
+ *
+ *     The WWDG early wakeup interrupt fires one WWDG tick (about 0.65 ms) before its reset. It
+ *     stores the late tasks and the time since each task last checked in into a record in the
+ *     .noinit RAM section, which start-up does not clear. The next boot reports the record and
+ *     the "watchdog" command shows it.
+ *
+ * Notes:
+ *     - The control loop is only expected in mod mode. While a task is not expected its window
+ *       is kept restarted, so it gets a full window once it is expected again.
+ *     - The WWDG runs from PCLK1 / 4096 / 8 (about 1526 Hz at 50 MHz) and resets after 64 ticks
+ *       (about 42 ms, or 262 ms on the 8 MHz PCLK1 of the HSI clock fallback) without refresh.
+ *       The window is open (W = 0x7F), so early refreshes are fine.
+ *     - The IWDG (5 s) stays as the backstop for a stopped APB1 clock.
+ *     - A record with late = 0 means the supervisor timer itself stopped running (SysTick was
+ *       blocked), not one of the tasks.
+ *     - A handler stuck at interrupt priority 0 still ends in a WWDG reset, but the early wakeup
+ *       interrupt (also priority 0) cannot preempt it to write the record.
+ *     - The WWDG is stopped while the core is halted by the debugger.
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "stm32f4xx.h"
+
+#include "supervisor.h"
+
+#include "converter.h"
+#include "iwdg.h"
+#include "restart.h"
+#include "swtimer.h"
+#include "systick.h"
+#include "terminal.h"
+
+#define SUPERVISOR_PERIOD_MS     10UL          // Check-in collection and watchdog refresh period
+#define SUPERVISOR_RECORD_MAGIC  0x57444F47UL  // "WDOG"
+#define SUPERVISOR_WWDG_COUNTER  0x7FUL        // WWDG reload value (64 ticks before reset)
+#define SUPERVISOR_WWDG_WINDOW   0x7FUL        // Refresh allowed at any counter value
+#define SUPERVISOR_WWDG_PRESCALE (WWDG_CFR_WDGTB_0 | WWDG_CFR_WDGTB_1) // PCLK1 / 4096 / 8
+
+// Record of the last WWDG reset, kept in RAM that is not cleared at start-up.
+struct supervisor_record
+{
+        uint32_t magic;
+        uint32_t late;                         // Late tasks, one bit per supervisor_task_t
+        uint32_t time_ms;                      // SysTick time of the early wakeup
+        uint32_t age_ms[SUPERVISOR_TASKS_NUM]; // Time since each task last checked in
+        uint32_t late_inverted;                // ~late, to reject a record left by old firmware
+};
+
+static const char *const supervisor_task_names[SUPERVISOR_TASKS_NUM] = {"loop",
+                                                                        "button",
+                                                                        "print",
+                                                                        "background"};
+
+// Longest time allowed between two check-ins of each task.
+static const uint32_t supervisor_windows_ms[SUPERVISOR_TASKS_NUM] = {
+        1000UL, // loop: released every 5 ms, may wait for a long CLI command
+        100UL,  // button: polled every 20 ms
+        1000UL, // print: released every 200 ms, lowest priority
+        4500UL  // background: one scheduler iteration (a CLI command), as the old 5 s IWDG allowed
+};
+
+__attribute__((section(".noinit"))) static struct supervisor_record supervisor_record;
+
+static _Atomic uint32_t supervisor_check_ins = 0UL;
+static uint32_t supervisor_last_seen[SUPERVISOR_TASKS_NUM];
+static uint32_t supervisor_late = 0UL; // Tasks found late by the last check
+static struct swtimer supervisor_timer;
+
+// Copy of the record found at start-up and the reset flags of RCC_CSR (read by restart.c).
+static struct supervisor_record supervisor_last_reset;
+static bool supervisor_last_reset_valid = false;
+static uint32_t supervisor_reset_flags  = 0UL;
+
+static void supervisor_check(void);
+static bool supervisor_is_expected(supervisor_task_t task);
+static void supervisor_print_tasks(uint32_t tasks);
+
+// The WWDG early wakeup interrupt saves the state of the supervision just before the reset.
+void WWDG_IRQHandler(void)
+{
+        // Clear EWIF flag.
+        WWDG->SR = 0UL;
+
+        uint32_t now = systick_get_ticks();
+
+        supervisor_record.late    = supervisor_late;
+        supervisor_record.time_ms = now;
+        for (int i = 0; i < SUPERVISOR_TASKS_NUM; i++)
+        {
+                supervisor_record.age_ms[i] = now - supervisor_last_seen[i];
+        }
+        supervisor_record.late_inverted = ~supervisor_late;
+        supervisor_record.magic         = SUPERVISOR_RECORD_MAGIC;
+}
+
+// Report the last watchdog reset and start supervising (call last, after the tasks are set up).
+void supervisor_init(void)
+{
+        supervisor_reset_flags = restart_get_reset_flags();
+
+        supervisor_last_reset_valid =
+                (supervisor_record.magic == SUPERVISOR_RECORD_MAGIC) &&
+                (supervisor_record.late_inverted == ~supervisor_record.late) &&
+                (supervisor_reset_flags & RCC_CSR_WWDGRSTF) != 0UL;
+        supervisor_last_reset   = supervisor_record;
+        supervisor_record.magic = 0UL;
+
+        if (supervisor_last_reset_valid)
+        {
+                printf("  Last reset by the task watchdog, late: ");
+                supervisor_print_tasks(supervisor_last_reset.late);
+                terminal_insert_new_line();
+                terminal_print_arrow();
+        }
+
+        uint32_t now = systick_get_ticks();
+        for (int i = 0; i < SUPERVISOR_TASKS_NUM; i++)
+        {
+                supervisor_last_seen[i] = now;
+        }
+
+        // Stop the WWDG counter while the core is halted by the debugger.
+        DBGMCU->APB1FZ |= DBGMCU_APB1_FZ_DBG_WWDG_STOP;
+
+        // Enable clock for WWDG.
+        RCC->APB1ENR |= RCC_APB1ENR_WWDGEN;
+
+        // Set prescaler, window and early wakeup interrupt, then start the WWDG.
+        WWDG->CFR = SUPERVISOR_WWDG_PRESCALE | SUPERVISOR_WWDG_WINDOW | WWDG_CFR_EWI;
+        WWDG->SR  = 0UL;
+        WWDG->CR  = WWDG_CR_WDGA | SUPERVISOR_WWDG_COUNTER;
+
+        // Clear pending interrupt.
+        NVIC_ClearPendingIRQ(WWDG_IRQn);
+        // Set priority and enable WWDG interrupt in NVIC.
+        NVIC_SetPriority(WWDG_IRQn, 0);
+        NVIC_EnableIRQ(WWDG_IRQn);
+
+        swtimer_start(&supervisor_timer,
+                      supervisor_check,
+                      SUPERVISOR_PERIOD_MS,
+                      SUPERVISOR_PERIOD_MS);
+}
+
+// Report that a task made progress (callable from thread mode and from interrupt handlers).
+void supervisor_check_in(supervisor_task_t task)
+{
+        atomic_fetch_or_explicit(&supervisor_check_ins, 1UL << task, memory_order_relaxed);
+}
+
+void supervisor_print(void)
+{
+        uint32_t now = systick_get_ticks();
+
+        printf("  task         window [ms]   last check-in [ms ago]");
+        terminal_insert_new_line();
+        for (int i = 0; i < SUPERVISOR_TASKS_NUM; i++)
+        {
+                printf("  %-10s   %-11lu   ",
+                       supervisor_task_names[i],
+                       (unsigned long)supervisor_windows_ms[i]);
+                if (supervisor_is_expected(i))
+                {
+                        printf("%lu", (unsigned long)(now - supervisor_last_seen[i]));
+                }
+                else
+                {
+                        printf("not expected");
+                }
+                terminal_insert_new_line();
+        }
+
+        printf("  Reset flags at start-up:%s%s%s%s%s%s",
+               (supervisor_reset_flags & RCC_CSR_WWDGRSTF) ? " WWDG" : "",
+               (supervisor_reset_flags & RCC_CSR_IWDGRSTF) ? " IWDG" : "",
+               (supervisor_reset_flags & RCC_CSR_SFTRSTF) ? " software" : "",
+               (supervisor_reset_flags & RCC_CSR_PORRSTF) ? " power-on" : "",
+               (supervisor_reset_flags & RCC_CSR_BORRSTF) ? " brown-out" : "",
+               (supervisor_reset_flags & RCC_CSR_PINRSTF) ? " pin" : "");
+        terminal_insert_new_line();
+
+        if (supervisor_last_reset_valid)
+        {
+                printf("  Last watchdog reset at %lu ms, late: ",
+                       (unsigned long)supervisor_last_reset.time_ms);
+                supervisor_print_tasks(supervisor_last_reset.late);
+                terminal_insert_new_line();
+                for (int i = 0; i < SUPERVISOR_TASKS_NUM; i++)
+                {
+                        printf("    %-10s last check-in %lu ms before",
+                               supervisor_task_names[i],
+                               (unsigned long)supervisor_last_reset.age_ms[i]);
+                        terminal_insert_new_line();
+                }
+        }
+        else
+        {
+                printf("  No task watchdog reset recorded.");
+                terminal_insert_new_line();
+        }
+}
+
+/*
+ * Collect the check-ins and refresh the watchdogs if no expected task is late (called by the
+ * supervisor software timer in SysTick).
+ */
+static void supervisor_check(void)
+{
+        uint32_t check_ins = atomic_exchange(&supervisor_check_ins, 0UL);
+        uint32_t now       = systick_get_ticks();
+        uint32_t late      = 0UL;
+
+        for (int i = 0; i < SUPERVISOR_TASKS_NUM; i++)
+        {
+                if ((check_ins & (1UL << i)) != 0UL || !supervisor_is_expected(i))
+                {
+                        supervisor_last_seen[i] = now;
+                }
+                else if (now - supervisor_last_seen[i] > supervisor_windows_ms[i])
+                {
+                        late |= 1UL << i;
+                }
+        }
+
+        supervisor_late = late;
+
+        if (late == 0UL)
+        {
+                WWDG->CR = SUPERVISOR_WWDG_COUNTER;
+                iwdg_pet_the_dog();
+        }
+}
+
+static bool supervisor_is_expected(supervisor_task_t task)
+{
+        if (task == SUPERVISOR_LOOP)
+        {
+                return converter_get_mode() == MOD;
+        }
+
+        return true;
+}
+
+static void supervisor_print_tasks(uint32_t tasks)
+{
+        if (tasks == 0UL)
+        {
+                printf("none (the supervisor timer stopped)");
+                return;
+        }
+
+        for (int i = 0; i < SUPERVISOR_TASKS_NUM; i++)
+        {
+                if ((tasks & (1UL << i)) != 0UL)
+                {
+                        printf("%s ", supervisor_task_names[i]);
+                }
+        }
+}
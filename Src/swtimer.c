@@ -0,0 +1,217 @@
+/*
+ * swtimer.c
+ *
+ * Description:
+ *     Software timer service driven by SysTick.
+ *
+ *     Any number of one-shot or periodic timers share the 1 ms SysTick interrupt instead of each
+ *     needing its own hardware timer. The timers are kept in a hierarchical timing wheel of
+ *     SWTIMER_LEVELS levels with SWTIMER_SLOTS slots each:
+ *     - Level 0 holds the timers due in the next 64 ms, one slot per millisecond.
+ *     - Level n holds the later ones, one slot per 64^n ms. When level 0 wraps, the next slot of
+ *       level 1 is cascaded, i.e. its timers are sorted again into the lower levels (and so on up
+ *       the levels), so a timer reaches level 0 shortly before it expires.
+ *     Starting and cancelling a timer is O(1): it is linked into or out of a single slot list. A
+ *     tick runs the timers of one level 0 slot, plus a cascade once every 64 ms.
+ *
+ * Notes:
+ *     - Wheel time counts milliseconds in 64 bits, so it does not wrap in the lifetime of the
+ *       device. Timers further away than 2^24 ms (about 4.6 h) wait in the last level and are
+ *       sorted again when their slot is cascaded.
+ *     - A periodic timer is re-armed from its expiry time, not from the time its callback ran, so
+ *       it does not drift.
+ *     - Callbacks run in the SysTick interrupt with the timer already re-armed or stopped, so
+ *       they may start or cancel any timer, including their own.
+ *     - Timers can be started and cancelled from thread mode or from SysTick callbacks. The slot
+ *       lists are edited with interrupts masked for a few instructions.
+ */
+
+#include <stddef.h>
+
+#include "stm32f4xx.h"
+
+#include "swtimer.h"
+
+#define SWTIMER_LEVELS    4U
+#define SWTIMER_SLOT_BITS 6U
+#define SWTIMER_SLOTS     (1U << SWTIMER_SLOT_BITS)
+#define SWTIMER_SLOT_MASK (SWTIMER_SLOTS - 1U)
+#define SWTIMER_MAX_DELAY ((1ULL << (SWTIMER_LEVELS * SWTIMER_SLOT_BITS)) - 1ULL)
+
+static struct swtimer *swtimer_wheel[SWTIMER_LEVELS][SWTIMER_SLOTS];
+
+// Wheel time in ms, the last tick that was processed. Only SysTick writes it.
+static volatile uint64_t swtimer_time = 0ULL;
+
+static void swtimer_insert(struct swtimer *timer);
+static void swtimer_unlink(struct swtimer *timer);
+static void swtimer_cascade(uint32_t level, uint32_t index);
+static uint32_t swtimer_lock(void);
+static void swtimer_unlock(uint32_t primask);
+
+// Advance the wheel by 1 ms and run the expired timers (called by SysTick_Handler).
+void swtimer_tick(void)
+{
+        uint64_t time = swtimer_time + 1ULL;
+        swtimer_time  = time;
+
+        // Level n is cascaded when all the levels below it have wrapped to slot 0.
+        for (uint32_t level = 1U; level < SWTIMER_LEVELS; level++)
+        {
+                if (((time >> (SWTIMER_SLOT_BITS * (level - 1U))) & SWTIMER_SLOT_MASK) != 0U)
+                {
+                        break;
+                }
+                swtimer_cascade(level, (time >> (SWTIMER_SLOT_BITS * level)) & SWTIMER_SLOT_MASK);
+        }
+
+        struct swtimer **slot = &swtimer_wheel[0][time & SWTIMER_SLOT_MASK];
+        struct swtimer *timer;
+
+        while ((timer = *slot) != NULL)
+        {
+                swtimer_unlink(timer);
+                if (timer->period_ms != 0U)
+                {
+                        timer->expiry_ms += timer->period_ms;
+                        swtimer_insert(timer);
+                }
+
+                if (timer->callback != NULL)
+                {
+                        timer->callback();
+                }
+        }
+}
+
+// Milliseconds since start-up (64-bit, never wraps).
+uint64_t swtimer_now_ms(void)
+{
+        uint32_t primask = swtimer_lock();
+        uint64_t time    = swtimer_time;
+        swtimer_unlock(primask);
+
+        return time;
+}
+
+/*
+ * Start (or restart) a timer. It fires delay_ms from now (on the next tick if delay_ms is 0) and
+ * then every period_ms, or only once if period_ms is 0.
+ */
+void swtimer_start(struct swtimer *timer,
+                   swtimer_callback_t callback,
+                   uint32_t delay_ms,
+                   uint32_t period_ms)
+{
+        uint32_t primask = swtimer_lock();
+
+        if (timer->pprev != NULL)
+        {
+                swtimer_unlink(timer);
+        }
+
+        timer->callback  = callback;
+        timer->period_ms = period_ms;
+        timer->expiry_ms = swtimer_time + ((delay_ms != 0U) ? delay_ms : 1U);
+        swtimer_insert(timer);
+
+        swtimer_unlock(primask);
+}
+
+// Stop a timer. Cancelling a stopped timer does nothing.
+void swtimer_cancel(struct swtimer *timer)
+{
+        uint32_t primask = swtimer_lock();
+
+        if (timer->pprev != NULL)
+        {
+                swtimer_unlink(timer);
+        }
+
+        swtimer_unlock(primask);
+}
+
+// A one-shot timer stays active until it fires, a periodic one until it is cancelled.
+bool swtimer_is_active(const struct swtimer *timer)
+{
+        return timer->pprev != NULL;
+}
+
+/*
+ * Link a timer into the slot of its expiry time. Interrupts must be masked (or in SysTick). The
+ * expiry is never in the past: a cascaded timer due now lands in the level 0 slot that is run
+ * right after the cascade.
+ */
+static void swtimer_insert(struct swtimer *timer)
+{
+        uint64_t time   = swtimer_time;
+        uint64_t expiry = timer->expiry_ms;
+
+        if (expiry - time > SWTIMER_MAX_DELAY)
+        {
+                // Beyond the wheel: park it in the last level, it is sorted again when cascaded.
+                expiry = time + SWTIMER_MAX_DELAY;
+        }
+
+        uint32_t level = 0U;
+        while (level < SWTIMER_LEVELS - 1U &&
+               expiry - time >= (1ULL << (SWTIMER_SLOT_BITS * (level + 1U))))
+        {
+                level++;
+        }
+
+        struct swtimer **slot =
+                &swtimer_wheel[level][(expiry >> (SWTIMER_SLOT_BITS * level)) & SWTIMER_SLOT_MASK];
+
+        timer->next = *slot;
+        if (*slot != NULL)
+        {
+                (*slot)->pprev = &timer->next;
+        }
+        *slot        = timer;
+        timer->pprev = slot;
+}
+
+static void swtimer_unlink(struct swtimer *timer)
+{
+        *timer->pprev = timer->next;
+        if (timer->next != NULL)
+        {
+                timer->next->pprev = timer->pprev;
+        }
+
+        timer->next  = NULL;
+        timer->pprev = NULL;
+}
+
+// Sort the timers of one slot of a higher level again into the levels below it.
+static void swtimer_cascade(uint32_t level, uint32_t index)
+{
+        struct swtimer *timer = swtimer_wheel[level][index];
+
+        swtimer_wheel[level][index] = NULL;
+
+        while (timer != NULL)
+        {
+                struct swtimer *next = timer->next;
+
+                timer->next  = NULL;
+                timer->pprev = NULL;
+                swtimer_insert(timer);
+
+                timer = next;
+        }
+}
+
+static uint32_t swtimer_lock(void)
+{
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+
+        return primask;
+}
+
+static void swtimer_unlock(uint32_t primask)
+{
+        __set_PRIMASK(primask);
+}
@@ -0,0 +1,212 @@
+/*
+ * sysid.c
+ *
+ * Description:
+ *     Online identification of the plant with recursive least squares (RLS).
+ *
+ *     The plant is modeled in ARX form
+ *         y[k] = -a1*y[k-1] - ... - a_na*y[k-na] + b1*u[k-1] + ... + b_nb*u[k-nb] + e[k]
+ *     and every control step sysid_update() does one RLS step with forgetting factor lambda on
+ *     the regressor phi = [-y[k-1] ... -y[k-na], u[k-1] ... u[k-nb]]:
+ *         e     = y[k] - phi' * theta            (a priori prediction error)
+ *         g     = P * phi / (lambda + phi' * P * phi)
+ *         theta = theta + g * e
+ *         P     = (P - g * phi' * P) / lambda
+ *
+ * Notes:
+ *     - The sizes are fixed at compile time (SYSID_PARAMS parameters), so a step always costs the
+ *       same O(SYSID_PARAMS^2) multiply-adds. Only the upper triangle of P is updated and
+ *       mirrored, which keeps P symmetric in float arithmetic.
+ *     - Forgetting is suspended while the trace of P is above SYSID_TRACE_MAX. Without excitation
+ *       (constant reference in steady state) P would otherwise grow without bound.
+ *     - The fit compares the exponentially weighted RMS of the prediction error with the RMS of
+ *       the output variation around its mean, with the same forgetting factor.
+ *     - The estimate is only as good as the excitation. A reference step, the inverter sine or an
+ *       "fra" sweep running at the same time all help.
+ */
+
+#include <math.h>
+#include <stdio.h>
+
+#include "sysid.h"
+
+#include "terminal.h"
+#include "utils.h"
+
+#define SYSID_DEFAULT_LAMBDA 0.999f
+#define SYSID_P0             1000.0f // Initial covariance (weak prior on theta = 0)
+#define SYSID_TRACE_MAX      1.0e5f  // Above this trace of P forgetting is suspended
+
+static float sysid_lambda = SYSID_DEFAULT_LAMBDA;
+static float sysid_theta[SYSID_PARAMS];
+static float sysid_phi[SYSID_PARAMS];
+static float sysid_P[SYSID_PARAMS][SYSID_PARAMS];
+static uint32_t sysid_samples;
+
+// Exponentially weighted statistics for the fit
+static float sysid_error_power;
+static float sysid_output_mean;
+static float sysid_output_power;
+
+void sysid_reset(void)
+{
+        for (int i = 0; i < SYSID_PARAMS; i++)
+        {
+                sysid_theta[i] = 0.0f;
+                sysid_phi[i]   = 0.0f;
+
+                for (int j = 0; j < SYSID_PARAMS; j++)
+                {
+                        sysid_P[i][j] = (i == j) ? SYSID_P0 : 0.0f;
+                }
+        }
+
+        sysid_samples      = 0U;
+        sysid_error_power  = 0.0f;
+        sysid_output_mean  = 0.0f;
+        sysid_output_power = 0.0f;
+}
+
+void sysid_update(float input, float output)
+{
+        float Pphi[SYSID_PARAMS];
+        float denominator = 0.0f;
+        float prediction  = 0.0f;
+        float trace       = 0.0f;
+
+        // The input has driven the plant to this output, so it enters the regressor as u[k-1].
+        for (int i = SYSID_PARAMS - 1; i > SYSID_NA; i--)
+        {
+                sysid_phi[i] = sysid_phi[i - 1];
+        }
+        sysid_phi[SYSID_NA] = input;
+
+        // P * phi, phi' * P * phi and the a priori prediction.
+        for (int i = 0; i < SYSID_PARAMS; i++)
+        {
+                float sum = 0.0f;
+
+                for (int j = 0; j < SYSID_PARAMS; j++)
+                {
+                        sum += sysid_P[i][j] * sysid_phi[j];
+                }
+                Pphi[i] = sum;
+                denominator += sysid_phi[i] * sum;
+                prediction += sysid_phi[i] * sysid_theta[i];
+                trace += sysid_P[i][i];
+        }
+
+        float lambda = (trace > SYSID_TRACE_MAX) ? 1.0f : sysid_lambda;
+        float error  = output - prediction;
+
+        denominator += lambda;
+
+        // theta += g * e and P = (P - g * Pphi') / lambda on the upper triangle.
+        float inv_denominator = 1.0f / denominator;
+        float inv_lambda      = 1.0f / lambda;
+
+        for (int i = 0; i < SYSID_PARAMS; i++)
+        {
+                float g = Pphi[i] * inv_denominator;
+
+                sysid_theta[i] += g * error;
+
+                for (int j = i; j < SYSID_PARAMS; j++)
+                {
+                        float p       = (sysid_P[i][j] - g * Pphi[j]) * inv_lambda;
+                        sysid_P[i][j] = p;
+                        sysid_P[j][i] = p;
+                }
+        }
+
+        // Fit statistics with the same memory as the estimator.
+        float weight    = 1.0f - sysid_lambda;
+        float deviation = output - sysid_output_mean;
+
+        sysid_output_mean += weight * deviation;
+        sysid_output_power += weight * (deviation * deviation - sysid_output_power);
+        sysid_error_power += weight * (error * error - sysid_error_power);
+
+        // The output becomes y[k-1] of the next step.
+        for (int i = SYSID_NA - 1; i > 0; i--)
+        {
+                sysid_phi[i] = sysid_phi[i - 1];
+        }
+        sysid_phi[0] = -output;
+
+        sysid_samples++;
+}
+
+struct sysid_estimate sysid_get(void)
+{
+        struct sysid_estimate estimate;
+        float a_sum = 1.0f;
+        float b_sum = 0.0f;
+
+        estimate.samples = sysid_samples;
+        estimate.trace   = 0.0f;
+
+        for (int i = 0; i < SYSID_NA; i++)
+        {
+                estimate.a[i] = sysid_theta[i];
+                a_sum += sysid_theta[i];
+        }
+        for (int i = 0; i < SYSID_NB; i++)
+        {
+                estimate.b[i] = sysid_theta[SYSID_NA + i];
+                b_sum += sysid_theta[SYSID_NA + i];
+        }
+        for (int i = 0; i < SYSID_PARAMS; i++)
+        {
+                estimate.trace += sysid_P[i][i];
+        }
+
+        estimate.dc_gain = (ABS_FLOAT(a_sum) > 1.0e-6f) ? b_sum / a_sum : 0.0f;
+        estimate.fit     = (sysid_output_power > 0.0f)
+                                   ? 100.0f * (1.0f - sqrtf(sysid_error_power / sysid_output_power))
+                                   : 0.0f;
+
+        return estimate;
+}
+
+float sysid_get_lambda(void)
+{
+        return sysid_lambda;
+}
+
+void sysid_set_lambda(float lambda)
+{
+        sysid_lambda = lambda;
+}
+
+void sysid_print(void)
+{
+        struct sysid_estimate estimate = sysid_get();
+
+        printf("  ARX(%d,%d) estimate, %lu samples, lambda %.4f",
+               SYSID_NA,
+               SYSID_NB,
+               (unsigned long)estimate.samples,
+               sysid_lambda);
+        terminal_insert_new_line();
+
+        printf("  a :");
+        for (int i = 0; i < SYSID_NA; i++)
+        {
+                printf(" %+.6f", estimate.a[i]);
+        }
+        terminal_insert_new_line();
+
+        printf("  b :");
+        for (int i = 0; i < SYSID_NB; i++)
+        {
+                printf(" %+.6f", estimate.b[i]);
+        }
+        terminal_insert_new_line();
+
+        printf("  fit %.2f %%, DC gain %.4f, trace(P) %.3g",
+               estimate.fit,
+               estimate.dc_gain,
+               estimate.trace);
+        terminal_insert_new_line();
+}
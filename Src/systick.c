@@ -8,24 +8,34 @@
  *     - Initialization of SysTick
  *     - A 1 ms system tick interrupt
  *     - An increasing tick counter with frequency of 1 kHz
+ *     - The base tick of the software timer wheel (swtimer.c), which releases the print task (or
+ *       the frames of the cyclic executive)
  */
-#include <math.h>
-#include <stdatomic.h>
 #include <stdio.h>
 
 #include "stm32f4xx.h"
 
 #include "systick.h"
 
+#include "boot.h"
 #include "cli.h"
 #include "clock.h"
-#include "controller.h"
-#include "converter.h"
+#include "cyclic.h"
+#include "fra.h"
+#include "health.h"
+#include "metrics.h"
+#include "model.h"
+#include "restart.h"
 #include "scheduler.h"
+#include "snapshot.h"
+#include "supervisor.h"
+#include "swtimer.h"
 #include "terminal.h"
+#include "timebase.h"
 
 // SysTick frequency in Hz
-#define SYSTICK_FREQUENCY 1000UL
+#define SYSTICK_FREQUENCY    1000UL
+#define SYSTICK_PRINT_PERIOD 200UL // Period of the print task in ms
 
 // systick_print_counter counts the printed lines in terminal, so we clean it after 100 prints.
 uint16_t systick_print_counter = 0U;
@@ -33,24 +43,18 @@ uint16_t systick_print_counter = 0U;
 // systick_ticks is incremented SYSTICK_FREQUENCY times every second in SysTick_Handler ISR.
 static volatile uint32_t systick_ticks = 0UL;
 
+// Releases the print task every 200 ms, or the frames of the cyclic executive.
+static struct swtimer systick_release_timer;
+
 /*
- * SysTick interrupt is used to print the output voltage of the converter when stream is on. Also it
- * keeps a tick that is used for locking UART from changing the mode for 5000ms after the mode was
- * changed by button.
+ * SysTick interrupt keeps the time stamp tick and drives the software timers (print period, button
+ * polling, UART lock after a mode change by button).
  */
 void SysTick_Handler(void)
 {
         systick_ticks++;
 
-        /*
-         * Every 200ms, add systick_print_output function to the scheduler so that it print the
-         * output voltage of the converter and reference value.
-         */
-        if (systick_ticks % 200UL == 0)
-        {
-                // Atomic modification of ready_flag_word to prevent race conditions.
-                atomic_fetch_or(&ready_flag_word, TASK3);
-        }
+        swtimer_tick();
 }
 
 void systick_init(void)
@@ -65,7 +69,7 @@ void systick_init(void)
         SysTick->CTRL |= SysTick_CTRL_CLKSOURCE_Msk;
 
         // Set reload value.
-        SysTick->LOAD = HCLK / SYSTICK_FREQUENCY - 1;
+        SysTick->LOAD = clock_get_hclk() / SYSTICK_FREQUENCY - 1;
 
         /*
          * Clear current value so it starts counting from LOAD immediately (SysTick is a 24-bit
@@ -73,31 +77,108 @@ void systick_init(void)
          */
         SysTick->VAL = 0U;
 
+        if (SCHEDULER_CYCLIC)
+        {
+                // SysTick is the base tick of the cyclic executive, which releases all tasks.
+                swtimer_start(&systick_release_timer,
+                              cyclic_release_frame,
+                              CYCLIC_MINOR_FRAME_MS,
+                              CYCLIC_MINOR_FRAME_MS);
+        }
+        else
+        {
+                /*
+                 * Every 200ms, release systick_print_output task so that it print the output
+                 * voltage of the converter and reference value.
+                 */
+                swtimer_start(&systick_release_timer,
+                              systick_release_print,
+                              SYSTICK_PRINT_PERIOD,
+                              SYSTICK_PRINT_PERIOD);
+        }
+
         // Enable SysTick timer.
         SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
 }
 
+/*
+ * Reload SysTick for a new HCLK without moving the tick (called by clock_set_profile() with
+ * interrupts masked). The counter missed lost_us during the clock switch, so the rest of the
+ * current tick is shortened by it.
+ */
+void systick_rescale(uint32_t lost_us)
+{
+        const int32_t period_us = 1000000L / SYSTICK_FREQUENCY;
+        uint32_t cycles_per_us  = clock_get_hclk() / 1000000UL;
+
+        // Time left until the next tick, counted with the old reload value.
+        int32_t left_us = (int32_t)((uint64_t)SysTick->VAL * period_us / (SysTick->LOAD + 1UL)) -
+                          (int32_t)lost_us;
+
+        if (left_us <= 0)
+        {
+                // The tick is overdue: take it now and shorten the next one.
+                SCB->ICSR = SCB_ICSR_PENDSTSET_Msk;
+                left_us += period_us;
+                if (left_us <= 0)
+                {
+                        left_us = 1;
+                }
+        }
+
+        /*
+         * Writing VAL clears the counter, which then reloads from LOAD on the next clock without
+         * a tick. Count the rest of the current tick first, then full ticks from the new LOAD.
+         */
+        SysTick->LOAD = (uint32_t)left_us * cycles_per_us - 1UL;
+        SysTick->VAL  = 0U;
+        while (SysTick->VAL == 0U)
+                ;
+        SysTick->LOAD = clock_get_hclk() / SYSTICK_FREQUENCY - 1;
+}
+
+// Post an event to the print task (called by SysTick, or by the cyclic executive).
+void systick_release_print(void)
+{
+        struct event event = {.type = EVENT_PRINT, .time_us = time_now_us()};
+        scheduler_post(QUEUE_PRINT, &event);
+}
+
 uint32_t systick_get_ticks(void)
 {
         return systick_ticks;
 }
 
-void systick_print_output(void)
+void systick_print_output(const struct event *event)
 {
+        supervisor_check_in(SUPERVISOR_PRINT);
+
+        // Keep the operating point for a warm restart after a watchdog reset.
+        restart_save();
+
+        // Send the startup menu if main left it for later (fast start).
+        boot_run_deferred();
+
+        // Frequency-response records are printed here so that the control loop never prints.
+        fra_print_records();
+
+        // Numerical faults of the control loop are reported here too.
+        health_print_events();
+
+        // Finish a model transfer over UART when all bytes are in (or it timed out).
+        model_receive_poll();
+
         if (cli_stream_is_on)
         {
-                converter_type_t converter_type = converter_get_type();
-
-                printf("  Output Voltage: %6.2f V, ", y[0][0]);
-                if (converter_type == DC_DC_IDEAL)
-                {
-                        printf("Reference Voltage: %6.2f V", pid_get_ref());
-                }
-                else
-                {
-                        printf("Reference Voltage: %6.2f V",
-                               pid_get_ref() * sinf(converter_ref_phase));
-                }
+                // Output and reference of the same control step.
+                struct loop_snapshot sample = snapshot_read();
+
+                printf("  [%lu.%06lu s] ",
+                       (unsigned long)(sample.time_us / 1000000ULL),
+                       (unsigned long)(sample.time_us % 1000000ULL));
+                printf("Output Voltage: %6.2f V, ", sample.y);
+                printf("Reference Voltage: %6.2f V", sample.ref);
+                printf(", IAE: %9.6f V*s", metrics_get().iae);
                 terminal_insert_new_line();
 
                 systick_print_counter++;
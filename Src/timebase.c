@@ -0,0 +1,113 @@
+/*
+ * timebase.c
+ *
+ * Description:
+ *     Free-running 64-bit microsecond time base.
+ *
+ *     TIM5 is a 32-bit timer counting at 1 MHz, so it wraps every 2^32 us (about 71.6 minutes).
+ *     Its update interrupt counts the wraps in timebase_high, the upper 32 bits of the time. The
+ *     time never wraps in practice (2^64 us is more than 500000 years).
+ *
+ * Notes:
+ *     - time_now_us() is lock-free and can be called from thread mode and from any interrupt
+ *       handler. It reads timebase_high, TIM5->CNT and the pending update flag, and retries only
+ *       when the wrap interrupt ran in between.
+ *     - A reader that runs while the wrap interrupt is pending (the reader has the same or higher
+ *       priority, or interrupts are masked) sees the update flag set. If the counter value it read
+ *       is in the lower half of the range, it was read after the wrap, so the reader adds the
+ *       missing wrap itself.
+ *     - TIM5 is clocked from APB1 like TIM2 (the APB1 timer clock is 100 MHz).
+ *       The prescaler is computed from the running clock, so the time base stays in us after
+ *       an HSI fallback.
+ */
+
+#include <stdbool.h>
+
+#include "stm32f4xx.h"
+
+#include "timebase.h"
+
+#include "clock.h"
+
+// Upper 32 bits of the time (wraps of TIM5 counted by its update interrupt).
+static volatile uint32_t timebase_high = 0UL;
+
+// TIM5 update event interrupt counts the wraps of the 32-bit counter.
+void TIM5_IRQHandler(void)
+{
+        // Clear UIF flag.
+        TIM5->SR &= ~TIM_SR_UIF;
+
+        timebase_high++;
+}
+
+void timebase_init(void)
+{
+        // Enable clock for TIM5.
+        RCC->APB1ENR |= RCC_APB1ENR_TIM5EN;
+
+        // Count at 1 MHz over the full 32-bit range.
+        TIM5->PSC = (clock_get_apb1_timer_clock() / TIMEBASE_FREQUENCY) - 1UL;
+        TIM5->ARR = 0xFFFFFFFFUL;
+
+        // Generate an update to load the prescaler, then clear the flag it sets.
+        TIM5->EGR |= TIM_EGR_UG;
+        TIM5->SR = 0;
+
+        // Enable update event interrupt.
+        TIM5->DIER |= TIM_DIER_UIE;
+
+        // Clear pending interrupt.
+        NVIC_ClearPendingIRQ(TIM5_IRQn);
+        // Set priority and enable TIM5 interrupt in NVIC.
+        NVIC_SetPriority(TIM5_IRQn, 0);
+        NVIC_EnableIRQ(TIM5_IRQn);
+
+        // Enable TIM5 counter.
+        TIM5->CR1 |= TIM_CR1_CEN;
+}
+
+/*
+ * Reload the TIM5 prescaler for a new clock (called by clock_set_profile() with interrupts
+ * masked). The counter missed lost_us during the clock switch, which is added back.
+ */
+void timebase_rescale(uint32_t lost_us)
+{
+        uint32_t count = TIM5->CNT;
+
+        // The prescaler is loaded by an update event, URS keeps it from counting as a wrap.
+        TIM5->CR1 |= TIM_CR1_URS;
+        TIM5->PSC = (clock_get_apb1_timer_clock() / TIMEBASE_FREQUENCY) - 1UL;
+        TIM5->EGR = TIM_EGR_UG;
+        TIM5->CNT = count + lost_us;
+        TIM5->CR1 &= ~TIM_CR1_URS;
+
+        // Adding the missed time wrapped the counter.
+        if (count + lost_us < count)
+        {
+                timebase_high++;
+        }
+}
+
+// Microseconds since timebase_init().
+uint64_t time_now_us(void)
+{
+        uint32_t high;
+        uint32_t low;
+        bool wrap_pending;
+
+        do
+        {
+                high         = timebase_high;
+                low          = TIM5->CNT;
+                wrap_pending = (TIM5->SR & TIM_SR_UIF) != 0U;
+        } while (high != timebase_high);
+
+        // The counter wrapped but the interrupt has not counted it yet.
+        if (wrap_pending && low < 0x80000000UL)
+        {
+                high++;
+        }
+
+        return ((uint64_t)high << 32U) | low;
+}
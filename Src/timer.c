@@ -6,17 +6,44 @@
 
 #include "timer.h"
 
+#include "boot.h"
 #include "cli.h"
 #include "clock.h"
 #include "controller.h"
 #include "converter.h"
+#include "fra.h"
 #include "gpio.h"
+#include "health.h"
+#include "metrics.h"
+#include "pq.h"
 #include "pwm.h"
 #include "scheduler.h"
+#include "snapshot.h"
+#include "supervisor.h"
+#include "swtimer.h"
+#include "sysid.h"
+#include "systick.h"
+#include "timebase.h"
 #include "utils.h"
 
-#define TIM2_CLK 10000UL // TIM2 clock frequency
-#define TIM3_CLK 10000UL // TIM3 clock frequency
+#define TIM2_CLK                   10000UL // TIM2 clock frequency
+#define TIM2_CATCHUP_DEFAULT_LIMIT 8UL     // Missed releases stepped per task run (step policy)
+
+const char *const tim2_catchup_policies[TIM2_CATCHUP_POLICIES_NUM] = {"skip", "step", "ff"};
+
+static uint32_t tim2_loop_tick = 0UL; // Control steps since start-up
+
+// Number of the last TIM2 release (counted by the interrupt) and of the last one served.
+static _Atomic uint32_t tim2_released = 0UL;
+static uint32_t tim2_served           = 0UL;
+static tim2_catchup_t tim2_catchup    = TIM2_CATCHUP_SKIP;
+static uint32_t tim2_catchup_limit    = TIM2_CATCHUP_DEFAULT_LIMIT;
+static struct tim2_catchup_stats tim2_catchup_stats;
+static struct swtimer button_poll_timer;
+
+static void tim2_loop_step(void);
+static void tim2_step_loop(float ref, float measurement);
+static void tim2_fast_forward(uint32_t steps);
 
 // TIM2 update event interrupt is used for updating the control loop and providing PWM for the LED.
 void TIM2_IRQHandler(void)
@@ -24,18 +51,41 @@ void TIM2_IRQHandler(void)
         // Clear UIF flag.
         TIM2->SR &= ~TIM_SR_UIF;
 
-        // Atomic modification of ready_flag_word to prevent race conditions.
-        atomic_fetch_or(&ready_flag_word, TASK0);
+        tim2_release();
 }
 
-// TIM3 update event interrupt is used for button debounce and command handling.
-void TIM3_IRQHandler(void)
+/*
+ * Release the control task once. Each release is numbered, so the control task knows how many it
+ * missed when it is late. Called by the TIM2 interrupt, or by the loop slots of the cyclic
+ * executive.
+ */
+void tim2_release(void)
 {
-        // Clear UIF flag.
-        TIM3->SR &= ~TIM_SR_UIF;
+        struct event event = {.type      = EVENT_TICK,
+                              .time_us   = time_now_us(),
+                              .data.tick = atomic_fetch_add(&tim2_released, 1UL) + 1UL};
+        scheduler_post(QUEUE_LOOP, &event);
+}
 
-        // Atomic modification of ready_flag_word to prevent race conditions.
-        atomic_fetch_or(&ready_flag_word, TASK2);
+/*
+ * Sample the button every 20 ms. Every change of the debounced button state is posted to the
+ * button task as an edge event. Called by the button software timer, or by the button slots of
+ * the cyclic executive.
+ */
+void timer_sample_button(void)
+{
+        supervisor_check_in(SUPERVISOR_BUTTON);
+
+        bool button_is_pressed = gpio_button_is_pressed();
+        if (button_is_pressed != button_last_push_status)
+        {
+                button_last_push_status = button_is_pressed;
+
+                struct event event = {.type         = EVENT_BUTTON,
+                                      .time_us      = time_now_us(),
+                                      .data.pressed = button_is_pressed};
+                scheduler_post(QUEUE_BUTTON, &event);
+        }
 }
 
 void tim2_init(uint32_t timer_freq)
@@ -45,12 +95,13 @@ void tim2_init(uint32_t timer_freq)
 
         /*
          * PCLK1 = HCLK / 2 = 50 MHz (max allowed on STM32F411).
-         * APB1 timer clock = 100 MHz (because APB1 prescaler = 2).
+         * APB1 timer clock = 100 MHz (because APB1 prescaler = 2), or 16 MHz if the clock fell
+         * back to HSI.
          * We want for timer 2 to run at frequency of TIM2_CLK = 10 kHz.
          */
 
         // Calculate the value of prescaler so timer 2 runs at 10 kHz.
-        uint32_t prescaler            = (APB1_TIM_CLK / TIM2_CLK) - 1UL;
+        uint32_t prescaler            = (clock_get_apb1_timer_clock() / TIM2_CLK) - 1UL;
         // Auto-reload register value.
         uint32_t auto_reload_register = (TIM2_CLK / timer_freq) - 1UL;
 
@@ -64,8 +115,11 @@ void tim2_init(uint32_t timer_freq)
         // Enable ARR preload (prescaler (PSC) is always buffered).
         TIM2->CR1 |= TIM_CR1_ARPE;
 
-        // Enable update event interrupt.
-        TIM2->DIER |= TIM_DIER_UIE;
+        // Enable update event interrupt (the cyclic executive releases the loop from its frames).
+        if (!SCHEDULER_CYCLIC)
+        {
+                TIM2->DIER |= TIM_DIER_UIE;
+        }
 
         // Generate an update first to load preloaded value.
         TIM2->EGR |= TIM_EGR_UG;
@@ -80,50 +134,154 @@ void tim2_init(uint32_t timer_freq)
         NVIC_DisableIRQ(TIM2_IRQn);
 }
 
-void tim3_init(uint32_t timer_freq)
+/*
+ * Reload the TIM2 prescaler for a new clock without moving the loop period (called by
+ * clock_set_profile() with interrupts masked). A running counter missed lost_us during the clock
+ * switch, which is added back.
+ */
+void tim2_rescale(uint32_t lost_us)
+{
+        uint32_t count = TIM2->CNT;
+
+        if (TIM2->CR1 & TIM_CR1_CEN)
+        {
+                count += lost_us / (1000000UL / TIM2_CLK);
+        }
+
+        // The prescaler is loaded by an update event, URS keeps it from releasing the loop.
+        TIM2->CR1 |= TIM_CR1_URS;
+        TIM2->PSC = (clock_get_apb1_timer_clock() / TIM2_CLK) - 1UL;
+        TIM2->EGR = TIM_EGR_UG;
+
+        // A period that ended during the switch ends on the next counter tick.
+        TIM2->CNT = (count < TIM2->ARR) ? count : TIM2->ARR;
+        TIM2->CR1 &= ~TIM_CR1_URS;
+}
+
+// Start polling the push-button on the software timer wheel (the cyclic executive polls it itself).
+void timer_button_init(void)
+{
+        if (!SCHEDULER_CYCLIC)
+        {
+                swtimer_start(&button_poll_timer,
+                              timer_sample_button,
+                              BUTTON_POLL_PERIOD_MS,
+                              BUTTON_POLL_PERIOD_MS);
+        }
+}
+
+/*
+ * Control task. It serves every TIM2 release counted since its last run: the missed ones (all but
+ * the last) with the catch-up policy, and the last one with a normal loop step. Releases whose
+ * tick events were dropped from a full queue are missed ones too.
+ */
+void tim2_update_loop(const struct event *event)
 {
-        // Enable clock for TIM3.
-        RCC->APB1ENR |= RCC_APB1ENR_TIM3EN;
+        supervisor_check_in(SUPERVISOR_LOOP);
+
+        // This release was served with a later one, or discarded by a mode change.
+        if ((int32_t)(event->data.tick - tim2_served) <= 0)
+        {
+                return;
+        }
+
+        uint32_t released = atomic_load(&tim2_released);
+        uint32_t releases = released - tim2_served;
+        uint32_t missed   = releases - 1UL;
+
+        tim2_served = released;
+
+        tim2_catchup_stats.releases += releases;
+        if (missed > tim2_catchup_stats.max_late)
+        {
+                tim2_catchup_stats.max_late = missed;
+        }
 
         /*
-         * PCLK1 = HCLK / 2 = 50 MHz (max allowed on STM32F411).
-         * APB1 timer clock = 100 MHz (because APB1 prescaler = 2).
-         * We want for timer 3 to run at frequency of TIM3_CLK = 10 kHz.
+         * Watch the floating-point exceptions from here on, so that the catch-up is checked too.
+         * health_check() at the end of each loop step clears them again for the next one.
          */
+        health_clear_flags();
 
-        // Calculate the value of prescaler so timer 3 runs at 10 kHz.
-        uint32_t prescaler            = (APB1_TIM_CLK / TIM3_CLK) - 1UL;
-        // Auto-reload register value.
-        uint32_t auto_reload_register = (TIM3_CLK / timer_freq) - 1UL;
+        switch (tim2_catchup)
+        {
+        case TIM2_CATCHUP_STEP:
+        {
+                uint32_t steps = (missed < tim2_catchup_limit) ? missed : tim2_catchup_limit;
+                uint32_t k;
 
-        // Set prescaler and auto-reload.
-        TIM3->PSC = prescaler;
-        TIM3->ARR = auto_reload_register;
+                // A step can leave mod mode (health monitor), then the loop must not go on.
+                for (k = 0UL; k < steps && converter_get_mode() == MOD; k++)
+                {
+                        tim2_loop_step();
+                }
+                tim2_catchup_stats.stepped += k;
+                tim2_catchup_stats.dropped += missed - k;
+                break;
+        }
+        case TIM2_CATCHUP_FAST_FORWARD:
+                if (missed != 0UL)
+                {
+                        tim2_fast_forward(missed);
+                        tim2_catchup_stats.forwarded += missed;
+                }
+                break;
+        case TIM2_CATCHUP_SKIP:
+        default:
+                tim2_catchup_stats.dropped += missed;
+                break;
+        }
 
-        // Enable ARR preload (prescaler (PSC) is always buffered).
-        TIM3->CR1 |= TIM_CR1_ARPE;
+        if (converter_get_mode() == MOD)
+        {
+                tim2_loop_step();
+        }
+}
 
-        // Enable update event interrupt.
-        TIM3->DIER |= TIM_DIER_UIE;
+/*
+ * Forget the pending releases and their tick events, so that the loop is not updated accidentally
+ * after coming out of mod mode.
+ */
+void tim2_clear_releases(void)
+{
+        scheduler_flush(QUEUE_LOOP);
+        tim2_served = atomic_load(&tim2_released);
+}
 
-        // Generate an update first to load preloaded value.
-        TIM3->EGR |= TIM_EGR_UG;
+tim2_catchup_t tim2_get_catchup(void)
+{
+        return tim2_catchup;
+}
 
-        // Clear pending flags.
-        TIM3->SR = 0;
+uint32_t tim2_get_catchup_limit(void)
+{
+        return tim2_catchup_limit;
+}
 
-        // Clear pending interrupt.
-        NVIC_ClearPendingIRQ(TIM3_IRQn);
-        // Set priority and enable TIM3 interrupt in NVIC.
-        NVIC_SetPriority(TIM3_IRQn, 2);
-        NVIC_EnableIRQ(TIM3_IRQn);
+void tim2_set_catchup(tim2_catchup_t policy, uint32_t limit)
+{
+        tim2_catchup       = policy;
+        tim2_catchup_limit = limit;
+}
 
-        // Enable TIM3 counter.
-        TIM3->CR1 |= TIM_CR1_CEN;
+struct tim2_catchup_stats tim2_get_catchup_stats(void)
+{
+        return tim2_catchup_stats;
 }
 
-void tim2_update_loop(void)
+void tim2_clear_catchup_stats(void)
 {
+        tim2_catchup_stats = (struct tim2_catchup_stats){0};
+}
+
+// One normal step of the loop: reference, controller, plant, analysis and LED.
+static void tim2_loop_step(void)
+{
+        if (tim2_loop_tick == 0UL)
+        {
+                boot_mark(BOOT_STAGE_FIRST_STEP);
+        }
+
         converter_type_t converter_type = converter_get_type();
 
         // The reference value chosen by the user.
@@ -148,11 +306,11 @@ void tim2_update_loop(void)
                  * update, in a slower rate. This slower rate here is TIM2 frequency.
                  */
 
-                // Update the pid control which makes the input for the plant.
-                u[0][0] = pid_update(ref, measurement);
-
-                // update the converter state vector with pid controller output as the input.
-                converter_update(u, y);
+                /*
+                 * Update the controller which makes the input for the plant, then update the
+                 * converter state vector with the controller output as the input.
+                 */
+                tim2_step_loop(ref, measurement);
 
                 /*
                  * The duty cycle for LED PWM in this type is calculated by normalizing the pid
@@ -174,10 +332,11 @@ void tim2_update_loop(void)
                 // Real reference value in this type is amplitude * sin(converter_ref_phase).
                 ref = ref * sinf(converter_ref_phase);
 
-                u[0][0] = pid_update(ref, measurement);
+                // Update the controller and the converter state vector.
+                tim2_step_loop(ref, measurement);
 
-                // update the converter state vector with pid controller output as the plant input.
-                converter_update(u, y);
+                // Accumulate the power-quality bins of the period in progress.
+                pq_update(converter_ref_phase, measurement);
 
                 /*
                  * The duty cycle for LED PWM in this type is the same as DC_DC_IDEAL type.
@@ -188,17 +347,81 @@ void tim2_update_loop(void)
                 duty = 100.0f * CLAMP(ABS_FLOAT(u[0][0] / REF_MAX), 0.0f, 1.0f);
         }
 
+        // Accumulate the performance metrics of this step (ref is the instantaneous reference).
+        metrics_update(pid_get_ref(), ref, measurement, u[0][0]);
+
         // Next, we change the brightness of the green LED.
         pwm_tim2_set_duty(duty);
+
+        // Check for inf/NaN or runaway values produced in this step and act on them.
+        health_check();
+
+        // Publish a consistent sample of this step for the readers outside the loop.
+        struct loop_snapshot sample = {.tick     = ++tim2_loop_tick,
+                                       .time_us  = time_now_us(),
+                                       .setpoint = pid_get_ref(),
+                                       .ref      = ref,
+                                       .phase    = converter_ref_phase,
+                                       .u        = u[0][0],
+                                       .y        = y[0][0]};
+        converter_get_state(sample.x);
+        snapshot_publish(&sample);
 }
 
-void tim3_read_button(void)
+/*
+ * One step of the closed loop. The controller type (PID, LQR, PR or MPC) is the one selected for
+ * the converter type. When a frequency-response sweep is running, its sine perturbation is added
+ * to the reference or to the controller output here.
+ */
+static void tim2_step_loop(float ref, float measurement)
 {
-        // Detect change in button status to register it as one button press.
-        bool button_is_pressed = gpio_button_is_pressed();
-        if (button_is_pressed && !button_last_push_status)
+        float perturbation = fra_get_perturbation();
+
+        if (fra_get_injection() == FRA_INJECT_REFERENCE)
+        {
+                ref += perturbation;
+                perturbation = 0.0f;
+        }
+
+        float controller_output = controller_update(ref, measurement);
+        u[0][0]                 = controller_output + perturbation;
+
+        // The observer of LQR and MPC must see the perturbed input, not the controller output.
+        controller_apply_input(u[0][0]);
+
+        // update the converter state vector with the plant input.
+        converter_update(u, y);
+
+        fra_update(controller_output, u[0][0], measurement);
+
+        // Identify the plant from the input it received and the output it produced.
+        sysid_update(u[0][0], y[0][0]);
+}
+
+/*
+ * Catch up missed releases in O(log steps): the plant runs over them with the last input held,
+ * as a real plant would while the controller was late, and the inverter reference phase moves on
+ * by the same time. The controller and the analysis modules do not see these steps.
+ */
+static void tim2_fast_forward(uint32_t steps)
+{
+        converter_fast_forward(steps, u[0][0]);
+
+        if (converter_get_type() == INVERTER_IDEAL)
+        {
+                // Whole periods of the reference are dropped first to keep the float exact.
+                uint32_t period_steps = (uint32_t)(SAMPLING_FREQUENCY / SINE_FREQUENCY);
+                float dphi            = (float)(steps % period_steps) * converter_ref_dphi;
+
+                converter_ref_phase = fmodf(converter_ref_phase + dphi, 2.0f * PI);
+        }
+}
+
+// Button task. A press edge is registered as one button press.
+void timer_read_button(const struct event *event)
+{
+        if (event->data.pressed)
         {
                 cli_button_handler();
         }
-        button_last_push_status = button_is_pressed;
 }
\ No newline at end of file
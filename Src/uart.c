@@ -9,39 +9,87 @@
  *     - Uses 115200 baud, 8 data bits, no parity, and 1 stop bit (8N1)
  *     - Enables transmit and receive functionality
  *     - Handles received characters via the USART2 RX interrupt
+ *     - Sends characters from a transmit buffer via the USART2 TX interrupt
  *
  * Notes:
  *     - USART2 is clocked from the APB1 peripheral bus.
- *     - RX data is captured in the USART2 interrupt handler.
- *     - USART2_IRQHandler handles RXNE interrupts for character reception.
- *     - printf is retargeted to UART by using uart2_write_char_blocking.
+ *     - RX data is captured in the USART2 interrupt handler and posted to the CLI task as one
+ *       event per byte.
+ *     - USART2_IRQHandler handles RXNE interrupts for character reception and TXE interrupts
+ *       for transmission.
+ *     - For binary transfers uart2_raw_receive_start() makes the interrupt handler store the bytes
+ *       directly into a buffer without waking up the CLI, so no byte is lost while the main loop
+ *       is busy. The transfer is complete when uart2_raw_receive_count() reaches the length.
+ *     - printf is retargeted to UART by using uart2_write_char, which queues the character in a
+ *       transmit ring buffer drained by the TXE interrupt. A task only waits for the wire when
+ *       the buffer is full, so a status line costs the time to format it, not to send it.
+ *       Nothing may print from an interrupt handler, it could wait forever for a full buffer.
  */
-#include <stdatomic.h>
-
 #include "stm32f4xx.h"
 
 #include "uart.h"
 
 #include "clock.h"
 #include "scheduler.h"
+#include "timebase.h"
 
 #define UART2_BAUDRATE 115200UL
+#define UART2_TX_LEN   1024U // Transmit ring buffer length (a power of two)
+
+// Binary transfer state (uart_raw_length is 0 when no transfer is armed)
+static uint8_t *uart_raw_buffer;
+static volatile uint16_t uart_raw_length = 0U;
+static volatile uint16_t uart_raw_count  = 0U;
 
-volatile uint8_t uart_read_char;
+// Transmit ring buffer (thread mode writes the head, the interrupt handler advances the tail)
+static char uart_tx_buffer[UART2_TX_LEN];
+static volatile uint16_t uart_tx_head = 0U;
+static volatile uint16_t uart_tx_tail = 0U;
 
 static uint32_t uart2_calc_brr(const uint32_t clock_freq, const uint32_t baud_rate);
 
 void USART2_IRQHandler(void)
 {
-        uart_read_char = (uint8_t)(USART2->DR & 0xFF);
+        // Send the next buffered character, or stop the TXE interrupt when the buffer is empty.
+        if ((USART2->CR1 & USART_CR1_TXEIE) && (USART2->SR & USART_SR_TXE))
+        {
+                if (uart_tx_tail != uart_tx_head)
+                {
+                        USART2->DR   = (uint8_t)uart_tx_buffer[uart_tx_tail];
+                        uart_tx_tail = (uart_tx_tail + 1U) & (UART2_TX_LEN - 1U);
+                }
+                else
+                {
+                        USART2->CR1 &= ~USART_CR1_TXEIE;
+                }
+        }
+
+        if (!(USART2->SR & USART_SR_RXNE))
+        {
+                return;
+        }
+
+        uint8_t ch = (uint8_t)(USART2->DR & 0xFF);
 
-        // Atomic modification of ready_flag_word to prevent race conditions.
-        atomic_fetch_or(&ready_flag_word, TASK1);
+        if (uart_raw_length != 0U)
+        {
+                if (uart_raw_count < uart_raw_length)
+                {
+                        uart_raw_buffer[uart_raw_count] = ch;
+                        uart_raw_count++;
+                }
+                return;
+        }
+
+        // Every byte is its own event, so bytes received while the CLI is busy wait in the queue.
+        struct event event = {.type = EVENT_BYTE, .time_us = time_now_us(), .data.byte = ch};
+        scheduler_post(QUEUE_UART, &event);
 }
 
 /*
  * Initialize USART2 for 115200 baud, 8 data bits, no parity, and 1 stop bit.
- * The peripheral clock for USART2 (APB1) is 50 MHz based on clock tree.
+ * The peripheral clock for USART2 (APB1) is 50 MHz based on clock tree, the baud rate is
+ * computed from the running PCLK1 and set again by uart2_rescale() after a clock switch.
  */
 void uart2_init(void)
 {
@@ -52,7 +100,7 @@ void uart2_init(void)
         USART2->CR1 = 0;
 
         // Set baud rate.
-        USART2->BRR = uart2_calc_brr(PCLK1, UART2_BAUDRATE);
+        USART2->BRR = uart2_calc_brr(clock_get_pclk1(), UART2_BAUDRATE);
 
         // Enable TX and RX.
         USART2->CR1 |= (USART_CR1_TE | USART_CR1_RE);
@@ -68,14 +116,53 @@ void uart2_init(void)
         USART2->CR1 |= USART_CR1_UE;
 }
 
-void uart2_write_char_blocking(char ch)
+void uart2_write_char(char ch)
+{
+        uint16_t next = (uart_tx_head + 1U) & (UART2_TX_LEN - 1U);
+
+        // Wait until the interrupt handler makes room in the buffer.
+        while (next == uart_tx_tail)
+                ;
+
+        uart_tx_buffer[uart_tx_head] = ch;
+        uart_tx_head                 = next;
+
+        // Enable TXE interrupt (it disables itself when the buffer runs empty).
+        USART2->CR1 |= USART_CR1_TXEIE;
+}
+
+// Wait until the last queued byte has left the shift register (before a clock switch).
+void uart2_wait_tx_done(void)
 {
-        // Wait until TXE flag is set.
-        while (!(USART2->SR & USART_SR_TXE))
+        while (!(USART2->SR & USART_SR_TC))
                 ;
+}
 
-        // Write the character to the data register.
-        USART2->DR = (uint8_t)ch;
+// Set the baud rate again for the current PCLK1 (after a clock switch).
+void uart2_rescale(void)
+{
+        USART2->BRR = uart2_calc_brr(clock_get_pclk1(), UART2_BAUDRATE);
+}
+
+// Store the next length received bytes into buffer instead of passing them to the CLI.
+void uart2_raw_receive_start(uint8_t *buffer, uint16_t length)
+{
+        NVIC_DisableIRQ(USART2_IRQn);
+        uart_raw_buffer = buffer;
+        uart_raw_count  = 0U;
+        uart_raw_length = length;
+        NVIC_EnableIRQ(USART2_IRQn);
+}
+
+// Return to normal character reception.
+void uart2_raw_receive_stop(void)
+{
+        uart_raw_length = 0U;
+}
+
+uint16_t uart2_raw_receive_count(void)
+{
+        return uart_raw_count;
 }
 
 /*
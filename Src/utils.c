@@ -5,6 +5,7 @@
  *     This module:
  *     - Converts ASCII numeric strings to floating-point values
  *     - Converts strings to lowercase in-place
+ *     - Computes the CRC-32 of a byte buffer
  *
  * Internal helpers:
  *     - str_to_uint32() converts a digit sequence to an unsigned 32-bit integer.
@@ -105,6 +106,28 @@ void str_to_lower(char *str)
         }
 }
 
+/*
+ * CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320) as computed by zlib.crc32() in Python.
+ * It is computed bit by bit without a table, which is fast enough for the short blobs received over
+ * UART.
+ */
+uint32_t crc32(const uint8_t *data, size_t length)
+{
+        uint32_t crc = 0xFFFFFFFFUL;
+
+        for (size_t i = 0; i < length; i++)
+        {
+                crc ^= data[i];
+
+                for (int bit = 0; bit < 8; bit++)
+                {
+                        crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1UL)));
+                }
+        }
+
+        return ~crc;
+}
+
 static uint32_t str_to_uint32(const char *str)
 {
         const char *p = str;
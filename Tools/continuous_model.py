@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""
+continuous_model.py
+
+Recovers the continuous-time model (Ac, Bc) of the converter from the discrete matrices in
+Src/converter.c, which are discretized with zero-order hold for h = 20 us, and prints the C tables
+ready to be pasted into Src/converter.c. The firmware discretizes them again (Src/c2d.c) for the
+configured model step.
+
+    Ac = logm(Ad) / h
+    Bc = (Ad - I)^-1 * Ac * Bd   (from Bd = Ac^-1 * (Ad - I) * Bc)
+
+C and D are the same in both forms.
+
+Usage:
+    python3 Tools/continuous_model.py
+"""
+
+import numpy as np
+from scipy.linalg import expm, logm
+
+from lqr_design import Ad, Bd
+
+H = 1.0 / 50000.0  # SAMPLING_FREQUENCY in Inc/converter.h
+
+
+def continuous():
+    n = Ad.shape[0]
+    Ac = logm(Ad) / H
+    if np.iscomplexobj(Ac):
+        if np.max(np.abs(Ac.imag)) > 1e-6:
+            raise ValueError("Ad has no real logarithm (negative real eigenvalue)")
+        Ac = Ac.real
+    Bc = np.linalg.solve(Ad - np.eye(n), Ac @ Bd)
+    return Ac, Bc
+
+
+def main():
+    Ac, Bc = continuous()
+    n = Ac.shape[0]
+
+    # Check the round trip with the same augmented-matrix exponential as the firmware.
+    M = np.zeros((n + 1, n + 1))
+    M[:n, :n] = Ac
+    M[:n, n:] = Bc
+    E = expm(M * H)
+    print("// round-trip error: Ad %.2e, Bd %.2e" % (np.max(np.abs(E[:n, :n] - Ad)),
+                                                    np.max(np.abs(E[:n, n:] - Bd))))
+    print("// continuous poles (rad/s):")
+    for pole in np.linalg.eigvals(Ac):
+        print("//     %.1f %+.1fj" % (pole.real, pole.imag))
+    # Rows are split in halves to stay within 100 columns.
+    print("const float converter_Ac[STATES_NUM][STATES_NUM] = {")
+    for row in Ac:
+        half = (n + 1) // 2
+        print("        {%s," % ", ".join(f"{v: .8e}f" for v in row[:half]))
+        print("         %s}," % ", ".join(f"{v: .8e}f" for v in row[half:]))
+    print("};")
+    print("const float converter_Bc[STATES_NUM][INPUTS_NUM] = {")
+    for v in Bc[:, 0]:
+        print("        {% .8ef}," % v)
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
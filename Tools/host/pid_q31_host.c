@@ -0,0 +1,114 @@
+/*
+ * pid_q31_host.c
+ *
+ * Description:
+ *     Host harness of the fixed-point PID controller (Src/pid_q31.c), driven by
+ *     Tools/pid_q31_test.py.
+ *
+ *     The controller source is included directly, so its static step and conversions are tested
+ *     as built for the target. Each line read from stdin is one command, and each command prints
+ *     one line with the resulting integers:
+ *
+ *         init <Ts> <int_min> <int_max> <out_min> <out_max>  -> Q31 limits
+ *         gains <kp> <ki> <kd>                                -> kp, ki*Ts, kd/Ts in Q format
+ *         qgains <kp> <ki_ts> <kd_ts>                         -> the same, set as raw integers
+ *         fit <kp> <ki> <kd>                                  -> 1 if the gains fit, else 0
+ *         run <reference> <measurement>                       -> output, integral, prev_error
+ *         reset                                               -> 0
+ *
+ *     Floats are read with strtof, so the test passes them as exact hexadecimal float literals.
+ *
+ * Notes:
+ *     - Build: gcc -std=gnu11 -O2 -ITools/host -IInc -ISrc Tools/host/pid_q31_host.c
+ *       (Tools/host comes first so its stm32f4xx.h replaces the device header).
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pid_q31.c"
+
+#define HOST_LINE_LEN 256
+
+int main(void)
+{
+        char line[HOST_LINE_LEN];
+
+        while (fgets(line, sizeof(line), stdin) != NULL)
+        {
+                char *arg[6] = {NULL};
+                int argc     = 0;
+
+                for (char *token = strtok(line, " \n"); token != NULL && argc < 6;
+                     token       = strtok(NULL, " \n"))
+                {
+                        arg[argc++] = token;
+                }
+
+                if (argc == 6 && strcmp(arg[0], "init") == 0)
+                {
+                        pid_q31_init(strtof(arg[1], NULL),
+                                     strtof(arg[2], NULL),
+                                     strtof(arg[3], NULL),
+                                     strtof(arg[4], NULL),
+                                     strtof(arg[5], NULL));
+                        printf("%" PRId32 " %" PRId32 " %" PRId32 " %" PRId32 "\n",
+                               pid_q31.int_out_min,
+                               pid_q31.int_out_max,
+                               pid_q31.controller_out_min,
+                               pid_q31.controller_out_max);
+                }
+                else if (argc == 4 && strcmp(arg[0], "gains") == 0)
+                {
+                        pid_q31_set_gains(strtof(arg[1], NULL),
+                                          strtof(arg[2], NULL),
+                                          strtof(arg[3], NULL));
+                        printf("%" PRId32 " %" PRId32 " %" PRId32 "\n",
+                               pid_q31.gains.kp,
+                               pid_q31.gains.ki_ts,
+                               pid_q31.gains.kd_ts);
+                }
+                else if (argc == 4 && strcmp(arg[0], "qgains") == 0)
+                {
+                        pid_q31.gains.kp    = (q31_t)strtol(arg[1], NULL, 10);
+                        pid_q31.gains.ki_ts = (q31_t)strtol(arg[2], NULL, 10);
+                        pid_q31.gains.kd_ts = (q31_t)strtol(arg[3], NULL, 10);
+                        printf("%" PRId32 " %" PRId32 " %" PRId32 "\n",
+                               pid_q31.gains.kp,
+                               pid_q31.gains.ki_ts,
+                               pid_q31.gains.kd_ts);
+                }
+                else if (argc == 4 && strcmp(arg[0], "fit") == 0)
+                {
+                        printf("%d\n",
+                               pid_q31_gains_fit(strtof(arg[1], NULL),
+                                                 strtof(arg[2], NULL),
+                                                 strtof(arg[3], NULL)));
+                }
+                else if (argc == 3 && strcmp(arg[0], "run") == 0)
+                {
+                        q31_t output = pid_q31_run(&pid_q31.gains,
+                                                   (q31_t)strtol(arg[1], NULL, 10),
+                                                   (q31_t)strtol(arg[2], NULL, 10));
+
+                        printf("%" PRId32 " %" PRId32 " %" PRId32 "\n",
+                               output,
+                               pid_q31.integral,
+                               pid_q31.prev_error);
+                }
+                else if (argc == 1 && strcmp(arg[0], "reset") == 0)
+                {
+                        pid_q31_reset();
+                        printf("0\n");
+                }
+                else
+                {
+                        fprintf(stderr, "unknown command\n");
+                        return 1;
+                }
+        }
+
+        return 0;
+}
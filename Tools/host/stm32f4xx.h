@@ -0,0 +1,39 @@
+/*
+ * stm32f4xx.h
+ *
+ * Description:
+ *     Host stand-in for the device header, used by the host test harnesses in Tools/host. It only
+ *     provides the CMSIS intrinsics the tested sources use, with the same saturating results as
+ *     the Cortex-M4 QADD and QSUB instructions.
+ */
+
+#ifndef STM32F4XX_HOST_H
+#define STM32F4XX_HOST_H
+
+#include <stdint.h>
+
+static inline int32_t host_saturate_q31(int64_t value)
+{
+        if (value > INT32_MAX)
+        {
+                return INT32_MAX;
+        }
+        if (value < INT32_MIN)
+        {
+                return INT32_MIN;
+        }
+
+        return (int32_t)value;
+}
+
+static inline int32_t __QADD(int32_t op1, int32_t op2)
+{
+        return host_saturate_q31((int64_t)op1 + op2);
+}
+
+static inline int32_t __QSUB(int32_t op1, int32_t op2)
+{
+        return host_saturate_q31((int64_t)op1 - op2);
+}
+
+#endif
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+lqr_design.py
+
+Computes the LQR state-feedback gain (with integral action), the reference feedforward gains and
+the steady-state Kalman observer gain for the converter model in Src/converter.c, and prints them as
+C tables ready to be pasted into Src/lqr.c.
+
+The matrices below are the 20 us discretization of the converter. Src/converter.c stores their
+continuous form (Tools/continuous_model.py) and reproduces them on the target.
+
+Usage:
+    python3 Tools/lqr_design.py
+"""
+
+import numpy as np
+from scipy.linalg import solve_discrete_are
+
+# fmt: off
+Ad = np.array([
+    [0.9652, -0.0172,  0.0057, -0.0058,  0.0052, -0.0251],
+    [0.7732,  0.1252,  0.2315,  0.0700,  0.1282,  0.7754],
+    [0.8278, -0.7522, -0.0956,  0.3299, -0.4855,  0.3915],
+    [0.9948,  0.2655, -0.3848,  0.4212,  0.3927,  0.2899],
+    [0.7648, -0.4165, -0.4855, -0.3366, -0.0986,  0.7281],
+    [1.1056,  0.7587, -0.1179,  0.0748, -0.2192,  0.1491],
+])
+Bd = np.array([[0.0471], [0.0377], [0.4040], [0.0485], [0.0373], [0.0539]])
+Cd = np.array([[0.0, 0.0, 0.0, 0.0, 0.0, 1.0]])
+# fmt: on
+
+n = Ad.shape[0]
+
+# LQR weights on the augmented state z = [x; xi], where xi[k+1] = xi[k] + (r - y[k]).
+Q_Y = 10.0  # output error weight
+Q_X = 0.01  # small weight on every state to keep the internal modes damped
+Q_I = 0.05  # integral state weight
+R_U = 0.1   # input weight
+
+# Kalman filter noise covariances (process and measurement).
+W_PROC = 1e-3
+V_MEAS = 1e-2
+
+
+def lqr_gains():
+    A = np.block([[Ad, np.zeros((n, 1))], [-Cd, np.eye(1)]])
+    B = np.vstack([Bd, np.zeros((1, 1))])
+    Q = np.zeros((n + 1, n + 1))
+    Q[:n, :n] = Q_Y * Cd.T @ Cd + Q_X * np.eye(n)
+    Q[n, n] = Q_I
+    R = np.array([[R_U]])
+    P = solve_discrete_are(A, B, Q, R)
+    K = np.linalg.solve(R + B.T @ P @ B, B.T @ P @ A)
+    return K[:, :n], K[0, n]
+
+
+def feedforward():
+    # Steady state for a unit reference: [A - I, B; C, 0] [Nx; Nu] = [0; 1].
+    M = np.block([[Ad - np.eye(n), Bd], [Cd, np.zeros((1, 1))]])
+    rhs = np.vstack([np.zeros((n, 1)), np.ones((1, 1))])
+    N = np.linalg.solve(M, rhs)
+    return N[:n, 0], N[n, 0]
+
+
+def kalman_gain():
+    # Steady-state filter gain M for the current-estimator form.
+    P = solve_discrete_are(Ad.T, Cd.T, W_PROC * np.eye(n), np.array([[V_MEAS]]))
+    return (P @ Cd.T @ np.linalg.inv(Cd @ P @ Cd.T + V_MEAS))[:, 0]
+
+
+def c_row(values):
+    return "{" + ", ".join(f"{v: .6f}f" for v in values) + "}"
+
+
+def main():
+    K, Ki = lqr_gains()
+    Nx, Nu = feedforward()
+    M = kalman_gain()
+
+    print("// closed-loop spectral radius: %.4f" % max(abs(np.linalg.eigvals(
+        np.block([[Ad - Bd @ K, Bd * -Ki], [-Cd, np.eye(1)]])))))
+    print("// observer spectral radius:    %.4f" % max(abs(np.linalg.eigvals(
+        (np.eye(n) - np.outer(M, Cd)) @ Ad))))
+    print("static const float lqr_K[STATES_NUM] = %s;" % c_row(K[0]))
+    print("static const float lqr_Ki            = %.6ff;" % Ki)
+    print("static const float lqr_Nx[STATES_NUM] = %s;" % c_row(Nx))
+    print("static const float lqr_Nu            = %.6ff;" % Nu)
+    print("static const float observer_M[STATES_NUM] = %s;" % c_row(M))
+
+
+if __name__ == "__main__":
+    main()
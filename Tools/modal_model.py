@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+modal_model.py
+
+Computes the real modal (block-diagonal) realization of the continuous converter model and prints
+the C tables ready to be pasted into Src/modal.c.
+
+Every complex pole pair s = sigma +- j*omega with eigenvector v = vr + j*vi gives the real basis
+[vr vi], in which the block of A is
+
+    [ sigma  omega]
+    [-omega  sigma]
+
+and a real pole sigma with eigenvector v gives a 1x1 block. With T = [vr1 vi1 vr2 vi2 ...]:
+
+    Am = T^-1 * Ac * T,  Bm = T^-1 * Bc,  Cm = Cd * T
+
+The firmware discretizes the blocks in closed form for its model step.
+
+Usage:
+    python3 Tools/modal_model.py
+"""
+
+import numpy as np
+
+from continuous_model import continuous
+from lqr_design import Cd
+
+
+def modal():
+    Ac, Bc = continuous()
+    n = Ac.shape[0]
+    poles, vectors = np.linalg.eig(Ac)
+
+    # One entry per real pole or complex pair, slowest mode first.
+    keep = [i for i in range(n) if poles[i].imag >= 0.0]
+    keep.sort(key=lambda i: -poles[i].real)
+
+    T = np.zeros((n, n))
+    blocks = []
+    column = 0
+    for i in keep:
+        v = vectors[:, i]
+        if abs(poles[i].imag) > 0.0:
+            T[:, column] = v.real
+            T[:, column + 1] = v.imag
+            blocks.append((2, poles[i].real, poles[i].imag))
+            column += 2
+        else:
+            T[:, column] = v.real
+            blocks.append((1, poles[i].real, 0.0))
+            column += 1
+
+    Bm = np.linalg.solve(T, Bc)[:, 0]
+    Cm = (Cd @ T)[0]
+    residual = np.max(np.abs(np.linalg.solve(T, Ac @ T) - block_matrix(blocks)))
+    return blocks, Bm, Cm, residual, np.linalg.cond(T)
+
+
+def block_matrix(blocks):
+    n = sum(size for size, _, _ in blocks)
+    A = np.zeros((n, n))
+    i = 0
+    for size, sigma, omega in blocks:
+        A[i, i] = sigma
+        if size == 2:
+            A[i, i + 1] = omega
+            A[i + 1, i] = -omega
+            A[i + 1, i + 1] = sigma
+        i += size
+    return A
+
+
+def main():
+    blocks, Bm, Cm, residual, cond = modal()
+
+    print("// block residual %.2e, cond(T) %.2f" % (residual, cond))
+    print("static const struct modal_block modal_blocks[] = {")
+    for size, sigma, omega in blocks:
+        print("        {%d, % .8ef, % .8ef}," % (size, sigma, omega))
+    print("};")
+    for name, values in (("modal_Bc", Bm), ("modal_Cc", Cm)):
+        print("static const float %s[STATES_NUM] = {" % name)
+        for i in range(0, len(values), 3):
+            print("        %s," % ", ".join(f"{v: .8e}f" for v in values[i:i + 3]))
+        print("};")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""
+model_blob.py
+
+Builds the binary blob of a discrete state-space model for the runtime model store (Src/model.c)
+and optionally sends it to the board.
+
+Blob layout (little-endian):
+
+    'S', 'S', version, n
+    float32 A[n][n] (row-major), B[n], C[n], D
+    uint32 CRC-32 (zlib) of all the preceding bytes
+
+Version 1 is a discrete model for the 20 us model step. Version 2 (--continuous) is a continuous
+model that the board discretizes for its configured step.
+
+The model is read from an .npz file with the arrays A, B, C and optionally D (single input, single
+output, at most 8 states). Without a file the built-in converter model is used.
+
+Usage:
+    python3 Tools/model_blob.py [model.npz] [--continuous] -o model.bin
+    python3 Tools/model_blob.py [model.npz] [--continuous] --port /dev/ttyACM0
+
+With --port the "model load <n>" command is typed first and then the blob is sent (needs pyserial).
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import numpy as np
+
+from lqr_design import Ad, Bd, Cd
+
+MAGIC = b"SS"
+DISCRETE = 1
+CONTINUOUS = 2
+STATES_MAX = 8
+
+
+def build_blob(A, B, C, D, continuous=False):
+    A = np.atleast_2d(np.asarray(A, dtype=np.float32))
+    n = A.shape[0]
+    B = np.asarray(B, dtype=np.float32).reshape(-1)
+    C = np.asarray(C, dtype=np.float32).reshape(-1)
+    D = np.asarray(D, dtype=np.float32).reshape(-1)
+
+    if A.shape != (n, n) or B.shape != (n,) or C.shape != (n,) or D.shape != (1,):
+        raise ValueError("expected a single-input single-output model (A n*n, B n, C n, D 1)")
+    if not 1 <= n <= STATES_MAX:
+        raise ValueError(f"the order must be between 1 and {STATES_MAX}")
+
+    poles = np.linalg.eigvals(A.astype(np.float64))
+    if continuous and max(poles.real) >= 0.0:
+        print("warning: pole in the right half-plane, the board will reject this model",
+              file=sys.stderr)
+    if not continuous and max(abs(poles)) >= 1.0:
+        print(f"warning: spectral radius {max(abs(poles)):.5f}, the board will reject this model",
+              file=sys.stderr)
+
+    body = MAGIC + bytes([CONTINUOUS if continuous else DISCRETE, n])
+    body += np.concatenate([A.reshape(-1), B, C, D]).astype("<f4").tobytes()
+    return body + struct.pack("<I", zlib.crc32(body))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("model", nargs="?", help=".npz file with A, B, C and optionally D")
+    parser.add_argument("--continuous", action="store_true",
+                        help="the model is continuous, the board discretizes it")
+    parser.add_argument("-o", "--output", help="write the blob to this file")
+    parser.add_argument("--port", help="send the blob to the board on this serial port")
+    args = parser.parse_args()
+
+    if args.model:
+        data = np.load(args.model)
+        A, B, C = data["A"], data["B"], data["C"]
+        D = data["D"] if "D" in data else np.zeros(1)
+    else:
+        A, B, C, D = Ad, Bd, Cd, np.zeros(1)
+
+    blob = build_blob(A, B, C, D, args.continuous)
+    n = blob[3]
+    print(f"{n} states, {len(blob)} bytes, CRC 0x{zlib.crc32(blob[:-4]):08x}")
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(blob)
+
+    if args.port:
+        import serial
+
+        with serial.Serial(args.port, 115200, timeout=1) as port:
+            port.write(f"model load {n}\r".encode())
+            time.sleep(0.2)
+            port.write(blob)
+            time.sleep(0.5)
+            sys.stdout.write(port.read(port.in_waiting or 1).decode(errors="replace"))
+
+
+if __name__ == "__main__":
+    main()
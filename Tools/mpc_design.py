@@ -0,0 +1,174 @@
+#!/usr/bin/env python3
+"""
+mpc_design.py
+
+Computes the explicit (piecewise-affine) solution of the input-constrained MPC problem for the
+converter model in Src/converter.c and prints the region tables ready to be pasted into Src/mpc.c.
+
+Problem, with theta = [x_hat; r] as the parameter and dx = x - Nx*r, du = u - Nu*r:
+
+    min  sum_{k=0}^{N-1} (dx_k' Q dx_k + R du_k^2) + dx_N' P dx_N
+    s.t. dx_{k+1} = Ad dx_k + Bd du_k
+         U_MIN <= u_k <= U_MAX
+
+P is the solution of the discrete algebraic Riccati equation, so the unconstrained region gives
+the plain LQR law. Every candidate active set of the input constraints is solved from the KKT
+conditions, and kept if its critical region has a non-empty interior. Each region is stored as
+
+    H*theta <= k  (primal feasibility of inactive constraints and dual feasibility of active ones)
+    u_0 = F*theta + g
+
+The model and weights must be kept identical to Src/converter.c and Tools/lqr_design.py.
+
+Usage:
+    python3 Tools/mpc_design.py
+"""
+
+import itertools
+
+import numpy as np
+from scipy.linalg import solve_discrete_are
+from scipy.optimize import linprog
+
+from lqr_design import Ad, Bd, Cd, Q_X, Q_Y, R_U, feedforward
+
+HORIZON = 3
+U_MIN = -60.0  # controller_out_min in Src/main.c
+U_MAX = 60.0   # controller_out_max in Src/main.c
+THETA_BOX = 200.0  # parameter box used only to bound the interior test LPs
+
+
+def mpqp():
+    n = Ad.shape[0]
+    N = HORIZON
+    Q = Q_Y * Cd.T @ Cd + Q_X * np.eye(n)
+    R = np.array([[R_U]])
+    P = solve_discrete_are(Ad, Bd, Q, R)
+    Nx, Nu = feedforward()
+
+    # Prediction: dX = Sx dx0 + Su dU for dX = [dx_1 .. dx_N].
+    Sx = np.vstack([np.linalg.matrix_power(Ad, k + 1) for k in range(N)])
+    Su = np.zeros((N * n, N))
+    for k in range(N):
+        for j in range(k + 1):
+            Su[k * n:(k + 1) * n, j:j + 1] = np.linalg.matrix_power(Ad, k - j) @ Bd
+    Qbar = np.kron(np.eye(N), Q)
+    Qbar[-n:, -n:] = P
+    Rbar = np.kron(np.eye(N), R)
+
+    # dx0 = E theta, with theta = [x_hat; r].
+    E = np.hstack([np.eye(n), -Nx.reshape(n, 1)])
+    H = Su.T @ Qbar @ Su + Rbar
+    F = Su.T @ Qbar @ Sx @ E  # cost is 1/2 dU' H dU + theta' F' dU (times 2)
+
+    # Constraints on dU: G dU <= w + S theta.
+    G = np.vstack([np.eye(N), -np.eye(N)])
+    w = np.concatenate([np.full(N, U_MAX), np.full(N, -U_MIN)])
+    S = np.zeros((2 * N, n + 1))
+    S[:N, n] = -Nu
+    S[N:, n] = Nu
+
+    regions = []
+    # Each input is free (0), at its upper bound (1) or at its lower bound (2).
+    for pattern in itertools.product(range(3), repeat=N):
+        active = [k if p == 1 else N + k for k, p in enumerate(pattern) if p != 0]
+        inactive = [i for i in range(2 * N) if i not in active]
+        Hinv = np.linalg.inv(H)
+        if active:
+            Ga = G[active]
+            M = Ga @ Hinv @ Ga.T
+            Minv = np.linalg.inv(M)
+            # lambda(theta) = -Minv (w_a + S_a theta + Ga Hinv F theta)
+            lam_T = -Minv @ (S[active] + Ga @ Hinv @ F)
+            lam_c = -Minv @ w[active]
+            dU_T = -Hinv @ (F + Ga.T @ lam_T)
+            dU_c = -Hinv @ (Ga.T @ lam_c)
+        else:
+            lam_T = np.zeros((0, n + 1))
+            lam_c = np.zeros(0)
+            dU_T = -Hinv @ F
+            dU_c = np.zeros(N)
+
+        # Region rows: G_i dU <= w_i + S_i theta (inactive) and -lambda <= 0 (active).
+        rows = [G[i] @ dU_T - S[i] for i in inactive] + list(-lam_T)
+        offs = [w[i] - G[i] @ dU_c for i in inactive] + list(lam_c)
+        A_ub = np.array(rows)
+        b_ub = np.array(offs)
+
+        # Chebyshev ball inside the region and the parameter box: maximize the radius.
+        norms = np.linalg.norm(A_ub, axis=1)
+        A_lp = np.hstack([A_ub, norms.reshape(-1, 1)])
+        res = linprog(np.r_[np.zeros(n + 1), -1.0],
+                      A_ub=A_lp,
+                      b_ub=b_ub,
+                      bounds=[(-THETA_BOX, THETA_BOX)] * (n + 1) + [(0, None)])
+        if res.status != 0 or res.x[-1] < 1e-6:
+            continue
+
+        A_ub, b_ub = remove_redundant_rows(A_ub, b_ub, n + 1)
+
+        # First move in absolute terms: u_0 = du_0 + Nu r.
+        F0 = dU_T[0].copy()
+        F0[n] += Nu
+        regions.append((len(active), A_ub, b_ub, F0, dU_c[0]))
+
+    # The unconstrained region comes first, it is the most likely one near the reference.
+    regions.sort(key=lambda reg: reg[0])
+    return regions
+
+
+def remove_redundant_rows(A_ub, b_ub, dim):
+    # A row is redundant if it cannot be violated while all other rows (and the box) hold.
+    keep = list(range(A_ub.shape[0]))
+    for i in range(A_ub.shape[0]):
+        others = [j for j in keep if j != i]
+        if np.linalg.norm(A_ub[i]) < 1e-9:
+            keep = others
+            continue
+        res = linprog(-A_ub[i],
+                      A_ub=A_ub[others] if others else None,
+                      b_ub=b_ub[others] if others else None,
+                      bounds=[(-THETA_BOX, THETA_BOX)] * dim)
+        if res.status == 0 and -res.fun <= b_ub[i] + 1e-9:
+            keep = others
+    return A_ub[keep], b_ub[keep]
+
+
+def c_float(v):
+    # Round-off residue of the KKT solution is printed as an exact zero.
+    text = f"{0.0 if abs(v) < 1e-9 else v:.7g}"
+    if "." not in text and "e" not in text:
+        text += ".0"
+    return text + "f"
+
+
+def c_row(values, indent):
+    # Seven values per line to stay within the column limit.
+    items = [c_float(v) for v in values]
+    lines = [", ".join(items[i:i + 7]) for i in range(0, len(items), 7)]
+    return "{" + (",\n" + " " * (indent + 1)).join(lines) + "}"
+
+
+def main():
+    regions = mpqp()
+    rows_max = max(reg[1].shape[0] for reg in regions)
+    print("// %d regions, at most %d rows per region, horizon %d" %
+          (len(regions), rows_max, HORIZON))
+    print("#define MPC_REGIONS_NUM %d" % len(regions))
+    print("#define MPC_ROWS_MAX    %d" % rows_max)
+    print("static const struct mpc_region mpc_regions[MPC_REGIONS_NUM] = {")
+    for i, (_, A_ub, b_ub, F0, g0) in enumerate(regions):
+        print("        // region %d" % i)
+        print("        {%d," % A_ub.shape[0])
+        print("         {")
+        for row in A_ub:
+            print("          %s," % c_row(row, 10))
+        print("         },")
+        print("         %s," % c_row(b_ub, 9))
+        print("         %s," % c_row(F0, 9))
+        print("         %s}," % c_float(g0))
+    print("};")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""
+pid_q31_ref.py
+
+Reference model of the fixed-point PID controller (Src/pid_q31.c) in integer arithmetic.
+
+Every step follows the C source: saturating QADD/QSUB, 64-bit products truncated with an
+arithmetic shift and saturated to Q31, and the float-to-Q31 conversions done in IEEE single
+precision (emulated with struct) and truncated towards zero. The model is exact, so the C
+controller must match it bit for bit (Tools/pid_q31_test.py).
+
+Q formats:
+    voltages    Q31, 1.0 = 128 V
+    kp, kd/Ts   Q8.23 (range +-256)
+    ki*Ts       Q0.31 (range +-1)
+"""
+
+import math
+import struct
+
+INT32_MAX = 2**31 - 1
+INT32_MIN = -(2**31)
+
+VOLTAGE_FS = 128.0
+GAIN_FS = 256.0
+GAIN_SHIFT = 23
+Q31_ONE = 2.0**31
+
+
+def f32(value):
+    """Round a Python float to IEEE single precision (beyond its range to +-inf)."""
+    try:
+        return struct.unpack("<f", struct.pack("<f", value))[0]
+    except OverflowError:
+        return math.copysign(math.inf, value)
+
+
+def saturate(value):
+    return max(INT32_MIN, min(INT32_MAX, value))
+
+
+def qadd(a, b):
+    return saturate(a + b)
+
+
+def qsub(a, b):
+    return saturate(a - b)
+
+
+def clamp(value, low, high):
+    return low if value < low else high if value > high else value
+
+
+def from_float(value, full_scale):
+    """pid_q31_from_float(): value / full_scale in Q31, saturated."""
+    scaled = f32(f32(value) * f32(Q31_ONE / f32(full_scale)))
+
+    if scaled >= Q31_ONE:
+        return INT32_MAX
+    if scaled <= -Q31_ONE:
+        return INT32_MIN
+
+    return int(scaled)
+
+
+class PidQ31:
+    def __init__(self, Ts, int_out_min, int_out_max, controller_out_min, controller_out_max):
+        self.Ts = f32(Ts)
+        self.int_out_min = from_float(int_out_min, VOLTAGE_FS)
+        self.int_out_max = from_float(int_out_max, VOLTAGE_FS)
+        self.controller_out_min = from_float(controller_out_min, VOLTAGE_FS)
+        self.controller_out_max = from_float(controller_out_max, VOLTAGE_FS)
+        self.kp = self.ki_ts = self.kd_ts = 0
+        self.reset()
+
+    def reset(self):
+        self.integral = 0
+        self.prev_error = 0
+
+    def limits(self):
+        return (self.int_out_min, self.int_out_max, self.controller_out_min, self.controller_out_max)
+
+    def set_gains(self, kp, ki, kd):
+        """pid_q31_convert_gains(): ki*Ts and kd/Ts are formed in single precision."""
+        kp, ki, kd = f32(kp), f32(ki), f32(kd)
+
+        self.kp = clamp(from_float(kp, GAIN_FS), -INT32_MAX, INT32_MAX)
+        self.ki_ts = from_float(f32(ki * self.Ts), 1.0)
+        self.kd_ts = clamp(from_float(f32(kd / self.Ts), GAIN_FS), -INT32_MAX, INT32_MAX)
+
+        return (self.kp, self.ki_ts, self.kd_ts)
+
+    def set_q_gains(self, kp, ki_ts, kd_ts):
+        self.kp, self.ki_ts, self.kd_ts = kp, ki_ts, kd_ts
+
+        return (self.kp, self.ki_ts, self.kd_ts)
+
+    def gains_fit(self, kp, ki, kd):
+        """pid_q31_gains_fit(): the limits are single-precision expressions of Ts."""
+        ki_max = f32(1.0 / self.Ts)
+        kd_max = f32(GAIN_FS * self.Ts)
+
+        return abs(f32(kp)) < GAIN_FS and abs(f32(ki)) < ki_max and abs(f32(kd)) < kd_max
+
+    def run(self, reference, measurement):
+        """pid_q31_run() with Q31 reference and measurement."""
+        error = qsub(reference, measurement)
+
+        integral_step = saturate((self.ki_ts * error) >> 31)
+        self.integral = qadd(self.integral, integral_step)
+        self.integral = clamp(self.integral, self.int_out_min, self.int_out_max)
+
+        accumulator = self.kp * error + self.kd_ts * qsub(error, self.prev_error)
+        assert -(2**63) <= accumulator < 2**63, "64-bit accumulator overflow"
+        pd = saturate(accumulator >> GAIN_SHIFT)
+
+        output = qadd(pd, self.integral)
+        output = clamp(output, self.controller_out_min, self.controller_out_max)
+
+        self.prev_error = error
+
+        return (output, self.integral, self.prev_error)
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""
+pid_q31_test.py
+
+Bit-exact host test of the fixed-point PID controller (Src/pid_q31.c) against the integer
+reference model in pid_q31_ref.py.
+
+The controller source is compiled for the host with Tools/host/pid_q31_host.c, which replaces the
+device header with saturating QADD/QSUB shims. The same command sequence is run through the
+harness and the model, and every printed integer must match:
+    - Q31 conversion of the limits, including limits beyond the 128 V full scale
+    - gain conversion (kp, ki*Ts, kd/Ts), including gains beyond their Q range and +-inf
+    - the gain range check used to reject gains in controller.c
+    - random closed sequences of steps, and directed saturation and overflow cases: full-scale
+      errors, the -1 * -1 integral product, saturated P+D sums and clamped integral and output
+
+Usage:
+    python3 Tools/pid_q31_test.py [--steps N] [--seed S] [--cc gcc]
+
+Exits with status 1 and prints the first mismatches if the controller and the model differ.
+"""
+
+import argparse
+import os
+import random
+import subprocess
+import sys
+import tempfile
+
+from pid_q31_ref import INT32_MAX, INT32_MIN, PidQ31, f32
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(TOOLS_DIR)
+
+TS = 1.0 / 50000.0  # Model step of the converter (SAMPLING_FREQUENCY)
+LIMITS = (-50.0, 50.0, -60.0, 60.0)  # Integral and output limits of main.c
+
+EDGE_Q31 = [INT32_MIN, INT32_MIN + 1, -(2**30), -1, 0, 1, 2**30, INT32_MAX - 1, INT32_MAX]
+EDGE_GAINS = [
+    (255.99, 0.0, 0.0),
+    (256.0, 0.0, 0.0),
+    (-256.0, 0.0, 0.0),
+    (1e30, -1e30, 1e30),
+    (float("inf"), float("-inf"), float("inf")),
+    (0.0, 49999.0, 0.0),
+    (0.0, 50000.0, 0.0),
+    (0.0, -50000.0, 0.0),
+    (0.0, 0.0, 5.11e-3),
+    (0.0, 0.0, 5.12e-3),
+    (0.0, 0.0, -5.12e-3),
+    (1e-12, 1e-12, 1e-12),
+]
+
+
+def build_harness(cc, directory):
+    source = os.path.join(TOOLS_DIR, "host", "pid_q31_host.c")
+    binary = os.path.join(directory, "pid_q31_host")
+    command = [
+        cc,
+        "-std=gnu11",
+        "-O2",
+        "-Wall",
+        "-I" + os.path.join(TOOLS_DIR, "host"),
+        "-I" + os.path.join(REPO_DIR, "Inc"),
+        "-I" + os.path.join(REPO_DIR, "Src"),
+        source,
+        "-o",
+        binary,
+    ]
+    subprocess.run(command, check=True)
+
+    return binary
+
+
+def fmt(value):
+    """Exact float literal for strtof."""
+    return f32(value).hex()
+
+
+class Session:
+    """Runs every command through the model and records the command for the harness."""
+
+    def __init__(self):
+        self.commands = []
+        self.expected = []
+        self.model = None
+
+    def add(self, command, result):
+        self.commands.append(command)
+        self.expected.append(" ".join(str(int(v)) for v in result))
+
+    def init(self, Ts, int_min, int_max, out_min, out_max):
+        self.model = PidQ31(Ts, int_min, int_max, out_min, out_max)
+        args = " ".join(fmt(v) for v in (Ts, int_min, int_max, out_min, out_max))
+        self.add("init " + args, self.model.limits())
+
+    def gains(self, kp, ki, kd):
+        args = " ".join(fmt(v) for v in (kp, ki, kd))
+        self.add("gains " + args, self.model.set_gains(kp, ki, kd))
+
+    def q_gains(self, kp, ki_ts, kd_ts):
+        self.add("qgains %d %d %d" % (kp, ki_ts, kd_ts), self.model.set_q_gains(kp, ki_ts, kd_ts))
+
+    def fit(self, kp, ki, kd):
+        args = " ".join(fmt(v) for v in (kp, ki, kd))
+        self.add("fit " + args, (self.model.gains_fit(kp, ki, kd),))
+
+    def run(self, reference, measurement):
+        self.add("run %d %d" % (reference, measurement), self.model.run(reference, measurement))
+
+    def reset(self):
+        self.model.reset()
+        self.add("reset", (0,))
+
+
+def build_session(steps, seed):
+    rng = random.Random(seed)
+    session = Session()
+
+    # Limits inside and beyond the 128 V full scale.
+    session.init(TS, -200.0, 200.0, -1e9, 1e9)
+    session.init(TS, *LIMITS)
+
+    # Gain conversion and range check.
+    for kp, ki, kd in EDGE_GAINS:
+        session.gains(kp, ki, kd)
+        session.fit(kp, ki, kd)
+    for _ in range(500):
+        kp = rng.uniform(-300.0, 300.0)
+        ki = rng.uniform(-60000.0, 60000.0)
+        kd = rng.uniform(-6e-3, 6e-3)
+        session.gains(kp, ki, kd)
+        session.fit(kp, ki, kd)
+
+    # Random closed sequences with gains that fit, from realistic to full-scale signals.
+    for sequence in range(steps // 100):
+        session.gains(rng.uniform(-255.0, 255.0), rng.uniform(-49999.0, 49999.0),
+                      rng.uniform(-5.1e-3, 5.1e-3))
+        session.reset()
+        span = INT32_MAX if sequence % 2 else 2**25
+        for _ in range(100):
+            session.run(rng.randint(-span, span), rng.randint(-span, span))
+
+    # Saturated error and difference, the -1 * -1 integral product and the extreme Q gains.
+    session.init(TS, -200.0, 200.0, -200.0, 200.0)
+    for kp, ki_ts, kd_ts in [
+        (INT32_MAX, INT32_MAX, INT32_MAX),
+        (-INT32_MAX, INT32_MIN, -INT32_MAX),
+        (INT32_MAX, INT32_MIN, -INT32_MAX),
+        (-INT32_MAX, INT32_MAX, INT32_MAX),
+        (0, INT32_MIN, 0),
+    ]:
+        session.q_gains(kp, ki_ts, kd_ts)
+        session.reset()
+        for reference in EDGE_Q31:
+            for measurement in EDGE_Q31:
+                session.run(reference, measurement)
+
+    # Integral and output clamped by the limits of main.c.
+    session.init(TS, *LIMITS)
+    session.gains(10.0, 40000.0, 1e-3)
+    session.reset()
+    for k in range(2000):
+        session.run(INT32_MAX if (k // 500) % 2 == 0 else INT32_MIN, 0)
+
+    return session
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n\n")[1])
+    parser.add_argument("--steps", type=int, default=20000, help="random steps to run")
+    parser.add_argument("--seed", type=int, default=1, help="seed of the random sequences")
+    parser.add_argument("--cc", default="gcc", help="host C compiler")
+    args = parser.parse_args()
+
+    session = build_session(args.steps, args.seed)
+
+    with tempfile.TemporaryDirectory() as directory:
+        binary = build_harness(args.cc, directory)
+        result = subprocess.run([binary],
+                                input="\n".join(session.commands) + "\n",
+                                capture_output=True,
+                                text=True,
+                                check=True)
+
+    actual = result.stdout.splitlines()
+    mismatches = [(i, command, expected, got)
+                  for i, (command, expected, got)
+                  in enumerate(zip(session.commands, session.expected, actual))
+                  if expected != got]
+
+    if len(actual) != len(session.expected):
+        print("harness printed %d lines for %d commands" % (len(actual), len(session.expected)))
+        return 1
+
+    for i, command, expected, got in mismatches[:10]:
+        print("%d: %s\n    model %s\n    C     %s" % (i, command, expected, got))
+
+    print("%d commands, %d mismatches" % (len(session.commands), len(mismatches)))
+
+    return 1 if mismatches else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())